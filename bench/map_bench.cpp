@@ -0,0 +1,109 @@
+// Compares lox::Map with std::unordered_map holding the same std::any values:
+// inserts, lookups that hit, and lookups that miss, for number and string
+// keys. Build with -DLOX_BUILD_BENCHMARKS=ON and run `map_bench [sizes...]`.
+#include "../src/map.hpp"
+
+#include <algorithm>
+#include <any>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+double nanoseconds_per(Clock::time_point start, size_t operations) {
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / operations;
+}
+
+struct Result {
+    double insert, hit, miss;
+};
+
+void report(const char* table, const char* keys, size_t size, Result result) {
+    std::printf("%-14s %-7s %10zu %9.1f %9.1f %9.1f\n", table, keys, size, result.insert, result.hit, result.miss);
+}
+
+// Keys are built up front so neither table is charged for making them, and
+// looked up in a different order than they went in, so a table whose nodes
+// sit in insertion order gets no help from the prefetcher.
+template <typename Key>
+Result run_map(const std::vector<Key>& present, const std::vector<Key>& shuffled, const std::vector<Key>& absent) {
+    std::vector<std::any> in(present.begin(), present.end()), out(absent.begin(), absent.end());
+    std::vector<std::any> lookups(shuffled.begin(), shuffled.end());
+    lox::Map map;
+    double found = 0;
+
+    auto start = Clock::now();
+    for (size_t i = 0; i < in.size(); i++) map.insert(in[i], double(i));
+    double insert = nanoseconds_per(start, in.size());
+
+    start = Clock::now();
+    for (const auto& key: lookups) found += std::any_cast<double>(*map.find(key));
+    double hit = nanoseconds_per(start, lookups.size());
+
+    start = Clock::now();
+    for (const auto& key: out) found += map.find(key) != nullptr;
+    double miss = nanoseconds_per(start, out.size());
+
+    if (found < 0) std::puts("");
+    return {insert, hit, miss};
+}
+
+template <typename Key>
+Result run_unordered(const std::vector<Key>& present, const std::vector<Key>& shuffled, const std::vector<Key>& absent) {
+    std::unordered_map<Key, std::any> map;
+    double found = 0;
+
+    auto start = Clock::now();
+    for (size_t i = 0; i < present.size(); i++) map.insert_or_assign(present[i], double(i));
+    double insert = nanoseconds_per(start, present.size());
+
+    start = Clock::now();
+    for (const auto& key: shuffled) found += std::any_cast<double>(map.find(key)->second);
+    double hit = nanoseconds_per(start, shuffled.size());
+
+    start = Clock::now();
+    for (const auto& key: absent) found += map.find(key) != map.end();
+    double miss = nanoseconds_per(start, absent.size());
+
+    if (found < 0) std::puts("");
+    return {insert, hit, miss};
+}
+
+template <typename Key, typename Make>
+void compare(const char* name, size_t size, Make make) {
+    std::vector<Key> present, absent;
+    present.reserve(size);
+    absent.reserve(size);
+    // Spread the keys so neither table sees them in hash order.
+    for (size_t i = 0; i < size; i++) {
+        present.push_back(make(i * 2654435761u % (size * 4) * 2));
+        absent.push_back(make(i * 2654435761u % (size * 4) * 2 + 1));
+    }
+
+    std::vector<Key> shuffled = present;
+    std::shuffle(shuffled.begin(), shuffled.end(), std::mt19937_64(size));
+
+    report("lox::Map", name, size, run_map(present, shuffled, absent));
+    report("unordered_map", name, size, run_unordered(present, shuffled, absent));
+}
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::vector<size_t> sizes;
+    for (int i = 1; i < argc; i++) sizes.push_back(std::strtoull(argv[i], nullptr, 10));
+    if (sizes.empty()) sizes = {1000, 1000000, 10000000};
+
+    std::printf("%-14s %-7s %10s %9s %9s %9s\n", "table", "keys", "entries", "insert", "hit", "miss");
+    std::printf("%-14s %-7s %10s %9s %9s %9s\n", "", "", "", "ns/op", "ns/op", "ns/op");
+    for (size_t size: sizes) {
+        compare<double>("number", size, [](size_t i) { return double(i); });
+        compare<std::string>("string", size, [](size_t i) { return "key" + std::to_string(i); });
+    }
+    return 0;
+}
@@ -0,0 +1,82 @@
+// Measures how many times per second liblox can run a small request-handling
+// script: compiling it for every run, and compiling once and sharing the
+// Program across threads. Build with -DLOX_BUILD_BENCHMARKS=ON and run
+// `throughput [runs] [threads]`.
+#include "../src/lox.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+const char* const SCRIPT = R"(
+class Request {
+  init(id, size) { this.id = id; this.size = size; }
+  cost() { return this.size * 3 + this.id; }
+}
+var total = 0;
+for (var i = 0; i < 50; i = i + 1) {
+  var request = Request(i, i * 2);
+  total = total + request.cost();
+}
+var table = map();
+for (var i = 0; i < 20; i = i + 1) set(table, i, i * i);
+print total + get(table, 7);
+)";
+
+// Counts bytes instead of keeping them, so the sink costs next to nothing.
+class CountingSink: public lox::OutputSink {
+public:
+    void write(std::string_view text) override { bytes += text.size(); }
+    void error(std::string_view text) override { errors += text.size(); }
+
+    size_t bytes{0};
+    size_t errors{0};
+};
+
+// Runs `work(sink)` `runs` times split across `threads`; returns runs per second.
+template <typename Work>
+double measure(size_t runs, unsigned threads, Work work) {
+    std::vector<CountingSink> sinks(threads);
+    std::vector<std::thread> workers;
+    auto start = Clock::now();
+    for (unsigned t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            for (size_t i = t; i < runs; i += threads) work(sinks[t]);
+        });
+    }
+    for (auto& worker: workers) worker.join();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    for (const auto& sink: sinks) {
+        if (sink.errors) {
+            std::fprintf(stderr, "a run failed\n");
+            std::exit(1);
+        }
+    }
+    return runs / seconds;
+}
+} // namespace
+
+int main(int argc, char* argv[]) {
+    size_t runs = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 20000;
+    unsigned threads = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : std::thread::hardware_concurrency();
+    if (!threads) threads = 1;
+
+    lox::Runtime runtime;
+    lox::Program shared = lox::compile(SCRIPT);
+    if (!shared.ok()) return 1;
+
+    double each = measure(runs, threads, [&](CountingSink& sink) { runtime.run(lox::compile(SCRIPT), sink); });
+    double once = measure(runs, threads, [&](CountingSink& sink) { runtime.run(shared, sink); });
+
+    std::printf("%zu runs on %u threads\n", runs, threads);
+    std::printf("compile every run   %10.0f runs/s\n", each);
+    std::printf("compile once        %10.0f runs/s\n", once);
+    return 0;
+}
@@ -0,0 +1,73 @@
+// A host that embeds Lox: it compiles one script, then runs it on several
+// threads at once, each run printing into its own buffer. Build with
+// -DLOX_BUILD_EXAMPLES=ON and run `embed [script.lox]`.
+#include "lox.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+const char* const DEFAULT_SCRIPT = R"(
+class Greeter {
+  init(name) { this.name = name; }
+  greet() { return "hello, " + this.name; }
+}
+var total = 0;
+for (var i = 0; i < 1000; i = i + 1) total = total + i;
+print Greeter("host").greet();
+print total;
+)";
+
+// Keeps a run's output and errors apart, in memory.
+class BufferSink: public lox::OutputSink {
+public:
+    void write(std::string_view text) override { output_ += text; }
+    void error(std::string_view text) override { errors_ += text; }
+
+    const std::string& output() const { return output_; }
+    const std::string& errors() const { return errors_; }
+
+private:
+    std::string output_;
+    std::string errors_;
+};
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string source = DEFAULT_SCRIPT;
+    if (argc > 1) {
+        std::ifstream file(argv[1]);
+        if (!file) {
+            std::cerr << "Could not read " << argv[1] << std::endl;
+            return 1;
+        }
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        source = buffer.str();
+    }
+
+    lox::Program program = lox::compile(source);
+    for (const auto& error: program.errors()) std::cerr << error << std::endl;
+    if (!program.ok()) return 65;
+
+    // One runtime serves every thread; each run gets its own interpreter.
+    lox::Runtime runtime(lox::RuntimeOptions{.max_steps = 10'000'000});
+
+    const int threads = 4;
+    std::vector<BufferSink> sinks(threads);
+    std::vector<char> succeeded(threads);
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; i++) {
+        workers.emplace_back([&, i] { succeeded[i] = runtime.run(program, sinks[i]); });
+    }
+    for (auto& worker: workers) worker.join();
+
+    for (int i = 0; i < threads; i++) {
+        std::cout << "run " << i << (succeeded[i] ? "" : " (failed)") << ":\n" << sinks[i].output() << sinks[i].errors();
+    }
+    return 0;
+}
@@ -0,0 +1,7 @@
+#include "allocation.hpp"
+
+namespace lox::alloc {
+const char* const phase_names[PHASES] = {"other", "source", "tokens", "ast", "environments", "strings"};
+
+thread_local constinit Tag current;
+} // namespace lox::alloc
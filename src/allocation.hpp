@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <utility>
+
+namespace lox::alloc {
+// The counters and the profiler are only in the executables that link
+// allocation_counters.cpp: interpreter-memprofile and the allocation test.
+
+// Calls to the global operator new since startup, across all threads.
+size_t count();
+// Bytes requested through the global operator new since startup.
+size_t bytes();
+
+// What an allocation is for, as far as the memory profiler is concerned.
+enum Phase: uint8_t { OTHER, SOURCE, TOKENS, AST, ENVIRONMENTS, STRINGS, PHASES };
+extern const char* const phase_names[PHASES];
+
+struct Tag {
+    Phase phase{OTHER};
+    int    line{0};
+};
+
+// The tag new allocations on this thread are attributed to. Maintaining it is
+// a thread-local store; it is only read while profiling.
+extern thread_local constinit Tag current;
+
+inline void set_line(int line) { current.line = line; }
+
+class PhaseScope {
+public:
+    PhaseScope(Phase phase): saved_(current.phase) { current.phase = phase; }
+    ~PhaseScope() { current.phase = saved_; }
+
+private:
+    Phase saved_;
+};
+
+struct Usage {
+    size_t live{0};
+    size_t total{0};
+    size_t allocations{0};
+};
+
+struct Profile {
+    Usage phases[PHASES];
+    std::map<std::pair<int, Phase>, Usage> lines;
+
+    // Live bytes when the tracked total peaked, split by phase.
+    size_t peak{0};
+    size_t peak_phases[PHASES]{};
+};
+
+// Tracks every allocation made from now on, with its size and tag, until
+// `stop_profiling`. Memory allocated earlier is ignored when freed.
+void start_profiling();
+void  stop_profiling();
+
+Profile profile();
+} // namespace lox::alloc
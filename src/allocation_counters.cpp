@@ -0,0 +1,148 @@
+#include "allocation.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+
+// Replaces the global allocation functions so allocations can be counted.
+// Only interpreter-memprofile and the allocation test link this file; liblox
+// and the interpreter leave operator new alone.
+// The counters are relaxed atomics: one uncontended add per allocation.
+// While profiling, each allocation is also recorded with its size and tag;
+// the profiler's own bookkeeping allocations are not tracked.
+namespace {
+using namespace lox::alloc;
+
+std::atomic<size_t> allocations{0};
+std::atomic<size_t> allocated_bytes{0};
+
+std::atomic<bool> profiling{false};
+thread_local bool in_profiler = false;
+
+struct Allocation {
+    size_t size;
+    Tag    tag;
+};
+
+std::mutex profile_mutex;
+std::unordered_map<void*, Allocation>* tracked = nullptr;
+Profile* state = nullptr;
+size_t live = 0;
+
+void track(void* memory, size_t size) {
+    in_profiler = true;
+    {
+        std::lock_guard lock(profile_mutex);
+        tracked->emplace(memory, Allocation{size, current});
+
+        for (Usage* usage: {&state->phases[current.phase], &state->lines[{current.line, current.phase}]}) {
+            usage->live += size;
+            usage->total += size;
+            usage->allocations++;
+        }
+
+        live += size;
+        if (live > state->peak) {
+            state->peak = live;
+            for (int phase = 0; phase < PHASES; phase++) state->peak_phases[phase] = state->phases[phase].live;
+        }
+    }
+    in_profiler = false;
+}
+
+void untrack(void* memory) {
+    in_profiler = true;
+    {
+        std::lock_guard lock(profile_mutex);
+        auto it = tracked->find(memory);
+        if (it != tracked->end()) {
+            auto [size, tag] = it->second;
+            state->phases[tag.phase].live -= size;
+            state->lines[{tag.line, tag.phase}].live -= size;
+            live -= size;
+            tracked->erase(it);
+        }
+    }
+    in_profiler = false;
+}
+
+void* allocate(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+
+    void* memory = std::malloc(size ? size : 1);
+    if (!memory) throw std::bad_alloc();
+
+    if (profiling.load(std::memory_order_relaxed) && !in_profiler) track(memory, size);
+    return memory;
+}
+
+void* allocate(size_t size, std::align_val_t alignment) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+
+    size_t align = static_cast<size_t>(alignment);
+    void* memory = std::aligned_alloc(align, (size + align - 1) / align * align);
+    if (!memory) throw std::bad_alloc();
+
+    if (profiling.load(std::memory_order_relaxed) && !in_profiler) track(memory, size);
+    return memory;
+}
+
+void release(void* memory) {
+    if (memory && profiling.load(std::memory_order_relaxed) && !in_profiler) untrack(memory);
+    std::free(memory);
+}
+} // namespace
+
+namespace lox::alloc {
+size_t count() { return allocations.load(std::memory_order_relaxed); }
+size_t bytes() { return allocated_bytes.load(std::memory_order_relaxed); }
+
+void start_profiling() {
+    in_profiler = true;
+    {
+        std::lock_guard lock(profile_mutex);
+        if (!tracked) tracked = new std::unordered_map<void*, Allocation>();
+        if (!state) state = new Profile();
+    }
+    in_profiler = false;
+    profiling.store(true);
+}
+
+void stop_profiling() { profiling.store(false); }
+
+Profile profile() {
+    in_profiler = true;
+    Profile snapshot;
+    {
+        std::lock_guard lock(profile_mutex);
+        if (state) snapshot = *state;
+    }
+    in_profiler = false;
+    return snapshot;
+}
+} // namespace lox::alloc
+
+void* operator new  (size_t size) { return allocate(size); }
+void* operator new[](size_t size) { return allocate(size); }
+void* operator new  (size_t size, std::align_val_t alignment) { return allocate(size, alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return allocate(size, alignment); }
+
+void* operator new  (size_t size, const std::nothrow_t&) noexcept {
+    try { return allocate(size); } catch (...) { return nullptr; }
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    try { return allocate(size); } catch (...) { return nullptr; }
+}
+
+void operator delete  (void* memory) noexcept { release(memory); }
+void operator delete[](void* memory) noexcept { release(memory); }
+void operator delete  (void* memory, size_t) noexcept { release(memory); }
+void operator delete[](void* memory, size_t) noexcept { release(memory); }
+void operator delete  (void* memory, std::align_val_t) noexcept { release(memory); }
+void operator delete[](void* memory, std::align_val_t) noexcept { release(memory); }
+void operator delete  (void* memory, size_t, std::align_val_t) noexcept { release(memory); }
+void operator delete[](void* memory, size_t, std::align_val_t) noexcept { release(memory); }
@@ -0,0 +1,831 @@
+#include "aot.hpp"
+#include "function.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace lox::aot {
+extern const char* const runtime;
+
+namespace {
+// How a translated expression's result is held in C.
+enum Kind: uint8_t { NUMBER, BOOLEAN, VALUE };
+
+// A side-effect free C expression: a temporary, a variable or a constant.
+struct Operand {
+    std::string code;
+    Kind kind;
+};
+
+// A variable of the program: a global, a function's frame slot, or a
+// variable of a block outside functions. Blocks outside functions can't
+// declare functions here, so nothing outlives them and their variables are
+// plain C locals of `main`, resolved by where they are declared.
+struct Symbol {
+    enum Scope: uint8_t { GLOBAL, SLOT, BLOCK };
+
+    Scope scope;
+    std::string name;
+    std::string identifier;
+    // Where it is first mentioned.
+    int line{0};
+
+    // Cleared once anything but a number may be stored in it.
+    bool number{true};
+    // Globals named after a native start out holding it.
+    bool native{false};
+    // Declarations and assignments that store into it.
+    int stores{0};
+    // The function whose declaration is its only store.
+    Function* function{nullptr};
+    // Read other than as the callee of a call.
+    bool escapes{false};
+};
+
+// A store into a symbol; a null value stores something other than a number.
+struct Store {
+    Symbol* symbol;
+    Expr* value;
+};
+
+struct Routine {
+    Function* function;
+    std::string identifier;
+    int id;
+    std::vector<Symbol*> slots;
+    // Null for `return;`.
+    std::vector<Expr*> returns;
+    // Returns only numbers, and never falls off the end of its body.
+    bool number{true};
+};
+
+bool is_map_native(const std::string& name) {
+    for (auto native: {"map", "get", "set", "has", "delete", "next", "key", "value"}) if (name == native) return true;
+    return false;
+}
+
+bool returns_number(const std::string& native) {
+    for (auto name: {"clock", "len", "sum", "min", "max", "dot"}) if (native == name) return true;
+    return false;
+}
+
+bool always_returns(Stmt* stmt) {
+    if (dynamic_cast<Return*>(stmt)) return true;
+    if (auto block = dynamic_cast<Block*>(stmt)) return std::any_of(block->statements_.begin(), block->statements_.end(), always_returns);
+    if (auto if_stmt = dynamic_cast<If*>(stmt)) {
+        return if_stmt->else_branch_ && always_returns(if_stmt->then_branch_) && always_returns(if_stmt->else_branch_);
+    }
+    return false;
+}
+
+std::string number_literal(double value) {
+    // Literals past a double's range are infinite, which C spells with math.h.
+    if (std::isinf(value)) return value > 0 ? "HUGE_VAL" : "(-HUGE_VAL)";
+    char buffer[32];
+    std::string text(buffer, std::snprintf(buffer, sizeof(buffer), "%.17g", value));
+    if (text.find_first_of(".en") == std::string::npos) text += ".0";
+    return text;
+}
+
+std::string string_literal(const std::string& text) {
+    std::string literal = "\"";
+    for (unsigned char c: text) {
+        if (c == '"' || c == '\\' || c == '?') {
+            literal += '\\';
+            literal += c;
+        } else if (c == '\n') {
+            literal += "\\n";
+        } else if (c < 0x20 || c > 0x7e) {
+            char escape[5];
+            std::snprintf(escape, sizeof(escape), "\\%03o", c);
+            literal += escape;
+        } else {
+            literal += c;
+        }
+    }
+    return literal + "\"";
+}
+
+const std::string long_chains = "operator chains longer than " + std::to_string(MAX_RECURSIVE_CHAIN) + " links";
+
+const char* c_type(Kind kind) {
+    switch (kind) {
+        case NUMBER:  return "double";
+        case BOOLEAN: return "int";
+        default:      return "LxValue";
+    }
+}
+
+class Translator {
+public:
+    std::string translate(const std::vector<Stmt*>& statements, std::string& source);
+
+private:
+    std::deque<Symbol> symbols_;
+    std::map<std::string, Symbol*> globals_;
+    // Scopes of the blocks outside functions being collected, innermost last.
+    std::vector<std::unordered_map<std::string, Symbol*>> blocks_;
+    std::deque<Routine> routines_;
+    std::unordered_map<const Function*, Routine*> routine_of_;
+    std::vector<Routine*> enclosing_;
+
+    // What each Variable, Assign, Var and Function refers to.
+    std::unordered_map<const Expr*, Symbol*> references_;
+    std::unordered_map<const Stmt*, Symbol*> declarations_;
+    // Declarations that introduce a block variable, and so its C local.
+    std::unordered_set<const Stmt*> introduces_;
+    std::vector<Store> stores_;
+    // Calls whose callee is a variable.
+    std::vector<Call*> calls_;
+    std::string error_;
+
+    // Output of the function being written.
+    std::string* out_{nullptr};
+    int indent_{1};
+    Routine* routine_{nullptr};
+    int temporaries_{0};
+    std::string strings_;
+    int string_count_{0};
+
+    void unsupported(int line, const std::string& what) {
+        if (error_.empty()) error_ = "[line " + std::to_string(line) + "] Can't compile " + what + " to C.";
+    }
+
+    // Collecting symbols and stores.
+    void collect(Stmt*);
+    void collect(Expr*);
+    void collect_function(Function*);
+    Symbol* global(const Token& name);
+    Symbol* slot(Routine&, int index, const Token& name);
+    Symbol* use(const Token& name, const Binding&);
+    Symbol* declare(const Token& name, const Binding&, Stmt*);
+    void store(Symbol*, Expr* value, Function* function = nullptr);
+
+    // Type inference.
+    void infer();
+    Kind kind(Expr*);
+    inline Kind kind(const Symbol* symbol) const { return symbol->number ? NUMBER : VALUE; }
+    inline bool known(const Symbol* symbol) const { return symbol->function && symbol->stores == 1 && !symbol->native; }
+    inline bool direct_native(const Symbol* symbol) const {
+        return symbol->native && !symbol->stores && !is_map_native(symbol->name);
+    }
+
+    // Writing C.
+    void line(const std::string& text) {
+        out_->append(indent_ * 4, ' ');
+        *out_ += text;
+        *out_ += '\n';
+    }
+    Operand temporary(Kind, const std::string& code);
+    std::string boxed(const Operand&);
+    std::string truthy(const Operand&);
+    std::string number(const Operand&);
+    std::string convert(const Operand&, Kind);
+
+    void emit(Stmt*);
+    Operand emit(Expr*);
+    Operand emit_binary(Binary*);
+    Operand emit_call(Call*);
+    Operand constant(const std::any&);
+    void emit_routine(Routine&, std::string& definitions);
+    void check_defined(const Symbol*, const Token& name);
+    void assign(Symbol*, const Operand&, Stmt* declaration = nullptr);
+};
+
+Symbol* Translator::global(const Token& name) {
+    auto& symbol = globals_[name.lexeme];
+    if (symbol) return symbol;
+
+    symbol = &symbols_.emplace_back(Symbol{.scope = Symbol::GLOBAL, .name = name.lexeme, .identifier = "g_" + name.lexeme,
+                                           .line = name.line});
+    for (size_t i = 0; i < natives::count; i++) if (name.lexeme == natives::all[i]->name) symbol->native = true;
+    symbol->number = !symbol->native;
+    return symbol;
+}
+
+Symbol* Translator::slot(Routine& routine, int index, const Token& name) {
+    auto& symbol = routine.slots[index];
+    if (!symbol) {
+        symbol = &symbols_.emplace_back(Symbol{.scope = Symbol::SLOT, .name = name.lexeme,
+                                               .identifier = "l" + std::to_string(index), .line = name.line});
+    }
+    return symbol;
+}
+
+Symbol* Translator::use(const Token& name, const Binding& binding) {
+    if (!enclosing_.empty()) {
+        if (binding.kind == Binding::LOCAL) return slot(*enclosing_.back(), binding.index, name);
+        if (binding.kind != Binding::DYNAMIC) unsupported(name.line, "closures that capture variables");
+        return global(name);
+    }
+
+    for (auto block = blocks_.rbegin(); block != blocks_.rend(); block++) {
+        auto it = block->find(name.lexeme);
+        if (it != block->end()) return it->second;
+    }
+    return global(name);
+}
+
+Symbol* Translator::declare(const Token& name, const Binding& binding, Stmt* declaration) {
+    if (!enclosing_.empty() || blocks_.empty()) return use(name, binding);
+
+    auto& symbol = blocks_.back()[name.lexeme];
+    if (!symbol) {
+        symbol = &symbols_.emplace_back(Symbol{.scope = Symbol::BLOCK, .name = name.lexeme,
+                                               .identifier = "b" + std::to_string(symbols_.size()) + "_" + name.lexeme,
+                                               .line = name.line});
+        introduces_.insert(declaration);
+    }
+    return symbol;
+}
+
+void Translator::store(Symbol* symbol, Expr* value, Function* function) {
+    symbol->function = symbol->stores++ ? nullptr : function;
+    stores_.push_back({symbol, value});
+}
+
+void Translator::collect(Stmt* stmt) {
+    if (auto expression = dynamic_cast<Expression*>(stmt)) return collect(expression->expr_);
+    if (auto print      = dynamic_cast<Print*     >(stmt)) return collect(print->expr_);
+    if (auto function   = dynamic_cast<Function*  >(stmt)) return collect_function(function);
+    if (auto klass      = dynamic_cast<Class*     >(stmt)) return unsupported(klass->line_, "classes");
+    if (auto import     = dynamic_cast<Import*    >(stmt)) return unsupported(import->line_, "imports");
+
+    if (auto var = dynamic_cast<Var*>(stmt)) {
+        if (var->initializer_) collect(var->initializer_);
+        Symbol* symbol = declare(var->name_, var->binding_, var);
+        declarations_[var] = symbol;
+        return store(symbol, var->initializer_);
+    }
+
+    if (auto return_stmt = dynamic_cast<Return*>(stmt)) {
+        if (return_stmt->value_) collect(return_stmt->value_);
+        enclosing_.back()->returns.push_back(return_stmt->value_);
+        return;
+    }
+
+    if (auto block = dynamic_cast<Block*>(stmt)) {
+        if (block->tokens_) return unsupported(block->line_, "unparsed blocks");
+        if (!enclosing_.empty()) {
+            for (auto inner: block->statements_) collect(inner);
+            return;
+        }
+        blocks_.emplace_back();
+        for (auto inner: block->statements_) collect(inner);
+        blocks_.pop_back();
+        return;
+    }
+
+    if (auto if_stmt = dynamic_cast<If*>(stmt)) {
+        collect(if_stmt->condition_);
+        collect(if_stmt->then_branch_);
+        if (if_stmt->else_branch_) collect(if_stmt->else_branch_);
+        return;
+    }
+
+    auto while_stmt = static_cast<While*>(stmt);
+    collect(while_stmt->condition_);
+    collect(while_stmt->body_);
+}
+
+void Translator::collect_function(Function* function) {
+    if (enclosing_.empty() && !blocks_.empty()) return unsupported(function->line_, "functions declared in blocks outside functions");
+    if (!function->captures_.empty()) return unsupported(function->line_, "closures that capture variables");
+
+    Symbol* symbol = declare(function->name_, function->binding_, function);
+    declarations_[function] = symbol;
+    store(symbol, nullptr, function);
+
+    int id = routines_.size();
+    Routine& routine = routines_.emplace_back(Routine{.function = function, .identifier = "f" + std::to_string(id) + "_" + function->name_.lexeme,
+                                                      .id = id});
+    routine.slots.resize(function->slots_);
+    routine_of_[function] = &routine;
+
+    enclosing_.push_back(&routine);
+    for (size_t i = 0; i < function->parameters_.size(); i++) {
+        if (function->parameters_[i].kind != Binding::LOCAL) unsupported(function->line_, "closures that capture variables");
+        else slot(routine, function->parameters_[i].index, function->params_[i]);
+    }
+    for (auto stmt: function->body_) collect(stmt);
+    enclosing_.pop_back();
+
+    routine.number = std::any_of(function->body_.begin(), function->body_.end(), always_returns);
+}
+
+void Translator::collect(Expr* expr) {
+    if (auto variable = dynamic_cast<Variable*>(expr)) {
+        Symbol* symbol = use(variable->name_, variable->binding_);
+        references_[variable] = symbol;
+        symbol->escapes = true;
+        return;
+    }
+    if (auto assign = dynamic_cast<Assign*>(expr)) {
+        collect(assign->value_);
+        Symbol* symbol = use(assign->name_, assign->binding_);
+        references_[assign] = symbol;
+        return store(symbol, assign->value_);
+    }
+    if (auto call = dynamic_cast<Call*>(expr)) {
+        // A variable callee doesn't let the function escape; calls to it
+        // can be made directly.
+        if (auto variable = dynamic_cast<Variable*>(call->callee_)) {
+            references_[variable] = use(variable->name_, variable->binding_);
+            calls_.push_back(call);
+        } else {
+            collect(call->callee_);
+        }
+        for (auto argument: call->arguments_) collect(argument);
+        return;
+    }
+
+    if (auto grouping = dynamic_cast<Grouping*>(expr)) return collect(grouping->expr_);
+    if (auto unary    = dynamic_cast<Unary*   >(expr)) return collect(unary->right_);
+    if (auto get      = dynamic_cast<Get*     >(expr)) return collect(get->object_);
+    // Translation recurses along operator chains.
+    if (auto binary = dynamic_cast<Binary*>(expr)) {
+        if (binary->chain_ > MAX_RECURSIVE_CHAIN) return unsupported(binary->op_.line, long_chains);
+        collect(binary->left_);
+        return collect(binary->right_);
+    }
+    if (auto logical = dynamic_cast<Logical*>(expr)) {
+        if (logical->chain_ > MAX_RECURSIVE_CHAIN) return unsupported(logical->op_.line, long_chains);
+        collect(logical->left_);
+        return collect(logical->right_);
+    }
+    if (auto array = dynamic_cast<ArrayLiteral*>(expr)) {
+        for (auto element: array->elements_) collect(element);
+        return;
+    }
+    if (auto index = dynamic_cast<Index*>(expr)) {
+        collect(index->object_);
+        return collect(index->index_);
+    }
+    if (auto set = dynamic_cast<SetIndex*>(expr)) {
+        collect(set->object_);
+        collect(set->index_);
+        return collect(set->value_);
+    }
+    if (auto set = dynamic_cast<Set*>(expr)) {
+        collect(set->object_);
+        return collect(set->value_);
+    }
+    if (auto this_expr = dynamic_cast<This*>(expr)) return unsupported(this_expr->keyword_.line, "classes");
+    if (auto super = dynamic_cast<Super*>(expr)) return unsupported(super->keyword_.line, "classes");
+}
+
+// Starts from every symbol and function holding only numbers and clears
+// them until what is stored agrees. Parameters of functions that are only
+// ever called directly take the types of their arguments.
+void Translator::infer() {
+    for (auto call: calls_) {
+        Symbol* symbol = references_.at(call->callee_);
+        if (!known(symbol) || symbol->escapes) continue;
+
+        Routine& routine = *routine_of_.at(symbol->function);
+        Function* function = routine.function;
+        if (call->arguments_.size() != size_t(function->arity())) continue;
+        for (size_t i = 0; i < call->arguments_.size(); i++) {
+            stores_.push_back({routine.slots[function->parameters_[i].index], call->arguments_[i]});
+        }
+    }
+    for (auto& routine: routines_) {
+        Symbol* symbol = declarations_.at(routine.function);
+        if (known(symbol) && !symbol->escapes) continue;
+        for (auto& parameter: routine.function->parameters_) stores_.push_back({routine.slots[parameter.index], nullptr});
+    }
+
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (auto& store: stores_) {
+            if (store.symbol->number && (!store.value || kind(store.value) != NUMBER)) {
+                store.symbol->number = false;
+                changed = true;
+            }
+        }
+        for (auto& routine: routines_) {
+            if (!routine.number) continue;
+            for (auto value: routine.returns) {
+                if (value && kind(value) == NUMBER) continue;
+                routine.number = false;
+                changed = true;
+                break;
+            }
+        }
+    }
+}
+
+Kind Translator::kind(Expr* expr) {
+    if (auto literal = dynamic_cast<Literal*>(expr)) {
+        if (IS_TYPE(literal->value_, double)) return NUMBER;
+        if (IS_TYPE(literal->value_, bool)) return BOOLEAN;
+        return VALUE;
+    }
+    if (auto grouping = dynamic_cast<Grouping*>(expr)) return kind(grouping->expr_);
+    if (auto variable = dynamic_cast<Variable*>(expr)) return kind(references_.at(variable));
+    if (auto assign = dynamic_cast<Assign*>(expr)) return kind(assign->value_);
+    if (auto unary = dynamic_cast<Unary*>(expr)) return unary->op_.type == MINUS ? NUMBER : BOOLEAN;
+    if (auto binary = dynamic_cast<Binary*>(expr)) {
+        switch (binary->op_.type) {
+            case MINUS: case SLASH: case STAR: return NUMBER;
+            case PLUS: return kind(binary->left_) == NUMBER && kind(binary->right_) == NUMBER ? NUMBER : VALUE;
+            default: return BOOLEAN;
+        }
+    }
+    if (auto logical = dynamic_cast<Logical*>(expr)) {
+        Kind left = kind(logical->left_);
+        return left == kind(logical->right_) ? left : VALUE;
+    }
+    if (auto call = dynamic_cast<Call*>(expr)) {
+        auto variable = dynamic_cast<Variable*>(call->callee_);
+        if (!variable) return VALUE;
+        Symbol* symbol = references_.at(variable);
+        if (known(symbol)) return routine_of_.at(symbol->function)->number ? NUMBER : VALUE;
+        if (direct_native(symbol) && returns_number(symbol->name)) return NUMBER;
+        return VALUE;
+    }
+    if (dynamic_cast<Index*>(expr) || dynamic_cast<SetIndex*>(expr)) return NUMBER;
+    return VALUE;
+}
+
+Operand Translator::temporary(Kind kind, const std::string& code) {
+    std::string name = "t" + std::to_string(temporaries_++);
+    line(std::string(c_type(kind)) + " " + name + " = " + code + ";");
+    return {name, kind};
+}
+
+std::string Translator::boxed(const Operand& operand) {
+    switch (operand.kind) {
+        case NUMBER:  return "lx_number(" + operand.code + ")";
+        case BOOLEAN: return "lx_boolean(" + operand.code + ")";
+        default:      return operand.code;
+    }
+}
+
+std::string Translator::truthy(const Operand& operand) {
+    switch (operand.kind) {
+        case NUMBER:  return "1";
+        case BOOLEAN: return operand.code;
+        default:      return "lx_truthy(" + operand.code + ")";
+    }
+}
+
+// The operand as a double, once it has been checked to be a number. A
+// boolean never passes the check.
+std::string Translator::number(const Operand& operand) {
+    switch (operand.kind) {
+        case NUMBER:  return operand.code;
+        case BOOLEAN: return "0.0";
+        default:      return operand.code + ".as.number";
+    }
+}
+
+// Inference only makes a store a number where the value is one.
+std::string Translator::convert(const Operand& operand, Kind kind) {
+    return kind == VALUE ? boxed(operand) : operand.code;
+}
+
+void Translator::check_defined(const Symbol* symbol, const Token& name) {
+    if (symbol->scope != Symbol::GLOBAL || symbol->native) return;
+    line("if (!d_" + symbol->name + ") lx_undefined(" + std::to_string(name.line) + ", \"" + symbol->name + "\");");
+}
+
+void Translator::assign(Symbol* symbol, const Operand& value, Stmt* declaration) {
+    std::string code = convert(value, kind(symbol));
+    if (symbol->scope == Symbol::GLOBAL) {
+        line(symbol->identifier + " = " + code + ";");
+        if (!symbol->native) line("d_" + symbol->name + " = 1;");
+    } else if (introduces_.contains(declaration)) {
+        line(std::string(c_type(kind(symbol))) + " " + symbol->identifier + " = " + code + ";");
+    } else {
+        line(symbol->identifier + " = " + code + ";");
+    }
+}
+
+Operand Translator::constant(const std::any& value) {
+    if (IS_TYPE(value, double)) return {number_literal(std::any_cast<double>(value)), NUMBER};
+    if (IS_TYPE(value, bool)) return {std::any_cast<bool>(value) ? "1" : "0", BOOLEAN};
+    if (IS_TYPE(value, std::nullptr_t)) return {"LX_NIL_VALUE", VALUE};
+
+    const std::string& text = std::any_cast<const std::string&>(value);
+    std::string name = "s" + std::to_string(string_count_++);
+    strings_ += "static const LxString " + name + " = {" + std::to_string(text.size()) + ", " + string_literal(text) + "};\n";
+    return {"lx_object(LX_STRING, &" + name + ")", VALUE};
+}
+
+void Translator::emit(Stmt* stmt) {
+    if (auto expression = dynamic_cast<Expression*>(stmt)) {
+        emit(expression->expr_);
+        return;
+    }
+    if (auto print = dynamic_cast<Print*>(stmt)) {
+        Operand value = emit(print->expr_);
+        if      (value.kind == NUMBER ) line("lx_print_number(" + value.code + ");");
+        else if (value.kind == BOOLEAN) line("lx_print_boolean(" + value.code + ");");
+        else                            line("lx_print(" + value.code + ");");
+        return;
+    }
+    if (auto var = dynamic_cast<Var*>(stmt)) {
+        Operand value = var->initializer_ ? emit(var->initializer_) : Operand{"LX_NIL_VALUE", VALUE};
+        return assign(declarations_.at(var), value, var);
+    }
+    if (auto function = dynamic_cast<Function*>(stmt)) {
+        Routine& routine = *routine_of_.at(function);
+        return assign(declarations_.at(function), {"lx_closure(&i" + std::to_string(routine.id) + ")", VALUE}, function);
+    }
+    if (auto return_stmt = dynamic_cast<Return*>(stmt)) {
+        Operand value = return_stmt->value_ ? emit(return_stmt->value_) : Operand{"LX_NIL_VALUE", VALUE};
+        line("return " + convert(value, routine_->number ? NUMBER : VALUE) + ";");
+        return;
+    }
+    if (auto block = dynamic_cast<Block*>(stmt)) {
+        line("{");
+        indent_++;
+        for (auto inner: block->statements_) emit(inner);
+        indent_--;
+        line("}");
+        return;
+    }
+    if (auto if_stmt = dynamic_cast<If*>(stmt)) {
+        Operand condition = emit(if_stmt->condition_);
+        line("if (" + truthy(condition) + ") {");
+        indent_++;
+        emit(if_stmt->then_branch_);
+        indent_--;
+        if (if_stmt->else_branch_) {
+            line("} else {");
+            indent_++;
+            emit(if_stmt->else_branch_);
+            indent_--;
+        }
+        line("}");
+        return;
+    }
+
+    auto while_stmt = static_cast<While*>(stmt);
+    line("for (;;) {");
+    indent_++;
+    Operand condition = emit(while_stmt->condition_);
+    line("if (!" + truthy(condition) + ") break;");
+    emit(while_stmt->body_);
+    indent_--;
+    line("}");
+}
+
+Operand Translator::emit(Expr* expr) {
+    if (auto literal  = dynamic_cast<Literal* >(expr)) return constant(literal->value_);
+    if (auto grouping = dynamic_cast<Grouping*>(expr)) return emit(grouping->expr_);
+    if (auto binary   = dynamic_cast<Binary*  >(expr)) return emit_binary(binary);
+    if (auto call     = dynamic_cast<Call*    >(expr)) return emit_call(call);
+
+    if (auto variable = dynamic_cast<Variable*>(expr)) {
+        Symbol* symbol = references_.at(variable);
+        check_defined(symbol, variable->name_);
+        return temporary(kind(symbol), symbol->identifier);
+    }
+    if (auto assign = dynamic_cast<Assign*>(expr)) {
+        Operand value = emit(assign->value_);
+        Symbol* symbol = references_.at(assign);
+        check_defined(symbol, assign->name_);
+        this->assign(symbol, value);
+        return value;
+    }
+
+    if (auto unary = dynamic_cast<Unary*>(expr)) {
+        Operand right = emit(unary->right_);
+        if (unary->op_.type == BANG) {
+            if (right.kind == NUMBER) return {"0", BOOLEAN};
+            return temporary(BOOLEAN, "!" + truthy(right));
+        }
+        if (right.kind != NUMBER) line("lx_check_number(" + boxed(right) + ", " + std::to_string(unary->op_.line) + ");");
+        return temporary(NUMBER, "-(" + number(right) + ")");
+    }
+
+    if (auto logical = dynamic_cast<Logical*>(expr)) {
+        Kind kind = this->kind(logical);
+        Operand left = emit(logical->left_);
+        Operand result = temporary(kind, convert(left, kind));
+        line(std::string("if (") + (logical->op_.type == OR ? "!" : "") + truthy(left) + ") {");
+        indent_++;
+        Operand right = emit(logical->right_);
+        line(result.code + " = " + convert(right, kind) + ";");
+        indent_--;
+        line("}");
+        return result;
+    }
+
+    if (auto array = dynamic_cast<ArrayLiteral*>(expr)) {
+        std::string line = std::to_string(array->bracket_.line);
+        std::string elements;
+        for (auto element: array->elements_) {
+            Operand value = emit(element);
+            if (value.kind != NUMBER) value = temporary(NUMBER, "lx_element_value(" + boxed(value) + ", " + line + ")");
+            elements += (elements.empty() ? "" : ", ") + value.code;
+        }
+        if (elements.empty()) return temporary(VALUE, "lx_array(NULL, 0)");
+        return temporary(VALUE, "lx_array((const double[]){" + elements + "}, " + std::to_string(array->elements_.size()) + ")");
+    }
+    if (auto index = dynamic_cast<Index*>(expr)) {
+        Operand object = emit(index->object_);
+        Operand at = emit(index->index_);
+        return temporary(NUMBER, "*lx_element(" + boxed(object) + ", " + boxed(at) + ", " + std::to_string(index->bracket_.line) + ")");
+    }
+    if (auto set = dynamic_cast<SetIndex*>(expr)) {
+        std::string line = std::to_string(set->bracket_.line);
+        Operand object = emit(set->object_);
+        Operand at = emit(set->index_);
+        Operand value = emit(set->value_);
+        if (value.kind != NUMBER) value = temporary(NUMBER, "lx_element_value(" + boxed(value) + ", " + line + ")");
+        return temporary(NUMBER, "*lx_element(" + boxed(object) + ", " + boxed(at) + ", " + line + ") = " + value.code);
+    }
+
+    // Without classes there are no instances: property accesses always fail.
+    if (auto get = dynamic_cast<Get*>(expr)) {
+        emit(get->object_);
+        line("lx_error(" + std::to_string(get->name_.line) + ", \"Only instances have properties.\");");
+        return {"LX_NIL_VALUE", VALUE};
+    }
+    if (auto set = dynamic_cast<Set*>(expr)) {
+        emit(set->object_);
+        line("lx_error(" + std::to_string(set->name_.line) + ", \"Only instances have fields.\");");
+        return {"LX_NIL_VALUE", VALUE};
+    }
+    return {"LX_NIL_VALUE", VALUE};
+}
+
+Operand Translator::emit_binary(Binary* expr) {
+    Operand left = emit(expr->left_);
+    Operand right = emit(expr->right_);
+    std::string line = std::to_string(expr->op_.line);
+    bool numbers = left.kind == NUMBER && right.kind == NUMBER;
+
+    const char* op = nullptr;
+    Kind kind = BOOLEAN;
+    switch (expr->op_.type) {
+        case MINUS:         op = " - ";  kind = NUMBER; break;
+        case SLASH:         op = " / ";  kind = NUMBER; break;
+        case STAR:          op = " * ";  kind = NUMBER; break;
+        case GREATER:       op = " > ";  break;
+        case GREATER_EQUAL: op = " >= "; break;
+        case LESS:          op = " < ";  break;
+        case LESS_EQUAL:    op = " <= "; break;
+        case PLUS:
+            if (numbers) return temporary(NUMBER, left.code + " + " + right.code);
+            return temporary(VALUE, "lx_add(" + boxed(left) + ", " + boxed(right) + ", " + line + ")");
+        default: {
+            std::string equal;
+            if (left.kind == right.kind && left.kind != VALUE) equal = "(" + left.code + " == " + right.code + ")";
+            else if (left.kind != VALUE && right.kind != VALUE) equal = "0";
+            else equal = "lx_equal(" + boxed(left) + ", " + boxed(right) + ")";
+            return temporary(BOOLEAN, (expr->op_.type == BANG_EQUAL ? "!" : "") + equal);
+        }
+    }
+
+    if (!numbers) this->line("lx_check_numbers(" + boxed(left) + ", " + boxed(right) + ", " + line + ");");
+    return temporary(kind, number(left) + op + number(right));
+}
+
+Operand Translator::emit_call(Call* call) {
+    std::string line = std::to_string(call->paren_.line);
+    auto arity_error = [&](int arity) {
+        this->line("lx_check_arity(" + std::to_string(arity) + ", " + std::to_string(call->arguments_.size()) + ", " + line + ");");
+        return Operand{"LX_NIL_VALUE", VALUE};
+    };
+    auto arguments = [&]() {
+        std::vector<Operand> values;
+        for (auto argument: call->arguments_) values.push_back(emit(argument));
+        return values;
+    };
+    auto array = [&](const std::vector<Operand>& values) {
+        if (values.empty()) return std::string("NULL");
+        std::string elements;
+        for (auto& value: values) elements += (elements.empty() ? "" : ", ") + boxed(value);
+        return "(const LxValue[]){" + elements + "}";
+    };
+
+    auto variable = dynamic_cast<Variable*>(call->callee_);
+    Symbol* symbol = variable ? references_.at(variable) : nullptr;
+
+    if (symbol && known(symbol)) {
+        check_defined(symbol, variable->name_);
+        Routine& routine = *routine_of_.at(symbol->function);
+        Function* function = routine.function;
+        std::vector<Operand> values = arguments();
+        if (values.size() != size_t(function->arity())) return arity_error(function->arity());
+
+        std::string code = routine.identifier + "(";
+        for (size_t i = 0; i < values.size(); i++) {
+            code += (i ? ", " : "") + convert(values[i], kind(routine.slots[function->parameters_[i].index]));
+        }
+        this->line("lx_enter(" + line + ");");
+        Operand result = temporary(routine.number ? NUMBER : VALUE, code + ")");
+        this->line("lx_depth--;");
+        return result;
+    }
+
+    if (symbol && direct_native(symbol)) {
+        std::vector<Operand> values = arguments();
+        const Native* native = nullptr;
+        for (size_t i = 0; i < natives::count; i++) if (symbol->name == natives::all[i]->name) native = natives::all[i];
+        if (values.size() != size_t(native->arity)) return arity_error(native->arity);
+
+        std::string code = "lx_native_" + symbol->name + "_call(" + array(values) + ", " + line + ")";
+        if (returns_number(symbol->name)) return temporary(NUMBER, code + ".as.number");
+        return temporary(VALUE, code);
+    }
+
+    Operand callee = emit(call->callee_);
+    std::vector<Operand> values = arguments();
+    return temporary(VALUE, "lx_call(" + boxed(callee) + ", " + array(values) + ", " + std::to_string(values.size()) + ", " + line + ")");
+}
+
+void Translator::emit_routine(Routine& routine, std::string& definitions) {
+    Function* function = routine.function;
+    std::string body;
+    std::string* out = std::exchange(out_, &body);
+    int indent = std::exchange(indent_, 1);
+    Routine* enclosing = std::exchange(routine_, &routine);
+
+    for (size_t i = 0; i < routine.slots.size(); i++) {
+        Symbol* symbol = routine.slots[i];
+        bool parameter = std::any_of(function->parameters_.begin(), function->parameters_.end(),
+                                     [&](const Binding& binding) { return binding.index == int(i); });
+        if (!symbol || parameter) continue;
+        line(std::string(c_type(kind(symbol))) + " " + symbol->identifier + (symbol->number ? " = 0;" : " = LX_NIL_VALUE;"));
+    }
+    for (auto stmt: function->body_) emit(stmt);
+    line(routine.number ? "return 0;" : "return LX_NIL_VALUE;");
+
+    out_ = out;
+    indent_ = indent;
+    routine_ = enclosing;
+
+    std::string id = std::to_string(routine.id);
+    std::string parameters, unboxed;
+    for (size_t i = 0; i < function->parameters_.size(); i++) {
+        Symbol* symbol = routine.slots[function->parameters_[i].index];
+        parameters += std::string(i ? ", " : "") + c_type(kind(symbol)) + " " + symbol->identifier;
+        unboxed += std::string(i ? ", " : "") + "arguments[" + std::to_string(i) + "]" + (symbol->number ? ".as.number" : "");
+    }
+
+    definitions += "static " + std::string(routine.number ? "double " : "LxValue ") + routine.identifier + "(" +
+                   (parameters.empty() ? "void" : parameters) + ") {\n" + body + "}\n\n";
+    definitions += "static LxValue w" + id + "(const LxValue* arguments) {\n    (void)arguments;\n    return " +
+                   (routine.number ? "lx_number(" : "(") + routine.identifier + "(" + unboxed + "));\n}\n\n";
+}
+
+std::string Translator::translate(const std::vector<Stmt*>& statements, std::string& source) {
+    for (auto stmt: statements) collect(stmt);
+    for (auto& [name, symbol]: globals_) {
+        if (symbol->native && !symbol->stores && is_map_native(name)) unsupported(symbol->line, "map natives");
+    }
+    if (!error_.empty()) return error_;
+    infer();
+
+    std::string main;
+    out_ = &main;
+    for (auto stmt: statements) emit(stmt);
+
+    std::string definitions;
+    for (auto& routine: routines_) emit_routine(routine, definitions);
+
+    source = std::string("// Translated from Lox. Build with: cc ") + cflags + " <file> -lm\n\n" + runtime + "\n";
+    source += strings_ + "\n";
+    for (auto& [name, symbol]: globals_) {
+        if (symbol->native) {
+            source += "static LxValue " + symbol->identifier + " = {LX_NATIVE, {.object = &lx_native_" + name + "}};\n";
+            continue;
+        }
+        source += "static " + std::string(c_type(kind(symbol))) + " " + symbol->identifier +
+                  (symbol->number ? ";\n" : " = {LX_NIL, {.number = 0}};\n");
+        source += "static int d_" + name + ";\n";
+    }
+    source += "\n";
+
+    for (auto& routine: routines_) {
+        std::string id = std::to_string(routine.id);
+        std::string parameters;
+        for (size_t i = 0; i < routine.function->parameters_.size(); i++) {
+            parameters += std::string(i ? ", " : "") + c_type(kind(routine.slots[routine.function->parameters_[i].index]));
+        }
+        source += "static " + std::string(routine.number ? "double " : "LxValue ") + routine.identifier + "(" +
+                  (parameters.empty() ? "void" : parameters) + ");\n";
+        source += "static LxValue w" + id + "(const LxValue* arguments);\n";
+        source += "static const LxFunction i" + id + " = {\"" + routine.function->name_.lexeme + "\", " +
+                  std::to_string(routine.function->arity()) + ", w" + id + "};\n";
+    }
+    source += "\n" + definitions;
+    source += "int main(void) {\n" + main + "    return 0;\n}\n";
+    return "";
+}
+} // namespace
+
+std::string translate(const std::vector<Stmt*>& statements, std::string& source) {
+    return Translator().translate(statements, source);
+}
+} // namespace lox::aot
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "ast/statements.hpp"
+
+#include <string>
+#include <vector>
+
+// Ahead-of-time translation of a resolved program to a standalone C program,
+// for scripts that are run often enough to be worth a C compiler's time.
+// Variables, parameters and results that only ever hold numbers are inferred
+// and become plain doubles; everything else is a tagged value. The output
+// prints, fails and exits exactly as `run` does.
+//
+// Classes, closures that capture variables, functions declared in blocks
+// outside functions and the map natives are not translated. Generated
+// programs never free memory.
+namespace lox::aot {
+// Writes the C translation of `statements` to `source`. Returns why the
+// program can't be translated, or an empty string.
+std::string translate(const std::vector<Stmt*>& statements, std::string& source);
+
+// The C compiler flags the translation is written for. Without
+// -ffp-contract=off, floating-point results could differ from the
+// interpreter's.
+inline constexpr const char* cflags = "-std=c11 -O2 -ffp-contract=off";
+} // namespace lox::aot
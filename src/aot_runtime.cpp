@@ -0,0 +1,448 @@
+namespace lox::aot {
+// The value representation and builtins every translated program starts
+// with. Error messages, number formatting and the array kernels mirror the
+// interpreter's, down to the order the SSE2 kernels add in.
+extern const char* const runtime;
+const char* const runtime = R"runtime(#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef enum { LX_NIL, LX_BOOLEAN, LX_NUMBER, LX_STRING, LX_FUNCTION, LX_NATIVE, LX_ARRAY } LxType;
+
+typedef struct {
+    LxType type;
+    union {
+        int boolean;
+        double number;
+        const void* object;
+    } as;
+} LxValue;
+
+typedef struct {
+    size_t length;
+    const char* chars;
+} LxString;
+
+typedef struct {
+    const char* name;
+    int arity;
+    LxValue (*call)(const LxValue* arguments);
+} LxFunction;
+
+typedef struct {
+    const LxFunction* function;
+} LxClosure;
+
+typedef struct {
+    const char* name;
+    int arity;
+    LxValue (*call)(const LxValue* arguments, int line);
+} LxNative;
+
+typedef struct {
+    size_t size;
+    size_t capacity;
+    double* values;
+} LxArray;
+
+#define LX_NIL_VALUE ((LxValue){LX_NIL, {.number = 0}})
+#define LX_MAX_DEPTH 1024
+
+static int lx_depth;
+
+static inline LxValue lx_number(double number) { return (LxValue){LX_NUMBER, {.number = number}}; }
+static inline LxValue lx_boolean(int boolean) { return (LxValue){LX_BOOLEAN, {.boolean = boolean}}; }
+static inline LxValue lx_object(LxType type, const void* object) { return (LxValue){type, {.object = object}}; }
+
+static inline int lx_truthy(LxValue value) {
+    if (value.type == LX_NIL) return 0;
+    if (value.type == LX_BOOLEAN) return value.as.boolean;
+    return 1;
+}
+
+_Noreturn static void lx_error(int line, const char* message) {
+    fflush(stdout);
+    fprintf(stderr, "%s\n[line %d]\n", message, line);
+    exit(70);
+}
+
+_Noreturn static void lx_errorf(int line, const char* format, ...) {
+    char message[256];
+    va_list arguments;
+    va_start(arguments, format);
+    vsnprintf(message, sizeof(message), format, arguments);
+    va_end(arguments);
+    lx_error(line, message);
+}
+
+static void* lx_allocate(size_t size) {
+    void* memory = malloc(size ? size : 1);
+    if (!memory) {
+        fflush(stdout);
+        fputs("Out of memory.\n", stderr);
+        exit(70);
+    }
+    return memory;
+}
+
+static inline void lx_undefined(int line, const char* name) { lx_errorf(line, "Undefined variable '%s'.", name); }
+
+static inline void lx_check_number(LxValue operand, int line) {
+    if (operand.type != LX_NUMBER) lx_error(line, "Operand must be a number.");
+}
+
+static inline void lx_check_numbers(LxValue left, LxValue right, int line) {
+    if (left.type != LX_NUMBER || right.type != LX_NUMBER) lx_error(line, "Operands must be numbers.");
+}
+
+static inline void lx_check_arity(int arity, int count, int line) {
+    if (arity != count) lx_errorf(line, "Expected %d arguments but got %d.", arity, count);
+}
+
+static inline void lx_enter(int line) {
+    if (lx_depth >= LX_MAX_DEPTH) lx_error(line, "Stack overflow.");
+    lx_depth++;
+}
+
+static LxValue lx_add(LxValue left, LxValue right, int line) {
+    if (left.type == LX_NUMBER && right.type == LX_NUMBER) return lx_number(left.as.number + right.as.number);
+    if (left.type != LX_STRING || right.type != LX_STRING) lx_error(line, "Operands must be two numbers or two strings.");
+
+    const LxString* a = left.as.object;
+    const LxString* b = right.as.object;
+    LxString* string = lx_allocate(sizeof(LxString) + a->length + b->length);
+    char* chars = (char*)(string + 1);
+    memcpy(chars, a->chars, a->length);
+    memcpy(chars + a->length, b->chars, b->length);
+    string->length = a->length + b->length;
+    string->chars = chars;
+    return lx_object(LX_STRING, string);
+}
+
+static int lx_equal(LxValue left, LxValue right) {
+    if (left.type != right.type) return 0;
+    switch (left.type) {
+        case LX_NIL:     return 1;
+        case LX_BOOLEAN: return left.as.boolean == right.as.boolean;
+        case LX_NUMBER:  return left.as.number == right.as.number;
+        case LX_STRING: {
+            const LxString* a = left.as.object;
+            const LxString* b = right.as.object;
+            return a->length == b->length && memcmp(a->chars, b->chars, a->length) == 0;
+        }
+        default:         return left.as.object == right.as.object;
+    }
+}
+
+static LxValue lx_closure(const LxFunction* function) {
+    LxClosure* closure = lx_allocate(sizeof(LxClosure));
+    closure->function = function;
+    return lx_object(LX_FUNCTION, closure);
+}
+
+static LxValue lx_call(LxValue callee, const LxValue* arguments, int count, int line) {
+    if (callee.type == LX_FUNCTION) {
+        const LxFunction* function = ((const LxClosure*)callee.as.object)->function;
+        lx_check_arity(function->arity, count, line);
+        lx_enter(line);
+        LxValue result = function->call(arguments);
+        lx_depth--;
+        return result;
+    }
+    if (callee.type == LX_NATIVE) {
+        const LxNative* native = callee.as.object;
+        lx_check_arity(native->arity, count, line);
+        return native->call(arguments, line);
+    }
+    lx_error(line, "Can only call functions and classes.");
+}
+
+// Output
+
+static void lx_write_number(double number) {
+    char buffer[352];
+    int length = snprintf(buffer, sizeof(buffer), "%f", number);
+    while (length > 0 && buffer[length - 1] == '0') length--;
+    if (length > 0 && buffer[length - 1] == '.') length--;
+    fwrite(buffer, 1, length, stdout);
+}
+
+static void lx_write(LxValue value) {
+    switch (value.type) {
+        case LX_NIL:      fputs("nil", stdout); return;
+        case LX_BOOLEAN:  fputs(value.as.boolean ? "true" : "false", stdout); return;
+        case LX_NUMBER:   lx_write_number(value.as.number); return;
+        case LX_STRING: {
+            const LxString* string = value.as.object;
+            fwrite(string->chars, 1, string->length, stdout);
+            return;
+        }
+        case LX_FUNCTION: printf("<fn %s>", ((const LxClosure*)value.as.object)->function->name); return;
+        case LX_NATIVE:   fputs("<native fn>", stdout); return;
+        case LX_ARRAY: {
+            const LxArray* array = value.as.object;
+            putchar('[');
+            for (size_t i = 0; i < array->size; i++) {
+                if (i) fputs(", ", stdout);
+                lx_write_number(array->values[i]);
+            }
+            putchar(']');
+            return;
+        }
+    }
+}
+
+static inline void lx_print(LxValue value) { lx_write(value); putchar('\n'); }
+static inline void lx_print_number(double number) { lx_write_number(number); putchar('\n'); }
+static inline void lx_print_boolean(int boolean) { puts(boolean ? "true" : "false"); }
+
+// Arrays
+
+static LxArray* lx_new_array(size_t size) {
+    LxArray* array = lx_allocate(sizeof(LxArray));
+    array->size = array->capacity = size;
+    array->values = lx_allocate(size * sizeof(double));
+    memset(array->values, 0, size * sizeof(double));
+    return array;
+}
+
+static LxValue lx_array(const double* values, size_t size) {
+    LxArray* array = lx_new_array(size);
+    if (size) memcpy(array->values, values, size * sizeof(double));
+    return lx_object(LX_ARRAY, array);
+}
+
+static inline double lx_element_value(LxValue element, int line) {
+    if (element.type != LX_NUMBER) lx_error(line, "Array elements must be numbers.");
+    return element.as.number;
+}
+
+static double* lx_element(LxValue object, LxValue index, int line) {
+    if (object.type != LX_ARRAY) lx_error(line, "Only arrays can be indexed.");
+    if (index.type != LX_NUMBER || index.as.number != floor(index.as.number)) lx_error(line, "Array index must be an integer.");
+
+    const LxArray* array = object.as.object;
+    if (index.as.number < 0 || index.as.number >= (double)array->size) lx_error(line, "Array index out of bounds.");
+    return &array->values[(size_t)index.as.number];
+}
+
+// Natives
+
+static LxArray* lx_array_argument(const LxValue* arguments, int i, const char* native, int line) {
+    if (arguments[i].type != LX_ARRAY) lx_errorf(line, "Argument to '%s' must be an array.", native);
+    return (LxArray*)arguments[i].as.object;
+}
+
+static double lx_number_argument(const LxValue* arguments, int i, const char* native, int line) {
+    if (arguments[i].type != LX_NUMBER) lx_errorf(line, "Argument to '%s' must be a number.", native);
+    return arguments[i].as.number;
+}
+
+static const LxArray* lx_nonempty(const LxValue* arguments, const char* native, int line) {
+    const LxArray* array = lx_array_argument(arguments, 0, native, line);
+    if (!array->size) lx_errorf(line, "Can't take the %s of an empty array.", native);
+    return array;
+}
+
+static const LxArray* lx_same_length(const LxValue* arguments, const char* native, int line, const LxArray** left) {
+    *left = lx_array_argument(arguments, 0, native, line);
+    const LxArray* right = lx_array_argument(arguments, 1, native, line);
+    if ((*left)->size != right->size) lx_errorf(line, "Arrays passed to '%s' must have the same length.", native);
+    return right;
+}
+
+#if defined(__SSE2__)
+static double lx_kernel_sum(const double* values, size_t count) {
+    double a0 = 0, a1 = 0, b0 = 0, b1 = 0;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        a0 += values[i];
+        a1 += values[i + 1];
+        b0 += values[i + 2];
+        b1 += values[i + 3];
+    }
+    double total = (a0 + b0) + (a1 + b1);
+    for (; i < count; i++) total += values[i];
+    return total;
+}
+
+static double lx_kernel_dot(const double* left, const double* right, size_t count) {
+    double a0 = 0, a1 = 0, b0 = 0, b1 = 0;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        a0 += left[i] * right[i];
+        a1 += left[i + 1] * right[i + 1];
+        b0 += left[i + 2] * right[i + 2];
+        b1 += left[i + 3] * right[i + 3];
+    }
+    double total = (a0 + b0) + (a1 + b1);
+    for (; i < count; i++) total += left[i] * right[i];
+    return total;
+}
+
+// minpd and maxpd return their second operand unless the first wins the
+// comparison; std::min and std::max return their first.
+static double lx_kernel_min(const double* values, size_t count) {
+    if (count < 2) return values[0];
+    double m0 = values[0], m1 = values[1];
+    size_t i = 2;
+    for (; i + 2 <= count; i += 2) {
+        m0 = m0 < values[i] ? m0 : values[i];
+        m1 = m1 < values[i + 1] ? m1 : values[i + 1];
+    }
+    double result = m1 < m0 ? m1 : m0;
+    for (; i < count; i++) result = values[i] < result ? values[i] : result;
+    return result;
+}
+
+static double lx_kernel_max(const double* values, size_t count) {
+    if (count < 2) return values[0];
+    double m0 = values[0], m1 = values[1];
+    size_t i = 2;
+    for (; i + 2 <= count; i += 2) {
+        m0 = m0 > values[i] ? m0 : values[i];
+        m1 = m1 > values[i + 1] ? m1 : values[i + 1];
+    }
+    double result = m0 < m1 ? m1 : m0;
+    for (; i < count; i++) result = result < values[i] ? values[i] : result;
+    return result;
+}
+#else
+static double lx_kernel_sum(const double* values, size_t count) {
+    double total = 0;
+    for (size_t i = 0; i < count; i++) total += values[i];
+    return total;
+}
+
+static double lx_kernel_dot(const double* left, const double* right, size_t count) {
+    double total = 0;
+    for (size_t i = 0; i < count; i++) total += left[i] * right[i];
+    return total;
+}
+
+static double lx_kernel_min(const double* values, size_t count) {
+    double result = values[0];
+    for (size_t i = 1; i < count; i++) if (values[i] < result) result = values[i];
+    return result;
+}
+
+static double lx_kernel_max(const double* values, size_t count) {
+    double result = values[0];
+    for (size_t i = 1; i < count; i++) if (result < values[i]) result = values[i];
+    return result;
+}
+#endif
+
+static int lx_compare(const void* left, const void* right) {
+    double a = *(const double*)left, b = *(const double*)right;
+    return (a > b) - (a < b);
+}
+
+static LxValue lx_native_clock_call(const LxValue* arguments, int line) {
+    (void)arguments, (void)line;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return lx_number((double)now.tv_sec + (double)now.tv_nsec / 1e9);
+}
+
+static LxValue lx_native_array_call(const LxValue* arguments, int line) {
+    double size = lx_number_argument(arguments, 0, "array", line);
+    if (size < 0 || size != floor(size)) lx_error(line, "Array size must be a non-negative integer.");
+    return lx_object(LX_ARRAY, lx_new_array((size_t)size));
+}
+
+static LxValue lx_native_len_call(const LxValue* arguments, int line) {
+    if (arguments[0].type != LX_ARRAY) lx_error(line, "Argument to 'len' must be an array or a map.");
+    return lx_number((double)((const LxArray*)arguments[0].as.object)->size);
+}
+
+static LxValue lx_native_push_call(const LxValue* arguments, int line) {
+    LxArray* array = lx_array_argument(arguments, 0, "push", line);
+    double value = lx_number_argument(arguments, 1, "push", line);
+    if (array->size == array->capacity) {
+        array->capacity = array->capacity ? array->capacity * 2 : 8;
+        double* values = lx_allocate(array->capacity * sizeof(double));
+        if (array->size) memcpy(values, array->values, array->size * sizeof(double));
+        free(array->values);
+        array->values = values;
+    }
+    array->values[array->size++] = value;
+    return arguments[0];
+}
+
+static LxValue lx_native_sum_call(const LxValue* arguments, int line) {
+    const LxArray* array = lx_array_argument(arguments, 0, "sum", line);
+    return lx_number(lx_kernel_sum(array->values, array->size));
+}
+
+static LxValue lx_native_min_call(const LxValue* arguments, int line) {
+    const LxArray* array = lx_nonempty(arguments, "min", line);
+    return lx_number(lx_kernel_min(array->values, array->size));
+}
+
+static LxValue lx_native_max_call(const LxValue* arguments, int line) {
+    const LxArray* array = lx_nonempty(arguments, "max", line);
+    return lx_number(lx_kernel_max(array->values, array->size));
+}
+
+static LxValue lx_native_dot_call(const LxValue* arguments, int line) {
+    const LxArray* left;
+    const LxArray* right = lx_same_length(arguments, "dot", line, &left);
+    return lx_number(lx_kernel_dot(left->values, right->values, left->size));
+}
+
+static LxValue lx_native_scale_call(const LxValue* arguments, int line) {
+    const LxArray* source = lx_array_argument(arguments, 0, "scale", line);
+    double factor = lx_number_argument(arguments, 1, "scale", line);
+    LxArray* result = lx_new_array(source->size);
+    for (size_t i = 0; i < source->size; i++) result->values[i] = source->values[i] * factor;
+    return lx_object(LX_ARRAY, result);
+}
+
+static LxValue lx_native_add_call(const LxValue* arguments, int line) {
+    const LxArray* left;
+    const LxArray* right = lx_same_length(arguments, "add", line, &left);
+    LxArray* result = lx_new_array(left->size);
+    for (size_t i = 0; i < left->size; i++) result->values[i] = left->values[i] + right->values[i];
+    return lx_object(LX_ARRAY, result);
+}
+
+static LxValue lx_native_sort_call(const LxValue* arguments, int line) {
+    LxArray* array = lx_array_argument(arguments, 0, "sort", line);
+    qsort(array->values, array->size, sizeof(double), lx_compare);
+    return arguments[0];
+}
+
+// The map natives are not translated; a program may only shadow them.
+static LxValue lx_native_map_call(const LxValue* arguments, int line) {
+    (void)arguments;
+    lx_error(line, "Map natives aren't available in compiled programs.");
+}
+
+static const LxNative lx_native_clock  = {"clock",  0, lx_native_clock_call};
+static const LxNative lx_native_array  = {"array",  1, lx_native_array_call};
+static const LxNative lx_native_len    = {"len",    1, lx_native_len_call};
+static const LxNative lx_native_push   = {"push",   2, lx_native_push_call};
+static const LxNative lx_native_sum    = {"sum",    1, lx_native_sum_call};
+static const LxNative lx_native_min    = {"min",    1, lx_native_min_call};
+static const LxNative lx_native_max    = {"max",    1, lx_native_max_call};
+static const LxNative lx_native_dot    = {"dot",    2, lx_native_dot_call};
+static const LxNative lx_native_scale  = {"scale",  2, lx_native_scale_call};
+static const LxNative lx_native_add    = {"add",    2, lx_native_add_call};
+static const LxNative lx_native_sort   = {"sort",   1, lx_native_sort_call};
+static const LxNative lx_native_map    = {"map",    0, lx_native_map_call};
+static const LxNative lx_native_get    = {"get",    2, lx_native_map_call};
+static const LxNative lx_native_set    = {"set",    3, lx_native_map_call};
+static const LxNative lx_native_has    = {"has",    2, lx_native_map_call};
+static const LxNative lx_native_delete = {"delete", 2, lx_native_map_call};
+static const LxNative lx_native_next   = {"next",   2, lx_native_map_call};
+static const LxNative lx_native_key    = {"key",    2, lx_native_map_call};
+static const LxNative lx_native_value  = {"value",  2, lx_native_map_call};
+)runtime";
+} // namespace lox::aot
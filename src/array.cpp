@@ -0,0 +1,100 @@
+#include "array.hpp"
+
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace lox::kernels {
+#if defined(__SSE2__)
+namespace {
+// Adds the two lanes of `v`.
+inline double horizontal_sum(__m128d v) { return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v))); }
+} // namespace
+
+double sum(const double* values, size_t count) {
+    __m128d a = _mm_setzero_pd(), b = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        a = _mm_add_pd(a, _mm_loadu_pd(values + i));
+        b = _mm_add_pd(b, _mm_loadu_pd(values + i + 2));
+    }
+    double total = horizontal_sum(_mm_add_pd(a, b));
+    for (; i < count; i++) total += values[i];
+    return total;
+}
+
+double min(const double* values, size_t count) {
+    if (count < 2) return values[0];
+    __m128d m = _mm_loadu_pd(values);
+    size_t i = 2;
+    for (; i + 2 <= count; i += 2) m = _mm_min_pd(m, _mm_loadu_pd(values + i));
+    double result = std::min(_mm_cvtsd_f64(m), _mm_cvtsd_f64(_mm_unpackhi_pd(m, m)));
+    for (; i < count; i++) result = std::min(result, values[i]);
+    return result;
+}
+
+double max(const double* values, size_t count) {
+    if (count < 2) return values[0];
+    __m128d m = _mm_loadu_pd(values);
+    size_t i = 2;
+    for (; i + 2 <= count; i += 2) m = _mm_max_pd(m, _mm_loadu_pd(values + i));
+    double result = std::max(_mm_cvtsd_f64(m), _mm_cvtsd_f64(_mm_unpackhi_pd(m, m)));
+    for (; i < count; i++) result = std::max(result, values[i]);
+    return result;
+}
+
+double dot(const double* left, const double* right, size_t count) {
+    __m128d a = _mm_setzero_pd(), b = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        a = _mm_add_pd(a, _mm_mul_pd(_mm_loadu_pd(left + i), _mm_loadu_pd(right + i)));
+        b = _mm_add_pd(b, _mm_mul_pd(_mm_loadu_pd(left + i + 2), _mm_loadu_pd(right + i + 2)));
+    }
+    double total = horizontal_sum(_mm_add_pd(a, b));
+    for (; i < count; i++) total += left[i] * right[i];
+    return total;
+}
+
+void scale(double* out, const double* values, double factor, size_t count) {
+    __m128d k = _mm_set1_pd(factor);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) _mm_storeu_pd(out + i, _mm_mul_pd(_mm_loadu_pd(values + i), k));
+    for (; i < count; i++) out[i] = values[i] * factor;
+}
+
+void add(double* out, const double* left, const double* right, size_t count) {
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) _mm_storeu_pd(out + i, _mm_add_pd(_mm_loadu_pd(left + i), _mm_loadu_pd(right + i)));
+    for (; i < count; i++) out[i] = left[i] + right[i];
+}
+#else
+double sum(const double* values, size_t count) {
+    double total = 0;
+    for (size_t i = 0; i < count; i++) total += values[i];
+    return total;
+}
+
+double min(const double* values, size_t count) { return *std::min_element(values, values + count); }
+double max(const double* values, size_t count) { return *std::max_element(values, values + count); }
+
+double dot(const double* left, const double* right, size_t count) {
+    double total = 0;
+    for (size_t i = 0; i < count; i++) total += left[i] * right[i];
+    return total;
+}
+
+void scale(double* out, const double* values, double factor, size_t count) {
+    for (size_t i = 0; i < count; i++) out[i] = values[i] * factor;
+}
+
+void add(double* out, const double* left, const double* right, size_t count) {
+    for (size_t i = 0; i < count; i++) out[i] = left[i] + right[i];
+}
+#endif
+
+// Comparison sorts do not vectorise usefully; this is std::sort on the raw
+// buffer, which still avoids boxing every element.
+void sort(double* values, size_t count) { std::sort(values, values + count); }
+} // namespace lox::kernels
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "heap.hpp"
+
+#include <cstddef>
+#include <memory_resource>
+#include <vector>
+
+namespace lox {
+// A packed array of numbers. Elements are raw doubles in one contiguous
+// buffer, so bulk builtins run over them without unboxing anything.
+struct Array: public Object {
+    Array(std::pmr::memory_resource* resource = std::pmr::get_default_resource()): values_(resource) {}
+
+    std::pmr::vector<double> values_;
+
+    size_t size() const override { return sizeof(Array) + values_.capacity() * sizeof(double); }
+};
+
+// Bulk kernels behind the array builtins. They trust their caller: lengths
+// and types are checked once, when a builtin is called, never per element.
+// With SSE2 they process two lanes at a time with independent accumulators.
+namespace kernels {
+double sum(const double*, size_t);
+double min(const double*, size_t);
+double max(const double*, size_t);
+double dot(const double*, const double*, size_t);
+
+void scale(double* out, const double*, double factor, size_t);
+void   add(double* out, const double*, const double*, size_t);
+void  sort(double*, size_t);
+} // namespace lox::kernels
+} // namespace lox
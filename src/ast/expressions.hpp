@@ -2,50 +2,178 @@
 
 #include "../scanner.hpp"
 
+#include <cstdint>
+
 namespace lox {
+struct ArrayLiteral;
 struct Assign;
 struct Binary;
+struct Call;
+struct Get;
 struct Grouping;
+struct Index;
 struct Literal;
 struct Logical;
+struct Set;
+struct SetIndex;
+struct Super;
+struct This;
 struct Unary;
 struct Variable;
 
+struct Shape;
+struct Closure;
+
 template <typename T>
 class ExprVisitor {
 public:
+    virtual T visit_array_expr(ArrayLiteral*) = 0;
     virtual T visit_assign_expr(Assign*) = 0;
     virtual T visit_binary_expr(Binary*) = 0;
+    virtual T visit_call_expr(Call*) = 0;
+    virtual T visit_get_expr(Get*) = 0;
     virtual T visit_grouping_expr(Grouping*) = 0;
+    virtual T visit_index_expr(Index*) = 0;
     virtual T visit_literal_expr(Literal*) = 0;
     virtual T visit_logical_expr(Logical*) = 0;
+    virtual T visit_set_expr(Set*) = 0;
+    virtual T visit_set_index_expr(SetIndex*) = 0;
+    virtual T visit_super_expr(Super*) = 0;
+    virtual T visit_this_expr(This*) = 0;
     virtual T visit_unary_expr(Unary*) = 0;
     virtual T visit_variable_expr(Variable*) = 0;
 };
 
+// Where a variable lives, as decided by the resolver. Names outside functions,
+// and names a function neither declares nor captures, are looked up by name in
+// the environment chain. Function locals are slots in the call frame; the ones
+// a nested function captures hold a heap `Cell` instead of the value itself.
+//
+// A function declared in a block outside functions finds that block's
+// variables, and the globals, in its environment chain too. When the block
+// could still declare the same name after the function, the name is OUTER:
+// looked up from the environment that was in scope where the function was
+// declared, so a later declaration doesn't shadow it.
+struct Binding {
+    enum Kind: uint8_t { DYNAMIC, LOCAL, CELL, UPVALUE, OUTER };
+
+    Kind kind{DYNAMIC};
+    // Frame slot for LOCAL and CELL, index into the closure's cells for
+    // UPVALUE, and for OUTER the depth of the environment to look in, 0 for
+    // the globals.
+    int index{0};
+};
+
+// What a property name means on instances of one shape.
+struct Property {
+    enum Kind: uint8_t { MISSING, FIELD, METHOD };
+
+    Kind kind{MISSING};
+    int slot{0};
+    Closure* method{nullptr};
+};
+
+// The shapes seen at one property access site and what the name resolved to on
+// each. Shapes are identified by id rather than address: ids are never reused,
+// so entries left over from a collected class, or from an earlier interpreter
+// running the same AST, simply never match. Once every way is taken, new
+// shapes replace old ones round-robin.
+struct InlineCache {
+    static constexpr int WAYS = 4;
+
+    struct Entry {
+        uint64_t shape;
+        Property property;
+        // Set sites that add a field: the shape the instance moves to.
+        Shape* transition;
+    };
+
+    Entry entries[WAYS];
+    uint8_t size{0};
+    uint8_t next{0};
+
+    inline const Entry* find(uint64_t shape) const {
+        for (int i = 0; i < size; i++) if (entries[i].shape == shape) return &entries[i];
+        return nullptr;
+    }
+
+    void insert(const Entry& entry) {
+        if (size < WAYS) entries[size++] = entry;
+        else entries[next++ % WAYS] = entry;
+    }
+};
+
+// The longest operator chain that the engines still recursing down `left_`
+// accept; see Binary::chain_.
+constexpr uint32_t MAX_RECURSIVE_CHAIN = 1024;
+
 struct Expr {
+    virtual ~Expr() = default;
+
     virtual std::string accept(ExprVisitor<std::string>*) = 0;
     virtual std::any    accept(ExprVisitor<std::any   >*) = 0;
 };
+struct ArrayLiteral: public Expr {
+    ArrayLiteral(Token bracket, std::vector<Expr*> elements): bracket_(bracket), elements_(elements) {}
+
+    Token bracket_;
+    std::vector<Expr*> elements_;
+
+    std::string accept(ExprVisitor<std::string>* visitor) override { return visitor->visit_array_expr(this); }
+    std::any    accept(ExprVisitor<std::any   >* visitor) override { return visitor->visit_array_expr(this); }
+};
 struct Assign: public Expr {
     Assign(Token name, Expr* value): name_(name), value_(value) {}
 
     Token name_;
     Expr* value_;
+    Binding binding_;
 
     std::string accept(ExprVisitor<std::string>* visitor) override { return visitor->visit_assign_expr(this); }
     std::any    accept(ExprVisitor<std::any   >* visitor) override { return visitor->visit_assign_expr(this); }
 };
 struct Binary: public Expr {
-    Binary(Expr* left, Token op, Expr* right): left_(left), op_(op), right_(right) {}
+    Binary(Expr* left, Token op, Expr* right): left_(left), op_(op), right_(right) {
+        if (auto link = dynamic_cast<Binary*>(left)) chain_ = link->chain_ + 1;
+    }
 
     Expr* left_;
     Token op_;
     Expr* right_;
+    // Position in a left-associative chain such as `a + b + c`, counting from
+    // the innermost link, whose left operand is not a Binary. Chains nest as
+    // deep as they are long, so the tree walkers loop along them.
+    uint32_t chain_{1};
 
     std::string accept(ExprVisitor<std::string>* visitor) override { return visitor->visit_binary_expr(this); }
     std::any    accept(ExprVisitor<std::any   >* visitor) override { return visitor->visit_binary_expr(this); }
 };
+struct Call: public Expr {
+    Call(Expr* callee, Token paren, std::vector<Expr*> arguments)
+        : callee_(callee), paren_(paren), arguments_(arguments) {}
+
+    Expr* callee_;
+    Token paren_;
+    std::vector<Expr*> arguments_;
+    // Set when the callee is `object.name`, so methods are invoked directly.
+    Get* method_{nullptr};
+
+    std::string accept(ExprVisitor<std::string>* visitor) override { return visitor->visit_call_expr(this); }
+    std::any    accept(ExprVisitor<std::any   >* visitor) override { return visitor->visit_call_expr(this); }
+};
+struct Get: public Expr {
+    Get(Expr* object, Token name, uint32_t site): object_(object), name_(name), site_(site) {}
+
+    Expr* object_;
+    Token name_;
+    InlineCache cache_;
+    // Numbers the program's access sites, for interpreters that keep their
+    // caches out of the AST.
+    uint32_t site_;
+
+    std::string accept(ExprVisitor<std::string>* visitor) override { return visitor->visit_get_expr(this); }
+    std::any    accept(ExprVisitor<std::any   >* visitor) override { return visitor->visit_get_expr(this); }
+};
 struct Grouping: public Expr {
     Grouping(Expr* expr): expr_(expr) {}
 
@@ -54,6 +182,16 @@ struct Grouping: public Expr {
     std::string accept(ExprVisitor<std::string>* visitor) override { return visitor->visit_grouping_expr(this); }
     std::any    accept(ExprVisitor<std::any   >* visitor) override { return visitor->visit_grouping_expr(this); }
 };
+struct Index: public Expr {
+    Index(Expr* object, Token bracket, Expr* index): object_(object), bracket_(bracket), index_(index) {}
+
+    Expr* object_;
+    Token bracket_;
+    Expr* index_;
+
+    std::string accept(ExprVisitor<std::string>* visitor) override { return visitor->visit_index_expr(this); }
+    std::any    accept(ExprVisitor<std::any   >* visitor) override { return visitor->visit_index_expr(this); }
+};
 struct Literal: public Expr {
     Literal(std::any value): value_(value) {}
 
@@ -63,15 +201,64 @@ struct Literal: public Expr {
     std::any    accept(ExprVisitor<std::any   >* visitor) override { return visitor->visit_literal_expr(this); }
 };
 struct Logical: public Expr {
-    Logical(Expr* left, Token op, Expr* right): left_(left), op_(op), right_(right) {}
+    Logical(Expr* left, Token op, Expr* right): left_(left), op_(op), right_(right) {
+        if (auto link = dynamic_cast<Logical*>(left)) chain_ = link->chain_ + 1;
+    }
 
     Expr* left_;
     Token op_;
     Expr* right_;
+    // As for Binary::chain_, along `a or b or c`.
+    uint32_t chain_{1};
 
     std::string accept(ExprVisitor<std::string>* visitor) override { return visitor->visit_logical_expr(this); }
     std::any    accept(ExprVisitor<std::any   >* visitor) override { return visitor->visit_logical_expr(this); }
 };
+struct Set: public Expr {
+    Set(Expr* object, Token name, Expr* value, uint32_t site): object_(object), name_(name), value_(value), site_(site) {}
+
+    Expr* object_;
+    Token name_;
+    Expr* value_;
+    InlineCache cache_;
+    uint32_t site_;
+
+    std::string accept(ExprVisitor<std::string>* visitor) override { return visitor->visit_set_expr(this); }
+    std::any    accept(ExprVisitor<std::any   >* visitor) override { return visitor->visit_set_expr(this); }
+};
+struct SetIndex: public Expr {
+    SetIndex(Expr* object, Token bracket, Expr* index, Expr* value)
+        : object_(object), bracket_(bracket), index_(index), value_(value) {}
+
+    Expr* object_;
+    Token bracket_;
+    Expr* index_;
+    Expr* value_;
+
+    std::string accept(ExprVisitor<std::string>* visitor) override { return visitor->visit_set_index_expr(this); }
+    std::any    accept(ExprVisitor<std::any   >* visitor) override { return visitor->visit_set_index_expr(this); }
+};
+struct Super: public Expr {
+    Super(Token keyword, Token method): keyword_(keyword), method_(method) {}
+
+    Token keyword_;
+    Token method_;
+    Binding binding_;
+    // The receiver the superclass method is bound to.
+    Binding this_;
+
+    std::string accept(ExprVisitor<std::string>* visitor) override { return visitor->visit_super_expr(this); }
+    std::any    accept(ExprVisitor<std::any   >* visitor) override { return visitor->visit_super_expr(this); }
+};
+struct This: public Expr {
+    This(Token keyword): keyword_(keyword) {}
+
+    Token keyword_;
+    Binding binding_;
+
+    std::string accept(ExprVisitor<std::string>* visitor) override { return visitor->visit_this_expr(this); }
+    std::any    accept(ExprVisitor<std::any   >* visitor) override { return visitor->visit_this_expr(this); }
+};
 struct Unary: public Expr {
     Unary(Token op, Expr* right): op_(op), right_(right) {}
 
@@ -85,6 +272,7 @@ struct Variable: public Expr {
     Variable(Token name): name_(name) {}
 
     Token name_;
+    Binding binding_;
 
     std::string accept(ExprVisitor<std::string>* visitor) override { return visitor->visit_variable_expr(this); }
     std::any    accept(ExprVisitor<std::any   >* visitor) override { return visitor->visit_variable_expr(this); }
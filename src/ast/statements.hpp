@@ -2,13 +2,20 @@
 
 #include "expressions.hpp"
 
+#include <unordered_set>
+
 namespace lox {
 struct Expression;
 struct Print;
 struct Var;
+struct Function;
+struct Return;
+struct Class;
 struct Block;
 struct If;
 struct While;
+struct CountedLoop;
+struct Import;
 
 template <typename T>
 class StmtVisitor {
@@ -16,12 +23,22 @@ public:
     virtual T visit_expression_stmt(Expression*) = 0;
     virtual T visit_print_stmt(Print*) = 0;
     virtual T visit_var_stmt(Var*) = 0;
+    virtual T visit_function_stmt(Function*) = 0;
+    virtual T visit_return_stmt(Return*) = 0;
+    virtual T visit_class_stmt(Class*) = 0;
     virtual T visit_block_stmt(Block*) = 0;
     virtual T visit_if_stmt(If*) = 0;
     virtual T visit_while_stmt(While*) = 0;
+    virtual T visit_counted_loop_stmt(CountedLoop*) = 0;
+    virtual T visit_import_stmt(Import*) = 0;
 };
 
 struct Stmt {
+    virtual ~Stmt() = default;
+
+    // Source line of the statement's first token.
+    int line_{0};
+
     virtual void accept(StmtVisitor<void>*) = 0;
 };
 struct Expression: public Stmt {
@@ -43,13 +60,98 @@ struct Var: public Stmt {
 
     Token name_;
     Expr* initializer_;
+    Binding binding_;
 
     void accept(StmtVisitor<void>* visitor) override { visitor->visit_var_stmt(this); }
 };
+struct Function: public Stmt {
+    // A variable the closure captures when it is created: a `Cell` in the
+    // enclosing frame's slot `index`, or the enclosing closure's cell `index`.
+    struct Capture {
+        bool local;
+        int  index;
+    };
+
+    enum Kind: uint8_t { FUNCTION, METHOD, INITIALIZER };
+
+    Function(Token name, std::vector<Token> params, std::vector<Stmt*> body)
+        : name_(name), params_(params), body_(body), parameters_(params_.size()) {}
+
+    Token name_;
+    std::vector<Token> params_;
+    std::vector<Stmt*> body_;
+    Kind kind_{FUNCTION};
+
+    // Filled in by the resolver. Parameters occupy the first frame slots,
+    // after the receiver in slot 0 for methods.
+    Binding binding_;
+    Binding this_;
+    std::vector<Binding> parameters_;
+    std::vector<Capture> captures_;
+    int slots_{0};
+
+    inline int  arity() const { return params_.size(); }
+    inline bool method() const { return kind_ != FUNCTION; }
+
+    void accept(StmtVisitor<void>* visitor) override { visitor->visit_function_stmt(this); }
+};
+struct Return: public Stmt {
+    Return(Token keyword, Expr* value): keyword_(keyword), value_(value) {}
+
+    Token keyword_;
+    Expr* value_;
+
+    void accept(StmtVisitor<void>* visitor) override { visitor->visit_return_stmt(this); }
+};
+struct Class: public Stmt {
+    Class(Token name, Variable* superclass, std::vector<Function*> methods)
+        : name_(name), superclass_(superclass), methods_(methods) {}
+
+    Token name_;
+    Variable* superclass_;
+    std::vector<Function*> methods_;
+
+    Binding binding_;
+    // Where the methods find `super`, when there is a superclass.
+    Binding super_;
+
+    void accept(StmtVisitor<void>* visitor) override { visitor->visit_class_stmt(this); }
+};
 struct Block: public Stmt {
-    Block(std::vector<Stmt*> statements): statements_(statements) {}
+    Block(std::vector<Stmt*> statements) { set_statements(std::move(statements)); }
+    // A block the parser only skimmed. Its statements start at token `first`,
+    // `depth` levels deep, and are parsed the first time it runs.
+    Block(const TokenStream* tokens, int first, int depth, int max_nesting)
+        : tokens_(tokens), first_(first), depth_(depth), max_nesting_(max_nesting) {}
 
     std::vector<Stmt*> statements_;
+    // Blocks that declare nothing run in the enclosing scope, as do blocks in
+    // function bodies, whose variables are frame slots.
+    bool declares_{false};
+
+    // Set while the block is still unparsed.
+    const TokenStream* tokens_{nullptr};
+    int first_{0};
+    // Where the parser left off counting nesting, and its limit.
+    int depth_{0};
+    int max_nesting_{0};
+    // The names the enclosing blocks had declared where this one was skimmed,
+    // outermost first, which resolving its statements starts from; see
+    // Resolver.
+    std::vector<std::unordered_set<std::string>> scopes_;
+
+    void set_statements(std::vector<Stmt*> statements) {
+        statements_ = std::move(statements);
+        declares_ = declares(statements_);
+        tokens_ = nullptr;
+    }
+
+    static bool declares(const std::vector<Stmt*>& statements) {
+        for (auto stmt: statements) {
+            if (dynamic_cast<Var*>(stmt) || dynamic_cast<Function*>(stmt) || dynamic_cast<Class*>(stmt)) return true;
+        }
+        return false;
+    }
 
     void accept(StmtVisitor<void>* visitor) override { visitor->visit_block_stmt(this); }
 };
@@ -71,4 +173,38 @@ struct While: public Stmt {
     
     void accept(StmtVisitor<void>* visitor) override { visitor->visit_while_stmt(this); }
 };
+// The desugared `for (var i = a; i < n; i = i + step) body`. It is still the
+// `Block` the parser would have built, but the interpreter can run it with `i`
+// kept as a raw double.
+struct CountedLoop: public Block {
+    CountedLoop(Var* initializer, While* loop, Stmt* body, Expression* increment, double step)
+        : Block({initializer, loop}), initializer_(initializer), loop_(loop), body_(body),
+          increment_(increment), step_(step) {}
+
+    Var*        initializer_;
+    While*      loop_;
+    Stmt*       body_;
+    Expression* increment_;
+    double      step_;
+
+    void accept(StmtVisitor<void>* visitor) override { visitor->visit_counted_loop_stmt(this); }
+};
+
+// `import "path";`, only at the top level of a file. The first import of a
+// module runs it in a global scope of its own; every import binds that scope
+// to the file's name without its extension, so `import "lib/text.lox";`
+// defines `text`.
+struct Import: public Stmt {
+    Import(Token keyword, Token path, Token name): keyword_(keyword), path_(path), name_(name) {}
+
+    Token keyword_;
+    // The string as written, relative to the importing file's directory.
+    Token path_;
+    Token name_;
+    Binding binding_;
+    // The module's file, made absolute by the loader.
+    std::string file_;
+
+    void accept(StmtVisitor<void>* visitor) override { visitor->visit_import_stmt(this); }
+};
 } // namespace lox
\ No newline at end of file
@@ -0,0 +1,53 @@
+#include "bench.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+namespace lox {
+namespace {
+// Nearest-rank percentile of sorted samples.
+double percentile(const std::vector<double>& sorted, double p) {
+    size_t rank = std::ceil(p / 100.0 * sorted.size());
+    return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+}
+} // namespace
+
+BenchStats summarize(std::vector<double> samples) {
+    BenchStats stats;
+    stats.samples = samples.size();
+    if (samples.empty()) return stats;
+
+    std::sort(samples.begin(), samples.end());
+    size_t n = samples.size();
+
+    stats.min = samples.front();
+    stats.median = n % 2 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+    stats.p95 = percentile(samples, 95);
+    stats.p99 = percentile(samples, 99);
+
+    double sum = 0;
+    for (double sample: samples) sum += sample;
+    stats.mean = sum / n;
+
+    double squares = 0;
+    for (double sample: samples) squares += (sample - stats.mean) * (sample - stats.mean);
+    stats.stddev = n > 1 ? std::sqrt(squares / (n - 1)) : 0.0;
+
+    return stats;
+}
+
+void BenchStats::write(std::ostream& out) const {
+    auto row = [&](const char* name, double value) {
+        out << "  " << std::left << std::setw(8) << name
+            << std::right << std::setw(12) << std::fixed << std::setprecision(3) << value << " ms\n";
+    };
+    row("min", min);
+    row("median", median);
+    row("p95", p95);
+    row("p99", p99);
+    row("mean", mean);
+    row("stddev", stddev);
+    out << std::flush;
+}
+} // namespace lox
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <ostream>
+#include <streambuf>
+#include <vector>
+
+namespace lox {
+// Summary of repeated timings of one program, in milliseconds.
+struct BenchStats {
+    size_t samples{0};
+    double min{0};
+    double median{0};
+    double p95{0};
+    double p99{0};
+    double mean{0};
+    double stddev{0};
+
+    void write(std::ostream&) const;
+};
+
+BenchStats summarize(std::vector<double> samples);
+
+// Swallows everything written to it; `bench --quiet` points std::cout here so
+// printing costs what formatting costs, without the terminal or a pipe.
+class NullBuffer: public std::streambuf {
+protected:
+    int overflow(int c) override { return traits_type::not_eof(c); }
+    std::streamsize xsputn(const char*, std::streamsize count) override { return count; }
+};
+} // namespace lox
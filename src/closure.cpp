@@ -0,0 +1,300 @@
+#include "closure.hpp"
+
+namespace lox {
+void ClosureEngine::interpret(const std::vector<Stmt*>& stmts) {
+    StmtFn program = compile_sequence(stmts);
+    if (error_) return err::runtime_error(*error_);
+    locals_.resize(max_locals_);
+
+    program();
+    if (error_) err::runtime_error(*error_);
+}
+
+ClosureEngine::ExprFn ClosureEngine::unsupported(const Token& token, const std::string& feature) {
+    if (!error_) fail(token, feature + " need the tree engine; the closure engine runs arithmetic and loops only.");
+    return []() -> std::any { return nullptr; };
+}
+
+int ClosureEngine::global_slot(const std::string& name) {
+    auto [it, inserted] = global_slots_.try_emplace(name, globals_.size());
+    if (inserted) globals_.emplace_back();
+    return it->second;
+}
+
+int ClosureEngine::resolve_local(const std::string& name) {
+    for (auto scope = scopes_.rbegin(); scope != scopes_.rend(); scope++) {
+        auto it = scope->find(name);
+        if (it != scope->end()) return it->second;
+    }
+    return -1;
+}
+
+// Compiled chains run as nested closures, one per link.
+static const std::string chain_feature = "Operator chains longer than " + std::to_string(MAX_RECURSIVE_CHAIN) + " links";
+
+ClosureEngine::ExprFn ClosureEngine::compile(Expr* expr) {
+    if (auto binary   = dynamic_cast<Binary*  >(expr)) {
+        if (binary->chain_ > MAX_RECURSIVE_CHAIN) return unsupported(binary->op_, chain_feature);
+        return compile_binary(binary);
+    }
+    if (auto logical  = dynamic_cast<Logical* >(expr)) {
+        if (logical->chain_ > MAX_RECURSIVE_CHAIN) return unsupported(logical->op_, chain_feature);
+        return compile_logical(logical);
+    }
+    if (auto unary    = dynamic_cast<Unary*   >(expr)) return compile_unary(unary);
+    if (auto variable = dynamic_cast<Variable*>(expr)) return compile_variable(variable);
+    if (auto assign   = dynamic_cast<Assign*  >(expr)) return compile_assign(assign);
+    if (auto grouping = dynamic_cast<Grouping*>(expr)) return compile(grouping->expr_);
+
+    if (auto call  = dynamic_cast<Call* >(expr)) return unsupported(call->paren_, "Function calls");
+    if (auto get   = dynamic_cast<Get*  >(expr)) return unsupported(get->name_, "Classes");
+    if (auto set   = dynamic_cast<Set*  >(expr)) return unsupported(set->name_, "Classes");
+    if (auto self  = dynamic_cast<This* >(expr)) return unsupported(self->keyword_, "Classes");
+    if (auto super = dynamic_cast<Super*>(expr)) return unsupported(super->keyword_, "Classes");
+    if (auto array = dynamic_cast<ArrayLiteral*>(expr)) return unsupported(array->bracket_, "Arrays");
+    if (auto index = dynamic_cast<Index*   >(expr)) return unsupported(index->bracket_, "Arrays");
+    if (auto set   = dynamic_cast<SetIndex*>(expr)) return unsupported(set->bracket_, "Arrays");
+
+    std::any value = static_cast<Literal*>(expr)->value_;
+    return [value]() { return value; };
+}
+
+template <typename Op>
+ClosureEngine::ExprFn ClosureEngine::numeric(ExprFn left, ExprFn right, Token op, Op apply) {
+    return [this, left = std::move(left), right = std::move(right), op, apply]() -> std::any {
+        std::any  l =  left();
+        if (failed()) return {};
+        std::any  r = right();
+        if (failed()) return {};
+
+        if (!(IS_TYPE(l, double)) || !(IS_TYPE(r, double))) return fail(op, "Operands must be numbers.");
+        return apply(std::any_cast<double>(l), std::any_cast<double>(r));
+    };
+}
+
+ClosureEngine::ExprFn ClosureEngine::compile_binary(Binary* expr) {
+    ExprFn  left = compile(expr-> left_);
+    ExprFn right = compile(expr->right_);
+    Token     op = expr->op_;
+
+    switch (op.type) {
+        case MINUS:         return numeric(left, right, op, std::minus<double>());
+        case SLASH:         return numeric(left, right, op, std::divides<double>());
+        case STAR:          return numeric(left, right, op, std::multiplies<double>());
+        case GREATER:       return numeric(left, right, op, std::greater<double>());
+        case GREATER_EQUAL: return numeric(left, right, op, std::greater_equal<double>());
+        case LESS:          return numeric(left, right, op, std::less<double>());
+        case LESS_EQUAL:    return numeric(left, right, op, std::less_equal<double>());
+
+        case PLUS: return [this, left, right, op]() -> std::any {
+            std::any l =  left();
+            if (failed()) return {};
+            std::any r = right();
+            if (failed()) return {};
+
+            if ((IS_TYPE(l,      double)) && (IS_TYPE(r,      double)))
+                return std::any_cast<     double>(l) + std::any_cast<     double>(r);
+            if ((IS_TYPE(l, std::string)) && (IS_TYPE(r, std::string)))
+                return std::any_cast<std::string>(l) + std::any_cast<std::string>(r);
+            return fail(op, "Operands must be two numbers or two strings.");
+        };
+
+        case EQUAL_EQUAL:
+        case BANG_EQUAL: {
+            bool negate = op.type == BANG_EQUAL;
+            return [this, left, right, negate]() -> std::any {
+                std::any l =  left();
+                if (failed()) return {};
+                std::any r = right();
+                if (failed()) return {};
+                return is_equal(l, r) != negate;
+            };
+        }
+
+        default: return []() -> std::any { return nullptr; };
+    }
+}
+
+ClosureEngine::ExprFn ClosureEngine::compile_logical(Logical* expr) {
+    ExprFn  left = compile(expr-> left_);
+    ExprFn right = compile(expr->right_);
+    bool  is_or  = expr->op_.type == OR;
+
+    return [this, left, right, is_or]() -> std::any {
+        std::any l = left();
+        if (failed()) return {};
+        if (is_truthy(l) == is_or) return l;
+        return right();
+    };
+}
+
+ClosureEngine::ExprFn ClosureEngine::compile_unary(Unary* expr) {
+    ExprFn right = compile(expr->right_);
+    Token     op = expr->op_;
+
+    if (op.type == BANG) return [this, right]() -> std::any {
+        std::any r = right();
+        if (failed()) return {};
+        return !is_truthy(r);
+    };
+
+    return [this, right, op]() -> std::any {
+        std::any r = right();
+        if (failed()) return {};
+        if (!(IS_TYPE(r, double))) return fail(op, "Operand must be a number.");
+        return -std::any_cast<double>(r);
+    };
+}
+
+ClosureEngine::ExprFn ClosureEngine::compile_variable(Variable* expr) {
+    int local = resolve_local(expr->name_.lexeme);
+    if (local >= 0) return [this, local]() { return locals_[local]; };
+
+    int global = global_slot(expr->name_.lexeme);
+    Token name = expr->name_;
+    return [this, global, name]() -> std::any {
+        const std::any& value = globals_[global];
+        if (!value.has_value()) return fail(name, "Undefined variable '" + name.lexeme + "'.");
+        return value;
+    };
+}
+
+ClosureEngine::ExprFn ClosureEngine::compile_assign(Assign* expr) {
+    ExprFn value = compile(expr->value_);
+
+    int local = resolve_local(expr->name_.lexeme);
+    if (local >= 0) return [this, value, local]() -> std::any {
+        std::any v = value();
+        if (failed()) return {};
+        return locals_[local] = v;
+    };
+
+    int global = global_slot(expr->name_.lexeme);
+    Token name = expr->name_;
+    return [this, value, global, name]() -> std::any {
+        std::any v = value();
+        if (failed()) return {};
+        if (!globals_[global].has_value()) return fail(name, "Undefined variable '" + name.lexeme + "'.");
+        return globals_[global] = v;
+    };
+}
+
+ClosureEngine::StmtFn ClosureEngine::compile(Stmt* stmt) {
+    if (auto var   = dynamic_cast<Var*  >(stmt)) return compile_var(var);
+    if (auto block = dynamic_cast<Block*>(stmt)) return compile_block(block);
+
+    if (auto function = dynamic_cast<Function*>(stmt)) {
+        unsupported(function->name_, "Functions");
+        return []() { return true; };
+    }
+    if (auto klass = dynamic_cast<Class*>(stmt)) {
+        unsupported(klass->name_, "Classes");
+        return []() { return true; };
+    }
+    if (auto return_stmt = dynamic_cast<Return*>(stmt)) {
+        unsupported(return_stmt->keyword_, "Functions");
+        return []() { return true; };
+    }
+    if (auto import = dynamic_cast<Import*>(stmt)) {
+        unsupported(import->keyword_, "Imports");
+        return []() { return true; };
+    }
+
+    if (auto expression = dynamic_cast<Expression*>(stmt)) {
+        ExprFn expr = compile(expression->expr_);
+        return [this, expr]() { expr(); return !failed(); };
+    }
+
+    if (auto print = dynamic_cast<Print*>(stmt)) {
+        ExprFn expr = compile(print->expr_);
+        return [this, expr]() {
+            std::any value = expr();
+            if (failed()) return false;
+            print_value(std::cout, value);
+            return true;
+        };
+    }
+
+    if (auto if_stmt = dynamic_cast<If*>(stmt)) {
+        ExprFn condition = compile(if_stmt->condition_);
+        StmtFn then_branch = compile(if_stmt->then_branch_);
+        StmtFn else_branch = if_stmt->else_branch_ ? compile(if_stmt->else_branch_) : StmtFn();
+
+        return [this, condition, then_branch, else_branch]() {
+            std::any value = condition();
+            if (failed()) return false;
+
+            if (is_truthy(value)) return then_branch();
+            if (else_branch) return else_branch();
+            return true;
+        };
+    }
+
+    auto while_stmt = static_cast<While*>(stmt);
+    ExprFn condition = compile(while_stmt->condition_);
+    StmtFn body = compile(while_stmt->body_);
+
+    return [this, condition, body]() {
+        while (true) {
+            std::any value = condition();
+            if (failed()) return false;
+            if (!is_truthy(value)) return true;
+            if (!body()) return false;
+        }
+    };
+}
+
+ClosureEngine::StmtFn ClosureEngine::compile_var(Var* stmt) {
+    ExprFn initializer = stmt->initializer_ ? compile(stmt->initializer_) : ExprFn();
+
+    // Slots are bound after the initializer so `var a = a;` reads the outer `a`.
+    int slot;
+    if (scopes_.empty()) {
+        slot = global_slot(stmt->name_.lexeme);
+        return [this, initializer, slot]() {
+            std::any value = nullptr;
+            if (initializer) value = initializer();
+            if (failed()) return false;
+            globals_[slot] = value;
+            return true;
+        };
+    }
+
+    auto [it, inserted] = scopes_.back().try_emplace(stmt->name_.lexeme, next_local_);
+    if (inserted) next_local_++;
+    slot = it->second;
+
+    return [this, initializer, slot]() {
+        std::any value = nullptr;
+        if (initializer) value = initializer();
+        if (failed()) return false;
+        locals_[slot] = value;
+        return true;
+    };
+}
+
+ClosureEngine::StmtFn ClosureEngine::compile_block(Block* stmt) {
+    int first_local = next_local_;
+    scopes_.emplace_back();
+
+    StmtFn block = compile_sequence(stmt->statements_);
+
+    scopes_.pop_back();
+    // Sibling blocks reuse the slots, but the array must cover the deepest nesting.
+    max_locals_ = std::max(max_locals_, next_local_);
+    next_local_ = first_local;
+
+    return block;
+}
+
+ClosureEngine::StmtFn ClosureEngine::compile_sequence(const std::vector<Stmt*>& stmts) {
+    std::vector<StmtFn> fns;
+    for (auto stmt: stmts) fns.emplace_back(compile(stmt));
+
+    if (fns.size() == 1) return fns.front();
+    return [fns]() {
+        for (const auto& fn: fns) if (!fn()) return false;
+        return true;
+    };
+}
+} // namespace lox
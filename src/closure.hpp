@@ -0,0 +1,70 @@
+#pragma once
+
+#include "ast/statements.hpp"
+#include "errors.hpp"
+#include "value.hpp"
+
+#include <functional>
+#include <optional>
+#include <unordered_map>
+
+namespace lox {
+// Lowers the AST once into a tree of pre-bound callables. Operators, literal
+// values and variable slots are fixed while compiling, so running the program
+// never goes through `accept` or re-inspects operator tokens.
+//
+// It covers arithmetic, variables, print, if and loops. Calls, functions,
+// classes, arrays and imports are rejected before anything runs; `--help`
+// says as much.
+class ClosureEngine {
+public:
+    void interpret(const std::vector<Stmt*>& stmts);
+
+    inline bool had_runtime_error() const { return error_.has_value(); }
+
+private:
+    using ExprFn = std::function<std::any()>;
+    using StmtFn = std::function<bool()>;
+
+    // Globals are late bound in Lox, so each name gets a slot that stays empty
+    // until its `var` runs. Locals are resolved statically to a flat slot array.
+    std::vector<std::any> globals_;
+    std::unordered_map<std::string, int> global_slots_;
+
+    std::vector<std::any> locals_;
+    std::vector<std::unordered_map<std::string, int>> scopes_;
+    int next_local_{0};
+    int max_locals_{0};
+
+    std::optional<RuntimeError> error_;
+
+    inline bool failed() const { return error_.has_value(); }
+
+    std::any fail(const Token& token, std::string message) {
+        error_.emplace(token, std::move(message));
+        return {};
+    }
+
+    // Records a compile error for a construct this engine cannot run yet.
+    ExprFn unsupported(const Token&, const std::string& feature);
+
+    int  global_slot(const std::string&);
+    int resolve_local(const std::string&);
+
+    ExprFn compile(Expr*);
+    StmtFn compile(Stmt*);
+
+    ExprFn compile_binary(Binary*);
+    ExprFn compile_logical(Logical*);
+    ExprFn compile_unary(Unary*);
+    ExprFn compile_variable(Variable*);
+    ExprFn compile_assign(Assign*);
+
+    StmtFn compile_var(Var*);
+    StmtFn compile_block(Block*);
+    StmtFn compile_sequence(const std::vector<Stmt*>&);
+
+    template <typename Op>
+    ExprFn numeric(ExprFn, ExprFn, Token, Op);
+};
+} // namespace lox
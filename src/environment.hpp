@@ -1,45 +1,89 @@
 #pragma once
 
 #include "scanner.hpp"
-#include "errors.hpp"
+#include "heap.hpp"
 
 #include <any>
+#include <memory_resource>
+#include <string_view>
 #include <unordered_map>
 
 namespace lox {
-struct Environment {
-    Environment(                      ): enclosing_(nullptr  ) {}
-    Environment(Environment* enclosing): enclosing_(enclosing) {}
+// Lets environments be searched with a lexeme without building a key string.
+struct NameHash {
+    using is_transparent = void;
+    inline size_t operator()(std::string_view name) const { return std::hash<std::string_view>()(name); }
+};
+
+// Entries and their keys come from `resource`; with the heap's pool, a warmed
+// up interpreter defines variables without calling the global allocator.
+struct Environment: public Object {
+    Environment(                       std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : Environment(nullptr, resource) {}
+    Environment(Environment* enclosing, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : enclosing_(enclosing), depth_(enclosing ? enclosing->depth_ + 1 : 0), values_(resource) {}
 
     Environment* enclosing_;
+    // Scopes between this one and the globals, which Binding::OUTER counts
+    // too, and the line of the statement that opened it, which only the
+    // memory profiler reports.
+    int depth_;
+    int line_{0};
+
+    inline size_t entries() const { return values_.size(); }
 
-    void define(const std::string& variable, std::any value) {
-        values_[variable] = value;
+    void define(const std::string& variable, const std::any& value) {
+        auto it = values_.find(std::string_view(variable));
+        if (it != values_.end()) it->second = value;
+        else values_.emplace(variable, value);
     }
 
-    std::any get(Token name) {
-        auto it = values_.find(name.lexeme);
-        if (it == values_.end()) {
-            if (enclosing_) return enclosing_->get(name);
+    // Returns nullptr when the variable is not defined anywhere in the chain.
+    std::any* get(const Token& name) {
+        auto it = values_.find(std::string_view(name.lexeme));
+        if (it == values_.end()) return enclosing_ ? enclosing_->get(name) : nullptr;
+        return &it->second;
+    }
 
-            std::string err = "Undefined variable '" + name.lexeme + "'.";
-            throw RuntimeError(name, err.data());
-        }
-        return it->second;
+    template <typename F>
+    void for_each(F visit) const {
+        for (const auto& [name, value]: values_) visit(std::string_view(name), value);
+    }
+
+    bool assign(const Token& name, const std::any& value) {
+        std::any* slot = get(name);
+        if (!slot) return false;
+        *slot = value;
+        return true;
     }
 
-    void assign(Token name, std::any value) {
-        auto it = values_.find(name.lexeme);
-        if (it == values_.end()) {
-            if (enclosing_) return enclosing_->assign(name, value);
+    void trace(Heap& heap) override {
+        heap.mark(enclosing_);
+        for (const auto& [name, value]: values_) heap.mark_value(value);
+    }
 
-            std::string err = "Undefined variable '" + name.lexeme + "'.";
-            throw RuntimeError(name, err.data());
+    size_t size() const override {
+        size_t bytes = sizeof(Environment) + values_.bucket_count() * sizeof(void*);
+        for (const auto& [name, value]: values_) {
+            bytes += sizeof(void*) + sizeof(std::pair<const std::pmr::string, std::any>);
+            if (name.capacity() > 15) bytes += name.capacity() + 1;
         }
-        values_[name.lexeme] = value;
+        return bytes;
     }
 
 private:
-    std::unordered_map<std::string, std::any> values_;
+    std::pmr::unordered_map<std::pmr::string, std::any, NameHash, std::equal_to<>> values_;
+};
+
+// An imported module: the global scope its file ran in, whose variables
+// `module.name` reads.
+struct Module: public Object {
+    Module(std::string name, Environment* globals): name_(std::move(name)), globals_(globals) {}
+
+    std::string name_;
+    Environment* globals_;
+
+    void trace(Heap& heap) override { heap.mark(globals_); }
+    size_t size() const override { return sizeof(Module) + (name_.capacity() > 15 ? name_.capacity() + 1 : 0); }
 };
 } // namespace lox
@@ -0,0 +1,6 @@
+#include "errors.hpp"
+
+namespace lox::err {
+thread_local bool had_error = false;
+thread_local std::ostream* output = &std::cerr;
+} // namespace lox::err
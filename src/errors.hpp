@@ -1,26 +1,32 @@
 #pragma once
 
+#include "scanner.hpp"
+
 #include <string>
 #include <iostream>
 
 namespace lox {
-class RuntimeError: public std::exception {
+class RuntimeError {
 public:
-    RuntimeError(Token token, char* message): token_(token), message_(message) {}
+    RuntimeError(Token token, std::string message): token_(token), message_(std::move(message)) {}
+    RuntimeError(int line, std::string message)
+        : token_(Token{.type = tk_EOF, .lexeme = "", .literal = nullptr, .line = line}), message_(std::move(message)) {}
 
-    inline char* what() { return message_; }
+    inline const std::string& what() const { return message_; }
     Token token_;
 
 private:
-    char* message_;
+    std::string message_;
 };
 
 namespace err {
-extern bool had_error;
-extern bool hadRuntimeError;
+// Both are per thread, so programs can be compiled on several threads at once.
+extern thread_local bool had_error;
+// Where compile errors go: std::cerr unless the caller collects them.
+extern thread_local std::ostream* output;
 
 static void report(int line, std::string where, std::string message) {
-    std::cerr << "[line " << line << "] Error: " << where << message << std::endl;
+    *output << "[line " << line << "] Error: " << where << message << std::endl;
     had_error = true;
 }
 
@@ -36,9 +42,8 @@ static void error(Token token, std::string message) {
     }
 }
 
-static void runtimeError(RuntimeError error) {
-    std::cerr << error.what() << "\n[line " << error.token_.line << "]" << std::endl;
-    hadRuntimeError = true;
+static void runtime_error(const RuntimeError& error, std::ostream& out = std::cerr) {
+    out << error.what() << "\n[line " << error.token_.line << "]" << std::endl;
   }
 } // namespace lox::err
 } // namespace lox
@@ -0,0 +1,359 @@
+#include "flat.hpp"
+
+namespace lox {
+FlatAst::FlatAst(const std::vector<Stmt*>& stmts) { root_ = lower_block(stmts, false); }
+FlatAst::FlatAst(Expr* expr) { root_ = lower(expr); }
+
+uint32_t FlatAst::add(Node node) {
+    nodes_.push_back(node);
+    return nodes_.size() - 1;
+}
+
+uint32_t FlatAst::add(const Token& token) {
+    tokens_.push_back(token);
+    return tokens_.size() - 1;
+}
+
+void FlatAst::list(Node& node, const std::vector<uint32_t>& items) {
+    node.b = lists_.size();
+    node.c = items.size();
+    lists_.insert(lists_.end(), items.begin(), items.end());
+}
+
+uint32_t FlatAst::global_slot(const std::string& name) {
+    return global_slots_.try_emplace(name, global_slots_.size()).first->second;
+}
+
+uint32_t FlatAst::local_slot(const std::string& name) {
+    for (auto scope = scopes_.rbegin(); scope != scopes_.rend(); scope++) {
+        auto it = scope->find(name);
+        if (it != scope->end()) return it->second;
+    }
+    return NONE;
+}
+
+uint32_t FlatAst::lower(Expr* expr) {
+    if (auto binary = dynamic_cast<Binary*>(expr)) return lower_chain(binary, BINARY);
+    if (auto logical = dynamic_cast<Logical*>(expr)) return lower_chain(logical, LOGICAL);
+    if (auto unary = dynamic_cast<Unary*>(expr)) {
+        uint32_t right = lower(unary->right_);
+        return add({.kind = UNARY, .op = uint8_t(unary->op_.type), .token = add(unary->op_), .a = right});
+    }
+    if (auto grouping = dynamic_cast<Grouping*>(expr)) {
+        uint32_t inner = lower(grouping->expr_);
+        return add({.kind = GROUPING, .a = inner});
+    }
+    if (auto variable = dynamic_cast<Variable*>(expr)) {
+        uint32_t local = local_slot(variable->name_.lexeme);
+        if (local != NONE) return add({.kind = LOCAL, .token = add(variable->name_), .a = local});
+        return add({.kind = GLOBAL, .token = add(variable->name_), .a = global_slot(variable->name_.lexeme)});
+    }
+    if (auto assign = dynamic_cast<Assign*>(expr)) {
+        uint32_t value = lower(assign->value_);
+        uint32_t local = local_slot(assign->name_.lexeme);
+        if (local != NONE) return add({.kind = ASSIGN_LOCAL, .token = add(assign->name_), .a = value, .b = local});
+        return add({.kind = ASSIGN_GLOBAL, .token = add(assign->name_), .a = value, .b = global_slot(assign->name_.lexeme)});
+    }
+    if (auto call = dynamic_cast<Call*>(expr)) {
+        uint32_t callee = lower(call->callee_);
+        std::vector<uint32_t> arguments;
+        for (auto argument: call->arguments_) arguments.push_back(lower(argument));
+        Node node{.kind = CALL, .token = add(call->paren_), .a = callee};
+        list(node, arguments);
+        return add(node);
+    }
+    if (auto get = dynamic_cast<Get*>(expr)) {
+        uint32_t object = lower(get->object_);
+        return add({.kind = GET, .token = add(get->name_), .a = object});
+    }
+    if (auto set = dynamic_cast<Set*>(expr)) {
+        uint32_t object = lower(set->object_), value = lower(set->value_);
+        return add({.kind = SET, .token = add(set->name_), .a = object, .b = value});
+    }
+    if (auto self = dynamic_cast<This*>(expr)) return add({.kind = THIS, .token = add(self->keyword_)});
+    if (auto super = dynamic_cast<Super*>(expr)) return add({.kind = SUPER, .token = add(super->method_)});
+    if (auto array = dynamic_cast<ArrayLiteral*>(expr)) {
+        std::vector<uint32_t> elements;
+        for (auto element: array->elements_) elements.push_back(lower(element));
+        Node node{.kind = ARRAY, .token = add(array->bracket_)};
+        list(node, elements);
+        return add(node);
+    }
+    if (auto index = dynamic_cast<Index*>(expr)) {
+        uint32_t object = lower(index->object_), position = lower(index->index_);
+        return add({.kind = INDEX, .token = add(index->bracket_), .a = object, .b = position});
+    }
+    if (auto set = dynamic_cast<SetIndex*>(expr)) {
+        uint32_t object = lower(set->object_), position = lower(set->index_), value = lower(set->value_);
+        return add({.kind = SET_INDEX, .token = add(set->bracket_), .a = object, .b = position, .c = value});
+    }
+
+    constants_.push_back(static_cast<Literal*>(expr)->value_);
+    return add({.kind = LITERAL, .a = uint32_t(constants_.size() - 1)});
+}
+
+template <typename Link>
+uint32_t FlatAst::lower_chain(Link* link, Kind kind) {
+    std::vector<Link*> links{link};
+    while (links.back()->chain_ > 1) links.push_back(static_cast<Link*>(links.back()->left_));
+
+    uint32_t left = lower(links.back()->left_);
+    for (auto it = links.rbegin(); it != links.rend(); it++) {
+        uint32_t right = lower((*it)->right_);
+        left = add({.kind = kind, .op = uint8_t((*it)->op_.type), .token = add((*it)->op_), .a = left, .b = right, .c = (*it)->chain_});
+    }
+    return left;
+}
+
+uint32_t FlatAst::lower(Stmt* stmt) {
+    if (auto var = dynamic_cast<Var*>(stmt)) {
+        // The slot is bound after the initializer so `var a = a;` reads the outer `a`.
+        uint32_t initializer = var->initializer_ ? lower(var->initializer_) : NONE;
+        if (scopes_.empty()) {
+            return add({.kind = VAR_GLOBAL, .token = add(var->name_), .a = initializer, .b = global_slot(var->name_.lexeme)});
+        }
+        auto [it, inserted] = scopes_.back().try_emplace(var->name_.lexeme, next_local_);
+        if (inserted) next_local_++;
+        return add({.kind = VAR_LOCAL, .token = add(var->name_), .a = initializer, .b = it->second});
+    }
+    if (auto block = dynamic_cast<Block*>(stmt)) return lower_block(block->statements_, true);
+    if (auto expression = dynamic_cast<Expression*>(stmt)) {
+        uint32_t expr = lower(expression->expr_);
+        return add({.kind = EXPRESSION, .a = expr});
+    }
+    if (auto print = dynamic_cast<Print*>(stmt)) {
+        uint32_t expr = lower(print->expr_);
+        return add({.kind = PRINT, .a = expr});
+    }
+    if (auto if_stmt = dynamic_cast<If*>(stmt)) {
+        uint32_t condition = lower(if_stmt->condition_);
+        uint32_t then_branch = lower(if_stmt->then_branch_);
+        uint32_t else_branch = if_stmt->else_branch_ ? lower(if_stmt->else_branch_) : NONE;
+        return add({.kind = IF, .a = condition, .b = then_branch, .c = else_branch});
+    }
+    if (auto while_stmt = dynamic_cast<While*>(stmt)) {
+        uint32_t condition = lower(while_stmt->condition_);
+        uint32_t body = lower(while_stmt->body_);
+        return add({.kind = WHILE, .a = condition, .b = body});
+    }
+
+    // Declarations only the tree interpreter runs keep just a token to report.
+    if (auto function = dynamic_cast<Function*>(stmt)) return add({.kind = FUNCTION, .token = add(function->name_)});
+    if (auto klass = dynamic_cast<Class*>(stmt)) return add({.kind = CLASS, .token = add(klass->name_)});
+    if (auto import = dynamic_cast<Import*>(stmt)) return add({.kind = IMPORT, .token = add(import->keyword_)});
+    return add({.kind = RETURN, .token = add(static_cast<Return*>(stmt)->keyword_)});
+}
+
+uint32_t FlatAst::lower_block(const std::vector<Stmt*>& stmts, bool scope) {
+    uint32_t first_local = next_local_;
+    if (scope) scopes_.emplace_back();
+
+    std::vector<uint32_t> statements;
+    for (auto stmt: stmts) statements.push_back(lower(stmt));
+
+    if (scope) {
+        scopes_.pop_back();
+        // Sibling blocks reuse the slots, but the array must cover the deepest nesting.
+        max_locals_ = std::max(max_locals_, next_local_);
+        next_local_ = first_local;
+    }
+
+    Node node{.kind = BLOCK};
+    list(node, statements);
+    return add(node);
+}
+
+void FlatInterpreter::interpret(const FlatAst& ast) {
+    ast_ = &ast;
+
+    // Reject what this engine can't run before running anything, as the
+    // closure engine does; one pass over the array finds it.
+    //
+    // Tracking: calls, functions, classes, arrays and imports are lowered,
+    // so `parse --flat` prints them, but not run. Running them needs
+    // per-call frames of local slots and a port of the tree interpreter's
+    // objects; until then programs using them belong on the tree engine.
+    for (uint32_t i = 0; i < ast.size(); i++) {
+        const char* feature = nullptr;
+        switch (ast[i].kind) {
+            case FlatAst::CALL:                                                     feature = "Function calls"; break;
+            case FlatAst::FUNCTION: case FlatAst::RETURN:                           feature = "Functions"; break;
+            case FlatAst::GET: case FlatAst::SET: case FlatAst::THIS:
+            case FlatAst::SUPER: case FlatAst::CLASS:                               feature = "Classes"; break;
+            case FlatAst::ARRAY: case FlatAst::INDEX: case FlatAst::SET_INDEX:      feature = "Arrays"; break;
+            case FlatAst::IMPORT:                                                   feature = "Imports"; break;
+            default: break;
+        }
+        if (feature) {
+            fail(ast[i], std::string(feature) + " need the tree engine; the flat engine runs expressions and statements only.");
+            return err::runtime_error(*error_);
+        }
+    }
+
+    globals_.assign(ast.globals(), std::any());
+    locals_.assign(ast.locals(), std::any());
+
+    execute(ast.root());
+    if (error_) err::runtime_error(*error_);
+}
+
+std::any FlatInterpreter::evaluate(uint32_t index) {
+    const FlatAst::Node& node = (*ast_)[index];
+    switch (node.kind) {
+        case FlatAst::LITERAL:  return ast_->constant(node);
+        case FlatAst::GROUPING: return evaluate(node.a);
+        case FlatAst::BINARY:   return node.c > 1 ? evaluate_chain(index) : binary(node);
+
+        case FlatAst::UNARY: {
+            std::any right = evaluate(node.a);
+            if (failed()) return {};
+            if (node.type() == BANG) return !is_truthy(right);
+
+            auto number = std::any_cast<double>(&right);
+            if (!number) return fail(node, "Operand must be a number.");
+            return -*number;
+        }
+
+        case FlatAst::LOGICAL: {
+            if (node.c > 1) return evaluate_chain(index);
+            std::any left = evaluate(node.a);
+            if (failed()) return {};
+            if (is_truthy(left) == (node.type() == OR)) return left;
+            return evaluate(node.b);
+        }
+
+        case FlatAst::LOCAL: return locals_[node.a];
+        case FlatAst::GLOBAL: {
+            const std::any& value = globals_[node.a];
+            if (!value.has_value()) return fail(node, "Undefined variable '" + ast_->token(node).lexeme + "'.");
+            return value;
+        }
+
+        case FlatAst::ASSIGN_LOCAL: {
+            std::any value = evaluate(node.a);
+            if (failed()) return {};
+            return locals_[node.b] = std::move(value);
+        }
+        case FlatAst::ASSIGN_GLOBAL: {
+            std::any value = evaluate(node.a);
+            if (failed()) return {};
+            if (!globals_[node.b].has_value()) return fail(node, "Undefined variable '" + ast_->token(node).lexeme + "'.");
+            return globals_[node.b] = std::move(value);
+        }
+
+        // interpret() rejects the rest before running.
+        default: return nullptr;
+    }
+}
+
+std::any FlatInterpreter::binary(const FlatAst::Node& node) {
+    std::any left = evaluate(node.a);
+    if (failed()) return {};
+    std::any right = evaluate(node.b);
+    if (failed()) return {};
+    return apply(node, left, right);
+}
+
+std::any FlatInterpreter::apply(const FlatAst::Node& node, const std::any& left, const std::any& right) {
+    auto l = std::any_cast<double>(&left);
+    auto r = std::any_cast<double>(&right);
+    if (l && r) switch (node.type()) {
+        case PLUS:          return *l +  *r;
+        case MINUS:         return *l -  *r;
+        case STAR:          return *l *  *r;
+        case SLASH:         return *l /  *r;
+        case GREATER:       return *l >  *r;
+        case GREATER_EQUAL: return *l >= *r;
+        case LESS:          return *l <  *r;
+        case LESS_EQUAL:    return *l <= *r;
+        case EQUAL_EQUAL:   return *l == *r;
+        case BANG_EQUAL:    return *l != *r;
+        default:            return nullptr;
+    }
+
+    switch (node.type()) {
+        case EQUAL_EQUAL: return  is_equal(left, right);
+        case BANG_EQUAL:  return !is_equal(left, right);
+        case PLUS: {
+            auto l = std::any_cast<std::string>(&left);
+            auto r = std::any_cast<std::string>(&right);
+            if (l && r) return *l + *r;
+            return fail(node, "Operands must be two numbers or two strings.");
+        }
+        default: return fail(node, "Operands must be numbers.");
+    }
+}
+
+std::any FlatInterpreter::evaluate_chain(uint32_t index) {
+    // Other chains may run while a right operand is evaluated, above `first`.
+    size_t first = links_.size();
+    for (uint32_t link = index; (*ast_)[link].c > 1; link = (*ast_)[link].a) links_.push_back(link);
+
+    // The innermost link's left operand ends no chain, so this does not come
+    // back here.
+    std::any value = evaluate((*ast_)[links_.back()].a);
+    for (size_t i = links_.size(); i > first && !failed(); i--) {
+        const FlatAst::Node& link = (*ast_)[links_[i - 1]];
+        if (link.kind == FlatAst::LOGICAL) {
+            if (is_truthy(value) == (link.type() == OR)) continue;
+            value = evaluate(link.b);
+            continue;
+        }
+        std::any right = evaluate(link.b);
+        if (!failed()) value = apply(link, value, right);
+    }
+
+    links_.resize(first);
+    if (failed()) return {};
+    return value;
+}
+
+bool FlatInterpreter::execute(uint32_t index) {
+    const FlatAst::Node& node = (*ast_)[index];
+    switch (node.kind) {
+        case FlatAst::EXPRESSION:
+            evaluate(node.a);
+            return !failed();
+
+        case FlatAst::PRINT: {
+            std::any value = evaluate(node.a);
+            if (failed()) return false;
+            print_value(std::cout, value);
+            return true;
+        }
+
+        case FlatAst::VAR_GLOBAL:
+        case FlatAst::VAR_LOCAL: {
+            std::any value = nullptr;
+            if (node.a != FlatAst::NONE) value = evaluate(node.a);
+            if (failed()) return false;
+            (node.kind == FlatAst::VAR_GLOBAL ? globals_ : locals_)[node.b] = std::move(value);
+            return true;
+        }
+
+        case FlatAst::BLOCK: {
+            const uint32_t* statements = ast_->list(node);
+            for (uint32_t i = 0; i < node.c; i++) if (!execute(statements[i])) return false;
+            return true;
+        }
+
+        case FlatAst::IF: {
+            std::any condition = evaluate(node.a);
+            if (failed()) return false;
+            if (is_truthy(condition)) return execute(node.b);
+            if (node.c != FlatAst::NONE) return execute(node.c);
+            return true;
+        }
+
+        case FlatAst::WHILE:
+            while (true) {
+                std::any condition = evaluate(node.a);
+                if (failed()) return false;
+                if (!is_truthy(condition)) return true;
+                if (!execute(node.b)) return false;
+            }
+
+        default: return true;
+    }
+}
+} // namespace lox
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "ast/statements.hpp"
+#include "errors.hpp"
+#include "value.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+
+namespace lox {
+// The AST re-encoded into one contiguous array of fixed-size nodes. Children
+// are 32-bit indices into the array, variable-length children (block bodies,
+// arguments, array elements) are runs in `lists_`, and literal values and
+// tokens live in side tables. Nodes are appended children first, so walking
+// the array front to back visits a subtree before its parent.
+//
+// Lowering resolves variables the way the closure engine does: names declared
+// in blocks become local slots, everything else a late-bound global slot.
+class FlatAst {
+public:
+    enum Kind: uint8_t {
+        // Expressions.
+        LITERAL, GROUPING, UNARY, BINARY, LOGICAL,
+        GLOBAL, LOCAL, ASSIGN_GLOBAL, ASSIGN_LOCAL,
+        CALL, GET, SET, THIS, SUPER, ARRAY, INDEX, SET_INDEX,
+
+        // Statements.
+        EXPRESSION, PRINT, VAR_GLOBAL, VAR_LOCAL, BLOCK, IF, WHILE,
+        FUNCTION, RETURN, CLASS, IMPORT,
+    };
+
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    // What each kind keeps in `a`, `b` and `c`:
+    //   LITERAL                     a: constant
+    //   GROUPING, EXPRESSION, PRINT a: operand
+    //   UNARY                       a: operand
+    //   BINARY, LOGICAL             a: left, b: right, c: links in the chain it
+//                               ends, as Binary::chain_
+    //   GLOBAL, LOCAL               a: slot
+    //   ASSIGN_*                    a: value, b: slot
+    //   VAR_*                       a: initializer or NONE, b: slot
+    //   CALL                        a: callee, b/c: first and count of arguments
+    //   ARRAY, BLOCK                b/c: first and count of elements
+    //   GET                         a: object
+    //   SET                         a: object, b: value
+    //   INDEX                       a: object, b: index
+    //   SET_INDEX                   a: object, b: index, c: value
+    //   IF                          a: condition, b: then, c: else or NONE
+    //   WHILE                       a: condition, b: body
+    // `token` names the variable or property, or is the operator or keyword
+    // that runtime errors point at.
+    struct Node {
+        Kind kind;
+        uint8_t op;
+        uint32_t token;
+        uint32_t a{NONE}, b{NONE}, c{NONE};
+
+        inline TokenType type() const { return TokenType(op); }
+    };
+
+    // Lowers a whole program; `root()` is then a block holding its statements.
+    explicit FlatAst(const std::vector<Stmt*>&);
+    // Lowers a single expression, as the `parse` command prints it.
+    explicit FlatAst(Expr*);
+
+    inline uint32_t root() const { return root_; }
+
+    inline const Node& operator[](uint32_t i) const { return nodes_[i]; }
+    inline size_t size() const { return nodes_.size(); }
+
+    inline const Token& token(const Node& node) const { return tokens_[node.token]; }
+    inline const std::any& constant(const Node& node) const { return constants_[node.a]; }
+    inline const uint32_t* list(const Node& node) const { return lists_.data() + node.b; }
+
+    inline size_t globals() const { return global_slots_.size(); }
+    inline size_t locals() const { return max_locals_; }
+
+private:
+    std::vector<Node> nodes_;
+    std::vector<uint32_t> lists_;
+    std::vector<std::any> constants_;
+    std::vector<Token> tokens_;
+    uint32_t root_{NONE};
+
+    std::unordered_map<std::string, uint32_t> global_slots_;
+    std::vector<std::unordered_map<std::string, uint32_t>> scopes_;
+    uint32_t next_local_{0};
+    uint32_t max_locals_{0};
+
+    uint32_t add(Node);
+    uint32_t add(const Token&);
+    // Stores `items` as one run in `lists_`, recording it in `node`.
+    void list(Node& node, const std::vector<uint32_t>& items);
+
+    uint32_t global_slot(const std::string&);
+    uint32_t local_slot(const std::string&);
+
+    uint32_t lower(Expr*);
+    // Lowers an operator chain without recursing along it.
+    template <typename Link>
+    uint32_t lower_chain(Link*, Kind);
+    uint32_t lower(Stmt*);
+    uint32_t lower_block(const std::vector<Stmt*>&, bool scope);
+};
+
+// Runs a FlatAst with one `switch` over node kinds per step: no virtual calls
+// and no pointers to chase, only indices into the node array.
+//
+// A prototype for expressions and statements: globals, block locals,
+// operators, print, if and loops. Programs that call anything, or declare
+// functions or classes, use arrays or import modules, are rejected before
+// they run.
+class FlatInterpreter {
+public:
+    void interpret(const FlatAst&);
+
+    inline bool had_runtime_error() const { return error_.has_value(); }
+
+private:
+    const FlatAst* ast_{nullptr};
+    std::vector<std::any> globals_;
+    std::vector<std::any> locals_;
+    // The links of the operator chains being evaluated; see evaluate_chain.
+    std::vector<uint32_t> links_;
+
+    std::optional<RuntimeError> error_;
+
+    inline bool failed() const { return error_.has_value(); }
+
+    std::any fail(const FlatAst::Node& node, std::string message) {
+        error_.emplace(ast_->token(node), std::move(message));
+        return {};
+    }
+
+    std::any evaluate(uint32_t);
+    bool      execute(uint32_t);
+
+    std::any binary(const FlatAst::Node&);
+    std::any apply(const FlatAst::Node&, const std::any& left, const std::any& right);
+    // Evaluates a chain of BINARY or LOGICAL links in a loop, as
+    // Interpreter::evaluate_chain does.
+    std::any evaluate_chain(uint32_t);
+};
+} // namespace lox
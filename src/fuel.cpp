@@ -0,0 +1,44 @@
+#include "fuel.hpp"
+
+#include <algorithm>
+#include <limits>
+
+namespace lox {
+Fuel::Fuel(uint64_t max_steps, uint64_t timeout_ms, const std::atomic<bool>* cancel)
+    : max_steps_(max_steps), timeout_ms_(timeout_ms), remaining_(max_steps),
+      deadline_(std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms)), cancel_(cancel) {
+    if (limited()) issue();
+    else countdown_ = std::numeric_limits<int64_t>::max();
+}
+
+void Fuel::issue() {
+    int64_t chunk = CHUNK;
+    if (max_steps_) {
+        chunk = int64_t(std::min<uint64_t>(CHUNK, remaining_));
+        remaining_ -= chunk;
+    }
+    countdown_ = chunk;
+}
+
+bool Fuel::refill() {
+    if (!exhausted_) {
+        if (max_steps_ && !remaining_) exhausted_ = true;
+        else if (timeout_ms_ && std::chrono::steady_clock::now() >= deadline_) exhausted_ = timed_out_ = true;
+        else if (cancel_ && cancel_->load(std::memory_order_relaxed)) exhausted_ = cancelled_ = true;
+    }
+    if (exhausted_) {
+        countdown_ = 0;
+        return false;
+    }
+
+    issue();
+    countdown_--;
+    return true;
+}
+
+std::string Fuel::message() const {
+    if (cancelled_) return "Cancelled.";
+    if (timed_out_) return "Time limit of " + std::to_string(timeout_ms_) + " ms exceeded.";
+    return "Step limit of " + std::to_string(max_steps_) + " exceeded.";
+}
+} // namespace lox
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace lox {
+// Limits on how long a program may run. Every loop iteration, block entry and
+// call takes a step, which only decrements `countdown_`; the step limit and
+// the clock are checked when the countdown runs out, every CHUNK steps at
+// most, as is `cancel`, which another thread may set to stop the run. Without
+// limits the countdown never runs out.
+class Fuel {
+public:
+    static constexpr int64_t CHUNK = 4096;
+
+    // Zero means no limit. The deadline counts from construction.
+    explicit Fuel(uint64_t max_steps = 0, uint64_t timeout_ms = 0, const std::atomic<bool>* cancel = nullptr);
+
+    // Returns false once a limit has been hit.
+    inline bool step() { return --countdown_ >= 0 || refill(); }
+    // Takes the step `step` could not, checking the limits first. Compiled
+    // loops decrement `countdown_` themselves and call this when it goes
+    // negative.
+    bool refill();
+
+    inline bool limited() const { return max_steps_ || timeout_ms_ || cancel_; }
+    inline bool exhausted() const { return exhausted_; }
+    // The runtime error to report once exhausted.
+    std::string message() const;
+
+    int64_t countdown_;
+
+private:
+    uint64_t max_steps_;
+    uint64_t timeout_ms_;
+    // Steps under the limit not yet handed to the countdown.
+    uint64_t remaining_;
+    std::chrono::steady_clock::time_point deadline_;
+    const std::atomic<bool>* cancel_;
+
+    bool exhausted_{false};
+    bool timed_out_{false};
+    bool cancelled_{false};
+
+    // Hands the countdown its next chunk.
+    void issue();
+};
+} // namespace lox
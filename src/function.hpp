@@ -0,0 +1,72 @@
+#pragma once
+
+#include "ast/statements.hpp"
+#include "environment.hpp"
+#include "heap.hpp"
+
+#include <any>
+#include <memory_resource>
+#include <vector>
+
+namespace lox {
+// A function local that a nested function captures. The frame slot holds the
+// cell instead of the value, so the variable outlives the call.
+struct Cell: public Object {
+    Cell(std::any value): value_(std::move(value)) {}
+
+    std::any value_;
+
+    void trace(Heap& heap) override { heap.mark_value(value_); }
+    size_t size() const override { return sizeof(Cell); }
+};
+
+// A function value: the declaration, the environment it was declared in for
+// names that are looked up at run time, and the cells it captured.
+struct Closure: public Object {
+    Closure(Function* declaration, Environment* environment,
+            std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : declaration_(declaration), environment_(environment), cells_(resource) {}
+
+    Function* declaration_;
+    Environment* environment_;
+    std::pmr::vector<Cell*> cells_;
+
+    inline const std::string& name() const { return declaration_->name_.lexeme; }
+
+    void trace(Heap& heap) override {
+        heap.mark(environment_);
+        for (auto cell: cells_) heap.mark(cell);
+    }
+    size_t size() const override { return sizeof(Closure) + cells_.capacity() * sizeof(Cell*); }
+};
+
+// The arguments of a native call, and what the native may use besides them.
+struct NativeCall {
+    // `count` of them, laid out contiguously.
+    const std::any* arguments;
+    size_t count;
+    Heap& heap;
+    // Set to raise a runtime error at the call site.
+    std::string error;
+
+    std::any fail(std::string message) {
+        error = std::move(message);
+        return {};
+    }
+};
+
+// A builtin implemented in C++. Natives are static and live as long as the
+// program, so values refer to them directly rather than through the heap.
+struct Native {
+    const char* name;
+    // Negative for a native that takes any number of arguments.
+    int arity;
+    std::any (*function)(NativeCall&);
+};
+
+namespace natives {
+// Every native, as defined in the global scope.
+extern const Native* const all[];
+extern const size_t count;
+} // namespace lox::natives
+} // namespace lox
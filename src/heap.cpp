@@ -0,0 +1,91 @@
+#include "heap.hpp"
+#include "instance.hpp"
+#include "array.hpp"
+#include "map.hpp"
+
+#include <iostream>
+
+namespace lox {
+Heap::~Heap() {
+    while (objects_) {
+        Object* next = objects_->next_;
+        release(objects_);
+        objects_ = next;
+    }
+}
+
+void Heap::for_each(const std::function<void(const Object&)>& visit) const {
+    for (Object* object = objects_; object; object = object->next_) visit(*object);
+}
+
+void Heap::release(Object* object) {
+    if (on_release_) on_release_(*object);
+    size_t allocation = object->allocation_;
+    object->~Object();
+    pool_.deallocate(object, allocation, alignof(std::max_align_t));
+}
+
+void Heap::mark(Object* object) {
+    if (!object || object->marked_) return;
+    object->marked_ = true;
+    gray_.push_back(object);
+}
+
+void Heap::mark_value(const std::any& value) {
+    if      (auto closure  = std::any_cast<Closure*    >(&value)) mark(*closure);
+    else if (auto instance = std::any_cast<Instance*   >(&value)) mark(*instance);
+    else if (auto array    = std::any_cast<Array*      >(&value)) mark(*array);
+    else if (auto map      = std::any_cast<Map*        >(&value)) mark(*map);
+    else if (auto cell     = std::any_cast<Cell*       >(&value)) mark(*cell);
+    else if (auto klass    = std::any_cast<LoxClass*   >(&value)) mark(*klass);
+    else if (auto bound    = std::any_cast<BoundMethod*>(&value)) mark(*bound);
+    else if (auto module   = std::any_cast<Module*     >(&value)) mark(*module);
+}
+
+void Heap::collect() {
+    auto start = std::chrono::steady_clock::now();
+
+    if (mark_roots_) mark_roots_(*this);
+    for (auto root: roots_) mark(root);
+
+    // An explicit worklist keeps deep environment chains off the native stack.
+    while (!gray_.empty()) {
+        Object* object = gray_.back();
+        gray_.pop_back();
+        object->trace(*this);
+    }
+
+    size_t before = pool_.bytes();
+    Object** link = &objects_;
+    while (Object* object = *link) {
+        if (object->marked_) {
+            object->marked_ = false;
+            link = &object->next_;
+        } else {
+            *link = object->next_;
+            release(object);
+        }
+    }
+
+    size_t live = pool_.bytes();
+    next_gc_ = live;
+    if (options_.initial_threshold) next_gc_ += std::max(options_.initial_threshold, size_t(live * (options_.growth_factor - 1)));
+
+    auto pause = std::chrono::steady_clock::now() - start;
+    stats_.collections++;
+    stats_.bytes_collected += before > live ? before - live : 0;
+    stats_.live_bytes = live;
+    stats_.total_pause += pause;
+    stats_.max_pause = std::max<std::chrono::nanoseconds>(stats_.max_pause, pause);
+}
+
+void print_heap_stats(const HeapStats& stats) {
+    using ms = std::chrono::duration<double, std::milli>;
+    std::cerr << "[gc] collections: "      << stats.collections << "\n"
+              << "[gc] pause total: "      << ms(stats.total_pause).count() << " ms, max: "
+                                           << ms(stats.max_pause).count() << " ms\n"
+              << "[gc] bytes collected: "  << stats.bytes_collected << "\n"
+              << "[gc] heap high-water mark: " << stats.high_water_mark << " bytes\n"
+              << "[gc] live after last collection: " << stats.live_bytes << " bytes" << std::endl;
+}
+} // namespace lox
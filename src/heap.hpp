@@ -0,0 +1,165 @@
+#pragma once
+
+#include "allocation.hpp"
+
+#include <algorithm>
+#include <any>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory_resource>
+#include <new>
+#include <vector>
+
+namespace lox {
+class Heap;
+
+// Base of everything the interpreter allocates at runtime and the collector
+// reclaims: environments, closures and their cells, classes, instances,
+// arrays and maps.
+struct Object {
+    virtual ~Object() = default;
+
+    // Marks the objects this one references.
+    virtual void trace(Heap&) {}
+    // Approximate footprint in bytes, including owned containers.
+    virtual size_t size() const = 0;
+
+private:
+    friend class Heap;
+    Object* next_{nullptr};
+    size_t allocation_{0};
+    bool  marked_{false};
+};
+
+struct HeapOptions {
+    // Bytes allowed after a full collection, objects and the containers
+    // inside them; 0 means unlimited.
+    size_t limit{0};
+    // Bytes allocated before the first collection and the floor for later
+    // ones. 0 collects before every allocation, which shakes out temporaries
+    // that aren't rooted.
+    size_t initial_threshold{1 << 20};
+    // The next collection runs once the heap grows this much past the live set.
+    double growth_factor{2.0};
+};
+
+struct HeapStats {
+    size_t collections{0};
+    size_t bytes_collected{0};
+    size_t high_water_mark{0};
+    size_t live_bytes{0};
+    std::chrono::nanoseconds total_pause{0};
+    std::chrono::nanoseconds   max_pause{0};
+};
+
+// The heap's pool, counting the bytes taken from it. Objects and the
+// containers inside them all come from here, so the count is what the heap
+// schedules collections by and holds to its limit, growth included.
+class CountingResource: public std::pmr::memory_resource {
+public:
+    CountingResource(HeapStats& stats): stats_(stats) {}
+
+    inline size_t bytes() const { return bytes_; }
+
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        void* memory = pool_.allocate(bytes, alignment);
+        bytes_ += bytes;
+        stats_.high_water_mark = std::max(stats_.high_water_mark, bytes_);
+        return memory;
+    }
+    void do_deallocate(void* memory, size_t bytes, size_t alignment) override {
+        pool_.deallocate(memory, bytes, alignment);
+        bytes_ -= bytes;
+    }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+private:
+    std::pmr::unsynchronized_pool_resource pool_;
+    HeapStats& stats_;
+    size_t bytes_{0};
+};
+
+// A non-moving mark-sweep collector. Roots are whatever the root marker marks
+// (the interpreter's environment chain) plus the explicit root stack, which
+// holds temporaries that are not reachable from any environment.
+class Heap {
+public:
+    Heap(HeapOptions options = {}): options_(options), pool_(stats_), next_gc_(options.initial_threshold) {
+        gray_.reserve(64);
+    }
+    ~Heap();
+
+    Heap(const Heap&) = delete;
+    Heap& operator=(const Heap&) = delete;
+
+    inline void set_root_marker(std::function<void(Heap&)> marker) { mark_roots_ = std::move(marker); }
+    // Called with every object just before the collector frees it.
+    inline void set_release_observer(std::function<void(const Object&)> observer) { on_release_ = std::move(observer); }
+
+    void for_each(const std::function<void(const Object&)>&) const;
+
+    inline void push_root(Object* object) { roots_.push_back(object); }
+    inline void  pop_root(              ) { roots_.pop_back(); }
+
+    // Returns nullptr when the allocation would exceed the heap limit even
+    // after a full collection.
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        alloc::PhaseScope phase(alloc::ENVIRONMENTS);
+
+        size_t size = sizeof(T);
+        if (!make_room(size)) return nullptr;
+
+        T* object = new (pool_.allocate(size, alignof(std::max_align_t))) T(std::forward<Args>(args)...);
+        Object* base = object;
+        base->next_ = objects_;
+        base->allocation_ = size;
+        objects_ = base;
+        return object;
+    }
+
+    // Collects if `bytes` more would reach the next collection, and says
+    // whether they fit under the limit. Called before growing a container
+    // by a large step, whose object must be reachable by then.
+    inline bool make_room(size_t bytes) {
+        if (pool_.bytes() + bytes < next_gc_ && !(options_.limit && pool_.bytes() + bytes > options_.limit)) return true;
+        collect();
+        // What is about to be allocated counts as live, or the next
+        // allocation would collect again straight away.
+        next_gc_ += bytes;
+        return !options_.limit || pool_.bytes() + bytes <= options_.limit;
+    }
+
+    void mark(Object*);
+    void mark_value(const std::any&);
+
+    void collect();
+
+    // Objects, and the containers inside them, are carved from this pool so
+    // memory released by a collection is reused without going back to malloc.
+    inline std::pmr::memory_resource* resource() { return &pool_; }
+
+    inline const HeapStats& stats() const { return stats_; }
+    inline const HeapOptions& options() const { return options_; }
+
+private:
+    HeapOptions options_;
+    HeapStats stats_;
+
+    CountingResource pool_;
+
+    Object* objects_{nullptr};
+    std::vector<Object*> roots_;
+    std::vector<Object*> gray_;
+    std::function<void(Heap&)> mark_roots_;
+    std::function<void(const Object&)> on_release_;
+
+    void release(Object*);
+
+    size_t next_gc_;
+};
+
+void print_heap_stats(const HeapStats&);
+} // namespace lox
@@ -0,0 +1,31 @@
+#include "instance.hpp"
+
+namespace lox {
+Property Shape::lookup(const std::string& name) {
+    if (auto slot = slots_.find(std::string_view(name)); slot != slots_.end()) return {Property::FIELD, slot->second};
+
+    auto method = methods_.find(std::string_view(name));
+    if (method == methods_.end()) method = methods_.emplace(name, class_->find_method(name)).first;
+
+    if (method->second) return {Property::METHOD, 0, method->second};
+    return {};
+}
+
+Shape* Shape::transition(const std::string& name) {
+    auto& next = transitions_[name];
+    if (!next) {
+        next = std::make_unique<Shape>(class_);
+        next->slots_ = slots_;
+        next->slots_.emplace(name, fields());
+    }
+    return next.get();
+}
+
+Closure* LoxClass::find_method(std::string_view name) const {
+    for (const LoxClass* klass = this; klass; klass = klass->superclass_) {
+        auto it = klass->methods_.find(name);
+        if (it != klass->methods_.end()) return it->second;
+    }
+    return nullptr;
+}
+} // namespace lox
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "function.hpp"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace lox {
+struct LoxClass;
+
+// A hidden class: the field layout shared by every instance of a class that
+// had the same fields added in the same order. Each class roots a tree of
+// shapes linked by field-adding transitions; instances store only a slot array
+// and point at their shape, which maps names to slots.
+struct Shape {
+    Shape(LoxClass* klass): id_(next_id_++), class_(klass) {}
+
+    const uint64_t id_;
+    LoxClass* class_;
+
+    inline size_t fields() const { return slots_.size(); }
+
+    // What `name` means on instances of this shape: a field, shadowing any
+    // method of the same name, a method of the class or a superclass, or
+    // nothing. Method lookups are memoised per shape.
+    Property lookup(const std::string& name);
+    // The shape an instance of this shape moves to when it gains `name`.
+    Shape* transition(const std::string& name);
+
+    // Slots of every field, including those added by ancestor shapes.
+    std::unordered_map<std::string, int, NameHash, std::equal_to<>> slots_;
+
+private:
+    std::unordered_map<std::string, std::unique_ptr<Shape>, NameHash, std::equal_to<>> transitions_;
+    std::unordered_map<std::string, Closure*, NameHash, std::equal_to<>> methods_;
+
+    static inline std::atomic<uint64_t> next_id_{1};
+};
+
+struct LoxClass: public Object {
+    LoxClass(const std::string& name, LoxClass* superclass,
+             std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : name_(name, resource), superclass_(superclass), methods_(resource),
+          shape_(std::make_unique<Shape>(this)) {}
+
+    std::pmr::string name_;
+    LoxClass* superclass_;
+    std::pmr::unordered_map<std::pmr::string, Closure*, NameHash, std::equal_to<>> methods_;
+    // `init`, inherited or not, looked up once the methods are in place.
+    Closure* initializer_{nullptr};
+    // Set for a class declared at the top level of its program, which a
+    // spawned task rebuilds from it; see tasks.hpp.
+    Class* declaration_{nullptr};
+    // The shape of a freshly constructed instance; owns the whole tree.
+    std::unique_ptr<Shape> shape_;
+
+    Closure* find_method(std::string_view) const;
+    inline int arity() const { return initializer_ ? initializer_->declaration_->arity() : 0; }
+
+    void trace(Heap& heap) override {
+        heap.mark(superclass_);
+        for (const auto& [name, method]: methods_) heap.mark(method);
+    }
+    size_t size() const override {
+        return sizeof(LoxClass) + methods_.size() * (sizeof(std::pmr::string) + 2 * sizeof(void*));
+    }
+};
+
+struct Instance: public Object {
+    Instance(LoxClass* klass, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : class_(klass), shape_(klass->shape_.get()), fields_(resource) {}
+
+    LoxClass* class_;
+    Shape* shape_;
+    // Indexed by the slots of `shape_`.
+    std::pmr::vector<std::any> fields_;
+
+    void trace(Heap& heap) override {
+        heap.mark(class_);
+        for (const auto& value: fields_) heap.mark_value(value);
+    }
+    size_t size() const override { return sizeof(Instance) + fields_.capacity() * sizeof(std::any); }
+};
+
+// `instance.method` evaluated without being called right away.
+struct BoundMethod: public Object {
+    BoundMethod(Instance* receiver, Closure* method): receiver_(receiver), method_(method) {}
+
+    Instance* receiver_;
+    Closure* method_;
+
+    void trace(Heap& heap) override {
+        heap.mark(receiver_);
+        heap.mark(method_);
+    }
+    size_t size() const override { return sizeof(BoundMethod); }
+};
+} // namespace lox
@@ -1,55 +1,172 @@
 #include "interpreter.hpp"
+#include "parser.hpp"
+#include "loader.hpp"
 
 namespace lox {
 std::any Interpreter::visit_binary_expr(Binary* expr) {
+    if (expr->chain_ > 1) return evaluate_chain(expr);
+
     std::any  left = evaluate(expr-> left_);
-    std::any right = evaluate(expr->right_);
+    if (failed()) return {};
+    std::any right = evaluate_holding(left, expr->right_);
+    if (failed()) return {};
 
-    if (expr->op_.type == MINUS) {
-        assert_numbers(expr->op_, left, right);
+    return apply(expr->op_, left, right);
+}
+
+std::any Interpreter::evaluate_chain(Binary* expr) {
+    // Other chains may run while a right operand is evaluated, above `first`.
+    size_t first = links_.size();
+    for (Binary* link = expr; link->chain_ > 1; link = static_cast<Binary*>(link->left_)) links_.push_back(link);
+
+    // The innermost link's left operand is not a Binary, so this does not
+    // come back here.
+    std::any value = visit_binary_expr(static_cast<Binary*>(static_cast<Binary*>(links_.back())->left_));
+    for (size_t i = links_.size(); i > first && !failed(); i--) {
+        auto link = static_cast<Binary*>(links_[i - 1]);
+        std::any right = evaluate_holding(value, link->right_);
+        if (!failed()) value = apply(link->op_, value, right);
+    }
+
+    links_.resize(first);
+    if (failed()) return {};
+    return value;
+}
+
+std::any Interpreter::evaluate_rooted(const std::any& held, Expr* expr) {
+    size_t slot = stack_.size();
+    stack_.push_back(held);
+    std::any value = evaluate(expr);
+    stack_.resize(slot);
+    return value;
+}
+
+std::any Interpreter::apply(const Token& op, std::any& left, const std::any& right) {
+    if (op.type == MINUS) {
+        if (!check_numbers(op, left, right)) return {};
         return std::any_cast<double>(left) - std::any_cast<double>(right);
     }
-    if (expr->op_.type == SLASH) {
-        assert_numbers(expr->op_, left, right);
+    if (op.type == SLASH) {
+        if (!check_numbers(op, left, right)) return {};
         return std::any_cast<double>(left) / std::any_cast<double>(right);
     }
-    if (expr->op_.type ==  STAR) {
-        assert_numbers(expr->op_, left, right);
+    if (op.type ==  STAR) {
+        if (!check_numbers(op, left, right)) return {};
         return std::any_cast<double>(left) * std::any_cast<double>(right);
     }
-    if (expr->op_.type ==  PLUS) {
+    if (op.type ==  PLUS) {
         if ((IS_TYPE(left,      double)) && (IS_TYPE(right,      double))) 
             return std::any_cast<     double>(left) + std::any_cast<     double>(right);
-        if ((IS_TYPE(left, std::string)) && (IS_TYPE(right, std::string)))
-            return std::any_cast<std::string>(left) + std::any_cast<std::string>(right);
-        std::string err = "Operands must be two numbers or two strings.";
-        throw RuntimeError(expr->op_, err.data());
+        if ((IS_TYPE(left, std::string)) && (IS_TYPE(right, std::string))) {
+            // Long concatenations grow one string instead of copying it at every link.
+            std::any_cast<std::string&>(left) += std::any_cast<const std::string&>(right);
+            return std::move(left);
+        }
+        return fail(op, "Operands must be two numbers or two strings.");
     }
 
-    if (expr->op_.type == GREATER      ) {
-        assert_numbers(expr->op_, left, right);
+    if (op.type == GREATER      ) {
+        if (!check_numbers(op, left, right)) return {};
         return std::any_cast<double>(left) >  std::any_cast<double>(right);
     }
-    if (expr->op_.type == GREATER_EQUAL) {
-        assert_numbers(expr->op_, left, right);
+    if (op.type == GREATER_EQUAL) {
+        if (!check_numbers(op, left, right)) return {};
         return std::any_cast<double>(left) >= std::any_cast<double>(right);
     }
-    if (expr->op_.type ==    LESS      ) {
-        assert_numbers(expr->op_, left, right);
+    if (op.type ==    LESS      ) {
+        if (!check_numbers(op, left, right)) return {};
         return std::any_cast<double>(left) <  std::any_cast<double>(right);
     }
-    if (expr->op_.type ==    LESS_EQUAL) {
-        assert_numbers(expr->op_, left, right);
+    if (op.type ==    LESS_EQUAL) {
+        if (!check_numbers(op, left, right)) return {};
         return std::any_cast<double>(left) <= std::any_cast<double>(right);
     }
 
-    if (expr->op_.type == EQUAL_EQUAL) return  is_equal(left, right);
-    if (expr->op_.type ==  BANG_EQUAL) return !is_equal(left, right);
+    if (op.type == EQUAL_EQUAL) return  is_equal(left, right);
+    if (op.type ==  BANG_EQUAL) return !is_equal(left, right);
     return nullptr;
 }
 
+std::any Interpreter::visit_array_expr(ArrayLiteral* expr) {
+    // Elements wait on the stack until the array that holds them exists.
+    size_t first = stack_.size();
+    for (auto element: expr->elements_) {
+        stack_.push_back(evaluate(element));
+        if (failed()) break;
+        if (!(IS_TYPE(stack_.back(), double))) {
+            fail(expr->bracket_, "Array elements must be numbers.");
+            break;
+        }
+    }
+    if (failed()) {
+        stack_.resize(first);
+        return {};
+    }
+
+    size_t count = stack_.size() - first;
+    Array* array = heap_.make_room(count * sizeof(double)) ? heap_.make<Array>(heap_.resource()) : nullptr;
+    if (!array) {
+        stack_.resize(first);
+        out_of_memory(expr->bracket_.line);
+        return {};
+    }
+    array->values_.reserve(count);
+    for (size_t i = first; i < stack_.size(); i++) array->values_.push_back(std::any_cast<double>(stack_[i]));
+
+    stack_.resize(first);
+    return array;
+}
+
+std::any Interpreter::visit_index_expr(Index* expr) {
+    size_t object = stack_.size();
+    stack_.push_back(evaluate(expr->object_));
+    if (!failed()) stack_.push_back(evaluate(expr->index_));
+
+    double* element = failed() ? nullptr : this->element(object, expr->bracket_);
+    stack_.resize(object);
+    if (!element) return {};
+    return *element;
+}
+
+std::any Interpreter::visit_set_index_expr(SetIndex* expr) {
+    size_t object = stack_.size();
+    stack_.push_back(evaluate(expr->object_));
+    if (!failed()) stack_.push_back(evaluate(expr->index_));
+    std::any value = failed() ? std::any() : evaluate(expr->value_);
+
+    if (!failed() && !(IS_TYPE(value, double))) fail(expr->bracket_, "Array elements must be numbers.");
+    double* element = failed() ? nullptr : this->element(object, expr->bracket_);
+    stack_.resize(object);
+    if (!element) return {};
+    return *element = std::any_cast<double>(value);
+}
+
+double* Interpreter::element(size_t object, const Token& bracket) {
+    auto array = std::any_cast<Array*>(&stack_[object]);
+    if (!array) {
+        fail(bracket, "Only arrays can be indexed.");
+        return nullptr;
+    }
+
+    auto index = std::any_cast<double>(&stack_[object + 1]);
+    if (!index || *index != std::floor(*index)) {
+        fail(bracket, "Array index must be an integer.");
+        return nullptr;
+    }
+
+    auto& values = (*array)->values_;
+    if (*index < 0 || *index >= values.size()) {
+        fail(bracket, "Array index out of bounds.");
+        return nullptr;
+    }
+    return &values[size_t(*index)];
+}
+
 std::any Interpreter::visit_logical_expr(Logical* expr) {
+    if (expr->chain_ > 1) return evaluate_chain(expr);
+
     std::any left = evaluate(expr->left_);
+    if (failed()) return {};
     
     if (expr->op_.type ==  OR) if ( is_truthy(left)) return left;
     if (expr->op_.type == AND) if (!is_truthy(left)) return left;
@@ -57,45 +174,583 @@ std::any Interpreter::visit_logical_expr(Logical* expr) {
     return evaluate(expr->right_);
 }
 
+std::any Interpreter::evaluate_chain(Logical* expr) {
+    size_t first = links_.size();
+    for (Logical* link = expr; link->chain_ > 1; link = static_cast<Logical*>(link->left_)) links_.push_back(link);
+
+    std::any value = visit_logical_expr(static_cast<Logical*>(static_cast<Logical*>(links_.back())->left_));
+    for (size_t i = links_.size(); i > first && !failed(); i--) {
+        auto link = static_cast<Logical*>(links_[i - 1]);
+        if (link->op_.type ==  OR && ( is_truthy(value))) continue;
+        if (link->op_.type == AND && (!is_truthy(value))) continue;
+        value = evaluate(link->right_);
+    }
+
+    links_.resize(first);
+    if (failed()) return {};
+    return value;
+}
+
 std::any Interpreter::visit_unary_expr(Unary* expr) {
     std::any right = evaluate(expr->right_);
+    if (failed()) return {};
 
     if (expr->op_.type == MINUS) {
-        assert_number(expr->op_, right);
+        if (!check_number(expr->op_, right)) return {};
         return -std::any_cast<double>(right);
     }
     if (expr->op_.type ==  BANG) return !is_truthy(right);
     return nullptr;
 }
 
-std::any Interpreter::visit_assign_expr(Assign* expr) {
+std::any Interpreter::visit_call_expr(Call* expr) {
+    // The callee and the arguments go straight onto the stack, where the
+    // collector sees them and the arguments become the callee's first slots.
+    size_t callee = stack_.size();
+    Closure* method = nullptr;
+    if (Get* get = expr->method_) {
+        // `object.name(...)`: a method found through the site's cache is called
+        // with the instance as receiver, without creating a bound method.
+        stack_.push_back(evaluate(get->object_));
+        if (!failed()) {
+            auto instance = std::any_cast<Instance*>(&stack_[callee]);
+            if (auto module = std::any_cast<Module*>(&stack_[callee])) stack_[callee] = module_member(*module, get->name_);
+            else if (!instance) fail(get->name_, "Only instances have properties.");
+            else {
+                Property found = property(*instance, get->name_, cache(get));
+                if      (found.kind == Property::METHOD) method = found.method;
+                else if (found.kind == Property::FIELD ) stack_[callee] = (*instance)->fields_[found.slot];
+                else fail(get->name_, "Undefined property '" + get->name_.lexeme + "'.");
+            }
+        }
+    } else {
+        stack_.push_back(evaluate(expr->callee_));
+    }
+
+    for (auto argument: expr->arguments_) {
+        if (failed()) break;
+        stack_.push_back(evaluate(argument));
+    }
+    if (failed()) {
+        stack_.resize(callee);
+        return {};
+    }
+
+    if (method) {
+        if (!check_arity(method->declaration_->arity(), callee, expr->paren_)) return {};
+        return call(method, callee, expr->paren_);
+    }
+    return call_value(callee, expr->paren_);
+}
+
+std::any Interpreter::call_value(size_t callee, const Token& paren) {
+    const std::any& value = stack_[callee];
+
+    if (auto closure = std::any_cast<Closure*>(&value)) {
+        if (!check_arity((*closure)->declaration_->arity(), callee, paren)) return {};
+        return call(*closure, callee, paren);
+    }
+
+    if (auto bound = std::any_cast<BoundMethod*>(&value)) {
+        Closure* method = (*bound)->method_;
+        if (!check_arity(method->declaration_->arity(), callee, paren)) return {};
+        stack_[callee] = (*bound)->receiver_;
+        return call(method, callee, paren);
+    }
+
+    if (auto klass = std::any_cast<LoxClass*>(&value)) {
+        LoxClass* constructed = *klass;
+        if (!check_arity(constructed->arity(), callee, paren)) return {};
+
+        Instance* instance = heap_.make<Instance>(constructed, heap_.resource());
+        if (!instance) {
+            stack_.resize(callee);
+            out_of_memory(paren.line);
+            return {};
+        }
+        stack_[callee] = instance;
+        if (constructed->initializer_) return call(constructed->initializer_, callee, paren);
+
+        stack_.resize(callee);
+        return instance;
+    }
+
+    if (auto native = std::any_cast<const Native*>(&value)) {
+        const Native* function = *native;
+        if (function->arity >= 0 && !check_arity(function->arity, callee, paren)) return {};
+
+        NativeCall call{&stack_[callee + 1], stack_.size() - callee - 1, heap_};
+        std::any result = function->function(call);
+        stack_.resize(callee);
+        if (!call.error.empty()) return fail(paren, std::move(call.error));
+        return result;
+    }
+
+    stack_.resize(callee);
+    return fail(paren, "Can only call functions and classes.");
+}
+
+void Interpreter::run_call(const std::any& callee, const std::vector<std::any>& arguments, int line) {
+    if (!globals_) return;
+    size_t base = stack_.size();
+    stack_.push_back(callee);
+    stack_.insert(stack_.end(), arguments.begin(), arguments.end());
+    call_value(base, Token{.type = RIGHT_PAREN, .lexeme = ")", .literal = nullptr, .line = line});
+}
+
+bool Interpreter::check_arity(int arity, size_t callee, const Token& paren) {
+    size_t arguments = stack_.size() - callee - 1;
+    if (arguments == arity) return true;
+
+    stack_.resize(callee);
+    fail(paren, "Expected " + std::to_string(arity) + " arguments but got " + std::to_string(arguments) + ".");
+    return false;
+}
+
+std::any Interpreter::call(Closure* closure, size_t callee, const Token& paren) {
+    if (frames_.size() >= max_call_depth_) {
+        stack_.resize(callee);
+        return fail(paren, "Stack overflow.");
+    }
+    if (!step(paren.line)) {
+        stack_.resize(callee);
+        return {};
+    }
+
+    // Methods see their receiver, which replaced the callee, as slot 0.
+    Function* function = closure->declaration_;
+    size_t base = function->method() ? callee : callee + 1;
+    stack_.resize(base + function->slots_);
+
+    // Captured parameters move into cells before the body runs.
+    auto box = [&](const Binding& binding) {
+        if (binding.kind != Binding::CELL) return true;
+
+        std::any& local = stack_[base + binding.index];
+        Cell* cell = heap_.make<Cell>(std::move(local));
+        if (!cell) return false;
+        local = cell;
+        return true;
+    };
+    bool boxed = !function->method() || box(function->this_);
+    for (size_t i = 0; boxed && i < function->parameters_.size(); i++) boxed = box(function->parameters_[i]);
+    if (!boxed) {
+        out_of_memory(function);
+        stack_.resize(callee);
+        return {};
+    }
+
+    frames_.push_back({closure, base, environment_});
+    base_ = base;
+    environment_ = closure->environment_;
+
+    for (auto stmt: function->body_) if (!execute(stmt)) break;
+
+    // Initializers return the receiver whether or not they `return`.
+    std::any result;
+    if (!failed()) {
+        if (function->kind_ == Function::INITIALIZER) result = *slot(function->this_);
+        else if (returning_) result = std::move(return_value_);
+        else result = nullptr;
+    }
+    returning_ = false;
+    return_value_.reset();
+
+    environment_ = frames_.back().caller;
+    frames_.pop_back();
+    base_ = frames_.empty() ? 0 : frames_.back().base;
+    stack_.resize(callee);
+
+    return result;
+}
+
+std::any Interpreter::visit_get_expr(Get* expr) {
+    std::any object = evaluate(expr->object_);
+    if (failed()) return {};
+
+    auto instance = std::any_cast<Instance*>(&object);
+    if (auto module = std::any_cast<Module*>(&object)) return module_member(*module, expr->name_);
+    if (!instance) return fail(expr->name_, "Only instances have properties.");
+
+    Property found = property(*instance, expr->name_, cache(expr));
+    if (found.kind == Property::FIELD) return (*instance)->fields_[found.slot];
+    if (found.kind == Property::METHOD) return bind(*instance, found.method, expr->name_);
+    return fail(expr->name_, "Undefined property '" + expr->name_.lexeme + "'.");
+}
+
+std::any Interpreter::module_member(Module* module, const Token& name) {
+    if (std::any* value = module->globals_->get(name)) return *value;
+    return fail(name, "Undefined property '" + name.lexeme + "'.");
+}
+
+std::any Interpreter::visit_set_expr(Set* expr) {
+    // The object waits on the stack while the value is evaluated.
+    size_t object = stack_.size();
+    stack_.push_back(evaluate(expr->object_));
+    if (failed()) {
+        stack_.resize(object);
+        return {};
+    }
+    if (!(IS_TYPE(stack_[object], Instance*))) {
+        stack_.resize(object);
+        return fail(expr->name_, "Only instances have fields.");
+    }
+
     std::any value = evaluate(expr->value_);
-    environment_->assign(expr->name_, value);
+    Instance* instance = std::any_cast<Instance*>(stack_[object]);
+    stack_.resize(object);
+    if (failed()) return {};
+
+    set_property(instance, expr->name_, cache(expr), value);
     return value;
 }
 
+std::any Interpreter::visit_super_expr(Super* expr) {
+    std::any* superclass = slot(expr->binding_);
+    if (!superclass) superclass = environment_->get(expr->keyword_);
+    Instance* receiver = std::any_cast<Instance*>(*slot(expr->this_));
+
+    Closure* method = std::any_cast<LoxClass*>(*superclass)->find_method(expr->method_.lexeme);
+    if (!method) return fail(expr->method_, "Undefined property '" + expr->method_.lexeme + "'.");
+    return bind(receiver, method, expr->method_);
+}
+
+Property Interpreter::property(Instance* instance, const Token& name, InlineCache& cache) {
+    Shape* shape = instance->shape_;
+    if (inline_caches_) {
+        if (auto entry = cache.find(shape->id_)) return entry->property;
+    }
+
+    Property found = shape->lookup(name.lexeme);
+    if (inline_caches_ && found.kind != Property::MISSING) cache.insert({shape->id_, found, nullptr});
+    return found;
+}
+
+void Interpreter::set_property(Instance* instance, const Token& name, InlineCache& cache, const std::any& value) {
+    Shape* shape = instance->shape_;
+    const InlineCache::Entry* entry = inline_caches_ ? cache.find(shape->id_) : nullptr;
+
+    InlineCache::Entry miss;
+    if (!entry) {
+        auto slot = shape->slots_.find(std::string_view(name.lexeme));
+        if (slot != shape->slots_.end()) miss = {shape->id_, {Property::FIELD, slot->second}, nullptr};
+        else miss = {shape->id_, {Property::FIELD, int(shape->fields())}, shape->transition(name.lexeme)};
+
+        if (inline_caches_) cache.insert(miss);
+        entry = &miss;
+    }
+
+    if (entry->transition) {
+        instance->fields_.push_back(value);
+        instance->shape_ = entry->transition;
+    } else {
+        instance->fields_[entry->property.slot] = value;
+    }
+}
+
+std::any Interpreter::bind(Instance* receiver, Closure* method, const Token& name) {
+    heap_.push_root(receiver);
+    BoundMethod* bound = heap_.make<BoundMethod>(receiver, method);
+    heap_.pop_root();
+
+    if (!bound) {
+        out_of_memory(name.line);
+        return {};
+    }
+    return bound;
+}
+
+std::any Interpreter::visit_variable_expr(Variable* expr) {
+    if (std::any* value = slot(expr->binding_)) return *value;
+
+    std::any* value = lookup(expr->binding_, expr->name_);
+    if (!value) return fail(expr->name_, "Undefined variable '" + expr->name_.lexeme + "'.");
+    return *value;
+}
+
+std::any Interpreter::visit_assign_expr(Assign* expr) {
+    std::any value = evaluate(expr->value_);
+    if (failed()) return {};
+
+    if (std::any* target = slot(expr->binding_)) return *target = value;
+    std::any* target = lookup(expr->binding_, expr->name_);
+    if (!target) return fail(expr->name_, "Undefined variable '" + expr->name_.lexeme + "'.");
+    return *target = value;
+}
+
 void Interpreter::visit_print_stmt(Print* stmt) {
     std::any value = evaluate(stmt->expr_);
-    std::cout << stringify(value) << std::endl;
+    if (failed()) return;
+    print_value(out_, value);
 }
 
 void Interpreter::visit_var_stmt(Var* stmt) {
     std::any value = nullptr;
     if (stmt->initializer_) value = evaluate(stmt->initializer_);
+    if (failed()) return;
 
+    switch (stmt->binding_.kind) {
+        case Binding::LOCAL:
+            stack_[base_ + stmt->binding_.index] = std::move(value);
+            return;
+        case Binding::CELL: {
+            // The value waits in its slot, where the collector can see it,
+            // while the cell is allocated. Each execution makes a new cell.
+            std::any& local = stack_[base_ + stmt->binding_.index];
+            local = std::move(value);
+            Cell* cell = heap_.make<Cell>(std::move(local));
+            if (!cell) return out_of_memory(stmt);
+            local = cell;
+            return;
+        }
+        default: break;
+    }
+
+    alloc::PhaseScope phase(alloc::ENVIRONMENTS);
     environment_->define(stmt->name_.lexeme, value);
 }
 
-void Interpreter::execute_block(std::vector<Stmt*> statements, Environment* environment) {
+void Interpreter::visit_function_stmt(Function* stmt) {
+    // A function that calls itself captures its own cell, so that must exist
+    // before the closure is built.
+    if (!declare(stmt, stmt->binding_)) return;
+
+    Closure* closure = make_closure(stmt);
+    if (!closure) return out_of_memory(stmt);
+    define(stmt->binding_, stmt->name_.lexeme, closure);
+}
+
+void Interpreter::visit_class_stmt(Class* stmt) {
+    LoxClass* superclass = nullptr;
+    if (stmt->superclass_) {
+        std::any value = evaluate(stmt->superclass_);
+        if (failed()) return;
+
+        auto klass = std::any_cast<LoxClass*>(&value);
+        if (!klass) {
+            fail(stmt->superclass_->name_, "Superclass must be a class.");
+            return;
+        }
+        superclass = *klass;
+    }
+
+    // Defined before the methods are built, which keeps it reachable while
+    // they are allocated and lets them refer to the class by name.
+    if (!declare(stmt, stmt->binding_)) return;
+    LoxClass* klass = heap_.make<LoxClass>(stmt->name_.lexeme, superclass, heap_.resource());
+    if (!klass) return out_of_memory(stmt);
+    define(stmt->binding_, stmt->name_.lexeme, klass);
+    if (stmt->binding_.kind == Binding::DYNAMIC && environment_ == globals_) klass->declaration_ = stmt;
+    add_methods(stmt, klass);
+}
+
+LoxClass* Interpreter::rebuild_class(Class* declaration, LoxClass* superclass) {
+    LoxClass* klass = heap_.make<LoxClass>(declaration->name_.lexeme, superclass, heap_.resource());
+    if (!klass) return nullptr;
+    klass->declaration_ = declaration;
+
+    heap_.push_root(klass);
+    add_methods(declaration, klass);
+    heap_.pop_root();
+    if (!failed()) return klass;
+    error_.reset();
+    return nullptr;
+}
+
+void Interpreter::add_methods(Class* stmt, LoxClass* klass) {
+    LoxClass* superclass = klass->superclass_;
+
+    // Methods find `super` in an environment of its own, or in a frame slot
+    // when the class is declared inside a function.
+    Environment* enclosing = environment_;
+    if (superclass && stmt->super_.kind == Binding::DYNAMIC) {
+        Environment* environment = heap_.make<Environment>(environment_, heap_.resource());
+        if (!environment) return out_of_memory(stmt);
+        environment->line_ = stmt->line_;
+        environment->define("super", superclass);
+        environment_ = environment;
+    } else if (superclass) {
+        if (!declare(stmt, stmt->super_)) return;
+        define(stmt->super_, "super", superclass);
+    }
+
+    for (auto method: stmt->methods_) {
+        Closure* closure = make_closure(method);
+        if (!closure) {
+            environment_ = enclosing;
+            return out_of_memory(stmt);
+        }
+        klass->methods_.insert_or_assign(std::pmr::string(method->name_.lexeme, heap_.resource()), closure);
+    }
+    klass->initializer_ = klass->find_method("init");
+
+    environment_ = enclosing;
+}
+
+void Interpreter::visit_import_stmt(Import* stmt) {
+    const ParsedModule* source = graph_ ? graph_->find(stmt->file_) : nullptr;
+    if (!source) {
+        fail(stmt->keyword_, "Can't import '" + stmt->path_.lexeme + "': modules were not loaded.");
+        return;
+    }
+
+    auto [entry, first] = modules_.try_emplace(source, nullptr);
+    if (!first) return define(stmt->binding_, stmt->name_.lexeme, entry->second);
+
+    // The program itself is already running in the globals.
+    bool program = source == graph_->entry.get();
+    Environment* globals = program ? globals_ : make_globals();
+    Module* module = nullptr;
+    if (globals) {
+        heap_.push_root(globals);
+        module = heap_.make<Module>(stmt->name_.lexeme, globals);
+        heap_.pop_root();
+    }
+    if (!module) {
+        modules_.erase(entry);
+        return out_of_memory(stmt);
+    }
+    entry->second = module;
+
+    if (!program) execute_block(source->statements, globals);
+    if (!failed()) define(stmt->binding_, stmt->name_.lexeme, module);
+}
+
+Environment* Interpreter::make_globals() {
+    Environment* globals = heap_.make<Environment>(heap_.resource());
+    if (!globals) return nullptr;
+    for (size_t i = 0; i < natives::count; i++) globals->define(natives::all[i]->name, natives::all[i]);
+    return globals;
+}
+
+Closure* Interpreter::make_closure(Function* function) {
+    Closure* closure = heap_.make<Closure>(function, environment_, heap_.resource());
+    if (!closure) return nullptr;
+
+    closure->cells_.reserve(function->captures_.size());
+    for (auto [local, index]: function->captures_) {
+        if (local) closure->cells_.push_back(std::any_cast<Cell*>(stack_[base_ + index]));
+        else       closure->cells_.push_back(frames_.back().closure->cells_[index]);
+    }
+    return closure;
+}
+
+bool Interpreter::declare(Stmt* stmt, const Binding& binding) {
+    if (binding.kind != Binding::CELL) return true;
+
+    Cell* cell = heap_.make<Cell>(nullptr);
+    if (!cell) {
+        out_of_memory(stmt);
+        return false;
+    }
+    stack_[base_ + binding.index] = cell;
+    return true;
+}
+
+void Interpreter::define(const Binding& binding, const std::string& name, std::any value) {
+    if (std::any* target = slot(binding)) {
+        *target = std::move(value);
+        return;
+    }
+
+    alloc::PhaseScope phase(alloc::ENVIRONMENTS);
+    environment_->define(name, value);
+}
+
+void Interpreter::visit_return_stmt(Return* stmt) {
+    std::any value = nullptr;
+    if (stmt->value_) value = evaluate(stmt->value_);
+    if (failed()) return;
+
+    return_value_ = std::move(value);
+    returning_ = true;
+}
+
+void Interpreter::visit_while_stmt(While* stmt) {
+    if (jit_ && jit_->is_compiled(stmt) && jit_->run(stmt, environment_)) return check_fuel(stmt->line_);
+
+    for (int iterations = 0; true; iterations++) {
+        if (jit_ && iterations == jit_->threshold() && jit_->run(stmt, environment_)) return check_fuel(stmt->line_);
+        if (!step(stmt->line_)) return;
+
+        std::any condition = evaluate(stmt->condition_);
+        if (failed() || !is_truthy(condition)) return;
+        if (!execute(stmt->body_)) return;
+    }
+}
+
+void Interpreter::run_counted_loop(CountedLoop* stmt) {
+    if (!execute(stmt->initializer_)) return;
+
+    While* loop = stmt->loop_;
+    auto condition = static_cast<Binary*>(loop->condition_);
+    TokenType comparison = condition->op_.type;
+
+    // Both slots stay put for the whole loop: the body defines its own
+    // variables in nested scopes, never in the loop scope or above it.
+    std::any* counter = environment_->get(stmt->initializer_->name_);
+    std::any* bound = nullptr;
+    if (auto variable = dynamic_cast<Variable*>(condition->right_)) bound = environment_->get(variable->name_);
+    else bound = &static_cast<Literal*>(condition->right_)->value_;
+
+    if (jit_ && jit_->is_compiled(loop) && jit_->run(loop, environment_)) return check_fuel(loop->line_);
+
+    for (int iterations = 0; true; iterations++) {
+        if (jit_ && iterations == jit_->threshold() && jit_->run(loop, environment_)) return check_fuel(loop->line_);
+        if (!step(loop->line_)) return;
+
+        // Once the body stores something other than a number in `i` or `n`,
+        // the generic loop takes over and reports errors as usual.
+        double* i = std::any_cast<double>(counter);
+        const double* n = bound ? std::any_cast<double>(bound) : nullptr;
+        if (!i || !n) return visit_while_stmt(loop);
+
+        bool running;
+        switch (comparison) {
+            case LESS:          running = *i <  *n; break;
+            case LESS_EQUAL:    running = *i <= *n; break;
+            case GREATER:       running = *i >  *n; break;
+            default:            running = *i >= *n; break;
+        }
+        if (!running) return;
+
+        if (!execute(stmt->body_)) return;
+
+        if (double* next = std::any_cast<double>(counter)) *next += stmt->step_;
+        else if (!execute(stmt->increment_)) return;
+    }
+}
+
+void Interpreter::mark_roots(Heap& heap) {
+    heap.mark(environment_);
+    // A module runs with its own globals as the environment.
+    heap.mark(globals_);
+    for (const auto& [source, module]: modules_) heap.mark(module);
+    for (const auto& frame: frames_) {
+        heap.mark(frame.closure);
+        heap.mark(frame.caller);
+    }
+    for (const auto& value: stack_) heap.mark_value(value);
+    heap.mark_value(return_value_);
+}
+
+bool Interpreter::parse(Block* block) {
+    Parser parser(*block->tokens_, true, nullptr, block->max_nesting_);
+    std::vector<Stmt*> statements = parser.parse_block(block->first_, block->depth_, block->scopes_);
+    if (err::had_error) {
+        error_.emplace(block->line_, "Syntax error.");
+        return false;
+    }
+    block->set_statements(std::move(statements));
+    return true;
+}
+
+void Interpreter::execute_block(const std::vector<Stmt*>& statements, Environment* environment) {
     Environment* previous = environment_;
     environment_ = environment;
 
-    try {
-        for (auto stmt: statements) execute(stmt);
-    } catch (RuntimeError error) {
-        err::runtimeError(error);
-    }
+    for (auto stmt: statements) if (!execute(stmt)) break;
 
     environment_ = previous;
 }
-} // namespace lox
\ No newline at end of file
+} // namespace lox
@@ -2,100 +2,310 @@
 
 #include "ast/statements.hpp"
 #include "environment.hpp"
+#include "function.hpp"
+#include "instance.hpp"
+#include "array.hpp"
 #include "errors.hpp"
+#include "value.hpp"
+#include "jit.hpp"
+#include "fuel.hpp"
+
+#include <optional>
+#include <cmath>
 
 namespace lox {
+struct ModuleGraph;
+struct ParsedModule;
+
+struct InterpreterOptions {
+    bool jit{LOX_JIT_AVAILABLE};
+    // Iterations a loop runs in the interpreter before it is compiled.
+    int jit_threshold{100};
+    // Nested calls allowed before a call fails with "Stack overflow.".
+    int max_call_depth{1024};
+    // Property accesses consult their site's inline cache before the shape.
+    bool inline_caches{true};
+    // Steps and wall-clock time a run may take before it fails; zero means no
+    // limit. See Fuel.
+    uint64_t max_steps{0};
+    uint64_t timeout_ms{0};
+    // Where `print` writes.
+    std::ostream* out{&std::cout};
+    // Once set, the run fails at its next step; see Fuel.
+    const std::atomic<bool>* cancel{nullptr};
+    // The parsed modules `import` statements run; see ModuleLoader.
+    const ModuleGraph* modules{nullptr};
+
+    HeapOptions heap;
+};
+
 class Interpreter: public ExprVisitor<std::any>, public StmtVisitor<void> {
 public:
-    void interpret(std::vector<Stmt*> stmts) { 
-        try {
-            for (auto stmt: stmts) execute(stmt);
-        } catch (RuntimeError error) {
-            err::runtimeError(error);
-        }
+    Interpreter(InterpreterOptions options = {}): heap_(options.heap), fuel_(options.max_steps, options.timeout_ms, options.cancel),
+                                                 out_(*options.out), max_call_depth_(options.max_call_depth),
+                                                 inline_caches_(options.inline_caches), graph_(options.modules) {
+        if (options.jit) jit_ = std::make_unique<Jit>(options.jit_threshold, out_, fuel_.limited() ? &fuel_ : nullptr);
+
+        heap_.set_root_marker([this](Heap& heap) { mark_roots(heap); });
+        environment_ = globals_ = make_globals();
+        // A heap limit too small for the globals leaves the interpreter with
+        // only this error; it runs nothing.
+        if (!globals_) out_of_memory(1);
+
+        stack_.reserve(256);
+        frames_.reserve(64);
+    }
+
+    // Runs without reporting a runtime error; see `error`.
+    void run(const std::vector<Stmt*>& stmts) {
+        if (!globals_) return;
+        for (auto stmt: stmts) if (!execute(stmt)) break;
+    }
+
+    // Calls `callee` with `arguments` as a call on `line` would, without
+    // reporting a runtime error.
+    void run_call(const std::any& callee, const std::vector<std::any>& arguments, int line);
+    // Builds a class declared at the top level of another interpreter's
+    // program around these globals, as a spawned task does; nullptr when out
+    // of memory. `superclass` must be reachable already.
+    LoxClass* rebuild_class(Class* declaration, LoxClass* superclass);
+
+    void interpret(const std::vector<Stmt*>& stmts) { 
+        run(stmts);
+        // A block that failed to parse when it first ran has reported its
+        // syntax errors already.
+        if (error_ && !err::had_error) err::runtime_error(*error_);
     }
 
     void interpret(Expr* expr) { 
-        try {
-            std::any value = evaluate(expr);
-            std::cout << stringify(value) << std::endl;
-        } catch (RuntimeError error) {
-            err::runtimeError(error);
-        }
+        if (!globals_) return err::runtime_error(*error_);
+        std::any value = evaluate(expr);
+        if (error_) return err::runtime_error(*error_);
+        out_ << stringify(value) << std::endl;
     }
 
+    inline bool had_runtime_error() const { return error_.has_value(); }
+    inline const std::optional<RuntimeError>& error() const { return error_; }
+
+    // Keeps inline caches in a table of `sites` entries, one per Get and Set
+    // site, instead of in the AST, which other threads may then be running.
+    inline void isolate_caches(size_t sites) { caches_.assign(sites, {}); }
+    inline const HeapStats& heap_stats() const { return heap_.stats(); }
+    inline Heap& heap() { return heap_; }
+    // Only there when the interpreter has no error after construction.
+    inline Environment& globals() { return *globals_; }
+
+           std::any    visit_array_expr(ArrayLiteral* ) override;
            std::any   visit_binary_expr( Binary*      ) override;
+           std::any     visit_call_expr(   Call*      ) override;
+           std::any      visit_get_expr(    Get*      ) override;
     inline std::any visit_grouping_expr(Grouping* expr) override { return evaluate(expr->expr_); }
+           std::any    visit_index_expr(  Index*      ) override;
     inline std::any  visit_literal_expr( Literal* expr) override { return expr->value_; }
            std::any   visit_logical_expr( Logical*    ) override;
+           std::any      visit_set_expr(    Set*      ) override;
+           std::any visit_set_index_expr(SetIndex*    ) override;
+           std::any    visit_super_expr(  Super*      ) override;
+    inline std::any     visit_this_expr(   This* expr) override { return *slot(expr->binding_); }
            std::any    visit_unary_expr(   Unary*     ) override;
-    inline std::any visit_variable_expr(Variable* expr) override { return environment_->get(expr->name_); }
+           std::any visit_variable_expr(Variable*     ) override;
            std::any   visit_assign_expr(  Assign*     ) override;
 
     inline void visit_expression_stmt(Expression* stmt) override { evaluate(stmt->expr_); }
            void      visit_print_stmt(     Print*     ) override;
            void        visit_var_stmt(       Var*     ) override;
+           void   visit_function_stmt(  Function*     ) override;
+           void     visit_return_stmt(    Return*     ) override;
+           void      visit_class_stmt(     Class*     ) override;
+           void     visit_import_stmt(    Import*     ) override;
     inline void      visit_block_stmt(     Block* stmt) override {
-        execute_block(stmt->statements_, new Environment(environment_));
+        if (!step(stmt->line_)) return;
+        if (stmt->tokens_ && !parse(stmt)) return;
+        if (!stmt->declares_) {
+            for (auto inner: stmt->statements_) if (!execute(inner)) return;
+            return;
+        }
+
+        Environment* environment = heap_.make<Environment>(environment_, heap_.resource());
+        if (!environment) return out_of_memory(stmt);
+        environment->line_ = stmt->line_;
+        execute_block(stmt->statements_, environment);
     }
     inline void         visit_if_stmt(        If* stmt) override {
-        if (is_truthy(evaluate(stmt->condition_))) execute(stmt->then_branch_);
-        else               if (stmt->else_branch_) execute(stmt->else_branch_);
+        std::any condition = evaluate(stmt->condition_);
+        if (failed()) return;
+
+        if (is_truthy(condition)) execute(stmt->then_branch_);
+        else if (stmt->else_branch_) execute(stmt->else_branch_);
     }
-    inline void      visit_while_stmt(     While* stmt) override {
-        while (is_truthy(evaluate(stmt->condition_))) execute(stmt->body_);
+           void      visit_while_stmt(     While*     ) override;
+    inline void visit_counted_loop_stmt(CountedLoop* stmt) override {
+        // Inside functions the counter is a frame slot: run the plain loop.
+        if (!stmt->declares_) return visit_block_stmt(stmt);
+
+        Environment* environment = heap_.make<Environment>(environment_, heap_.resource());
+        if (!environment) return out_of_memory(stmt);
+        environment->line_ = stmt->line_;
+
+        Environment* previous = environment_;
+        environment_ = environment;
+        run_counted_loop(stmt);
+        environment_ = previous;
     }
 
 private:
-    Environment* environment_ = new Environment();
+    // Declared first: the global environment is allocated from it.
+    Heap heap_;
+    Environment* environment_{nullptr};
+    Environment* globals_{nullptr};
+    // Declared before the JIT, whose compiled loops take steps from it.
+    Fuel fuel_;
+    std::unique_ptr<Jit> jit_;
+    std::ostream& out_;
+    std::vector<InlineCache> caches_;
 
-    std::any evaluate(Expr* expr) { return expr->accept(this); }
-    void      execute(Stmt* stmt) {        stmt->accept(this); }
+    // One contiguous stack holds every active call's callee, arguments and
+    // locals; a frame records where its slots start and the environment to
+    // restore when it returns.
+    struct Frame {
+        Closure* closure;
+        size_t base;
+        Environment* caller;
+    };
+    std::vector<std::any> stack_;
+    std::vector<Frame> frames_;
+    // Links of the operator chains being evaluated, innermost last; see
+    // `evaluate_chain`.
+    std::vector<Expr*> links_;
+    // Slot 0 of the innermost frame.
+    size_t base_{0};
+    size_t max_call_depth_;
+    bool inline_caches_;
 
-    void execute_block(std::vector<Stmt*>, Environment*);
+    const ModuleGraph* graph_;
+    // Every module imported so far, added before it runs so that an import
+    // cycle binds the partly run module instead of running it again.
+    std::unordered_map<const ParsedModule*, Module*> modules_;
 
-    bool is_truthy(std::any value) {
-        if (IS_TYPE(value, std::nullptr_t)) return false;
-        if (IS_TYPE(value, bool)) return std::any_cast<bool>(value);
-        return true;
-    }
+    // The first runtime error raised; once set, evaluation unwinds to `interpret`.
+    std::optional<RuntimeError> error_;
+    // Set by `return`, which unwinds the statements of the call the same way.
+    bool returning_{false};
+    std::any return_value_;
+
+    inline bool failed() const { return error_.has_value(); }
 
-    bool is_equal(std::any left, std::any right) {
-        if (left.type().name() != right.type().name()) return false;
+    std::any fail(const Token& token, std::string message) {
+        error_.emplace(token, std::move(message));
+        return {};
+    }
 
-        if (IS_TYPE(left, std::nullptr_t)) return true;
-        if (IS_TYPE(left,           bool)) return std::any_cast<       bool>(left) == std::any_cast<       bool>(right);
-        if (IS_TYPE(left,         double)) return std::any_cast<     double>(left) == std::any_cast<     double>(right);
-        if (IS_TYPE(left,    std::string)) return std::any_cast<std::string>(left) == std::any_cast<std::string>(right);
+    inline void out_of_memory(Stmt* stmt) { out_of_memory(stmt->line_); }
+    void out_of_memory(int line) {
+        error_.emplace(line, "Out of memory: heap limit of " + std::to_string(heap_.options().limit) + " bytes exceeded.");
+    }
 
+    // Takes a step of fuel, failing at `line` once a limit has been hit.
+    inline bool step(int line) {
+        if (fuel_.step()) return true;
+        error_.emplace(line, fuel_.message());
         return false;
     }
+    // Compiled loops stop early when they run out of fuel; the interpreter
+    // reports it for them.
+    inline void check_fuel(int line) {
+        if (fuel_.exhausted()) error_.emplace(line, fuel_.message());
+    }
 
-    void assert_number(Token op, std::any operand) {
-        if (IS_TYPE(operand, double)) return;
-        std::string err = "Operand must be a number.";
-        throw RuntimeError(op, err.data());
+    std::any evaluate(Expr* expr) { return expr->accept(this); }
+    // Evaluates `expr` while `held`, an operand evaluated before it, stays
+    // where the collector sees it. Numbers and strings aren't on the heap.
+    inline std::any evaluate_holding(const std::any& held, Expr* expr) {
+        if (IS_TYPE(held, double) || IS_TYPE(held, std::string)) return evaluate(expr);
+        return evaluate_rooted(held, expr);
+    }
+    std::any evaluate_rooted(const std::any& held, Expr* expr);
+    // Chains such as `a + b + c` nest down their left operands, so these run
+    // them from the innermost link out in a loop rather than recursing.
+    std::any evaluate_chain(Binary*);
+    std::any evaluate_chain(Logical*);
+    // Applies a binary operator. A string on the left is appended to in place.
+    std::any apply(const Token& op, std::any& left, const std::any& right);
+    // Returns false when the enclosing statements should stop: on an error or
+    // once a `return` has run.
+    bool      execute(Stmt* stmt) {
+        alloc::set_line(stmt->line_);
+        stmt->accept(this);
+        return !failed() && !returning_;
     }
 
-    void assert_numbers(Token op, std::any left, std::any right) {
-        if (IS_TYPE(left, double) && IS_TYPE(right, double)) return;
-        std::string err = "Operands must be numbers.";
-        throw RuntimeError(op, err.data());
+    void execute_block(const std::vector<Stmt*>&, Environment*);
+    // A global scope with the natives defined, or nullptr when out of memory.
+    Environment* make_globals();
+    // Parses a skimmed block in place; false after a syntax error.
+    bool parse(Block*);
+
+    // Calls run with the callee and its arguments on top of the stack, the
+    // callee at `callee`; each pops them before returning.
+    std::any call_value(size_t callee, const Token& paren);
+    std::any       call(Closure*, size_t callee, const Token& paren);
+    bool     check_arity(int arity, size_t callee, const Token& paren);
+
+    Closure* make_closure(Function*);
+    // Gives `klass` the methods `stmt` declares, in the current environment.
+    void add_methods(Class* stmt, LoxClass* klass);
+    // Storage for a declaration: a captured local gets its cell up front, so
+    // closures created while its value is built can share it.
+    bool   declare(Stmt*, const Binding&);
+    void    define(const Binding&, const std::string& name, std::any value);
+
+    Property property(Instance*, const Token& name, InlineCache&);
+    void set_property(Instance*, const Token& name, InlineCache&, const std::any& value);
+    std::any bind(Instance*, Closure*, const Token& name);
+    // A variable of the module's global scope, for `module.name`.
+    std::any module_member(Module*, const Token& name);
+
+    // Checks the array and index at the bottom of the stack from `object` and
+    // returns the element's address, or nullptr after reporting an error.
+    double* element(size_t object, const Token& bracket);
+
+    // Where a resolved variable's value is stored, or nullptr for a name that
+    // is looked up in the environment chain.
+    inline std::any* slot(const Binding& binding) {
+        switch (binding.kind) {
+            case Binding::LOCAL:   return &stack_[base_ + binding.index];
+            case Binding::CELL:    return &std::any_cast<Cell*>(stack_[base_ + binding.index])->value_;
+            case Binding::UPVALUE: return &frames_.back().closure->cells_[binding.index]->value_;
+            default:               return nullptr;
+        }
+    }
+
+    // Where a variable that isn't in a slot is found by name, or nullptr when
+    // it isn't defined.
+    inline std::any* lookup(const Binding& binding, const Token& name) {
+        Environment* environment = environment_;
+        if (binding.kind == Binding::OUTER) {
+            while (environment->depth_ > binding.index) environment = environment->enclosing_;
+        }
+        return environment->get(name);
     }
 
-    std::string trimmed_double(double value) {
-        std::string vs = std::to_string(value);
-        vs.erase(vs.find_last_not_of('0') + 1, std::string::npos);
-        if (vs.back() == '.') vs.pop_back();
-        return vs;
+    template <typename Site>
+    inline InlineCache& cache(Site* site) { return caches_.empty() ? site->cache_ : caches_[site->site_]; }
+
+    void mark_roots(Heap&);
+    void run_counted_loop(CountedLoop*);
+
+    bool check_number(const Token& op, const std::any& operand) {
+        if (IS_TYPE(operand, double)) return true;
+        fail(op, "Operand must be a number.");
+        return false;
     }
 
-    std::string stringify(std::any value) {
-        if (IS_TYPE(value, std::nullptr_t)) return "nil";
-        if (IS_TYPE(value, std::string)) return std::any_cast<std::string>(value);
-        if (IS_TYPE(value, double)) return trimmed_double(std::any_cast<double>(value));
-        if (IS_TYPE(value, bool)) return std::any_cast<bool>(value) ? "true" : "false";
-        return "?";
+    bool check_numbers(const Token& op, const std::any& left, const std::any& right) {
+        if (IS_TYPE(left, double) && IS_TYPE(right, double)) return true;
+        fail(op, "Operands must be numbers.");
+        return false;
     }
 };
-} // namespace lox
\ No newline at end of file
+} // namespace lox
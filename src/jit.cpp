@@ -0,0 +1,460 @@
+#include "jit.hpp"
+#include "value.hpp"
+
+#include <cstring>
+#include <iostream>
+
+#if LOX_JIT_AVAILABLE
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace lox {
+#if LOX_JIT_AVAILABLE
+namespace {
+void print_number(double value, std::ostream* out) { print_value(*out, value); }
+void   print_bool(double value, std::ostream* out) { *out << (value != 0.0 ? "true" : "false") << std::endl; }
+bool       refuel(Fuel* fuel) { return fuel->refill(); }
+
+// Condition codes, as the low nibble of the Jcc/SETcc opcodes.
+enum Condition: uint8_t { CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_BE = 0x6, CC_A = 0x7, CC_NS = 0x9 };
+
+// Every value the compiled code handles is a double in xmm0; booleans are 0.0 or 1.0.
+enum Kind { NUMBER, BOOL };
+
+// Emits the loop as a function `void(double* frame)`. The frame pointer lives
+// in rbx and every variable and spilled temporary is a slot in that frame.
+class LoopCompiler {
+public:
+    LoopCompiler(std::ostream& out, Fuel* fuel): out_(out), fuel_(fuel) {}
+
+    bool compile(While* loop) {
+        code_.reserve(256);
+        // push rbp; mov rbp, rsp; push rbx; sub rsp, 8; mov rbx, rdi
+        emit({0x55, 0x48, 0x89, 0xE5, 0x53, 0x48, 0x83, 0xEC, 0x08, 0x48, 0x89, 0xFB});
+        while_stmt(loop);
+        for (size_t exit: out_of_fuel_) bind(exit);
+        // add rsp, 8; pop rbx; pop rbp; ret
+        emit({0x48, 0x83, 0xC4, 0x08, 0x5B, 0x5D, 0xC3});
+        return ok_;
+    }
+
+    std::vector<uint8_t> code_;
+    std::vector<std::pair<Token, int>> externals_;
+    int slots_{0};
+
+private:
+    bool ok_{true};
+    std::ostream& out_;
+    Fuel* fuel_;
+    // Jumps taken when the fuel runs out, all to the epilogue.
+    std::vector<size_t> out_of_fuel_;
+
+    std::vector<std::unordered_map<std::string, int>> scopes_;
+    std::vector<int> temps_;
+    int depth_{0};
+
+    inline void reject() { ok_ = false; }
+
+    void emit(std::initializer_list<uint8_t> bytes) { code_.insert(code_.end(), bytes.begin(), bytes.end()); }
+
+    void emit32(int32_t value) {
+        uint8_t bytes[4];
+        std::memcpy(bytes, &value, 4);
+        code_.insert(code_.end(), bytes, bytes + 4);
+    }
+
+    void emit64(uint64_t value) {
+        uint8_t bytes[8];
+        std::memcpy(bytes, &value, 8);
+        code_.insert(code_.end(), bytes, bytes + 8);
+    }
+
+    // movsd xmm<reg>, [rbx + 8 * slot]
+    void load(int reg, int slot) {
+        emit({0xF2, 0x0F, 0x10, uint8_t(0x83 | reg << 3)});
+        emit32(slot * 8);
+    }
+
+    // movsd [rbx + 8 * slot], xmm0
+    void store(int slot) {
+        emit({0xF2, 0x0F, 0x11, 0x83});
+        emit32(slot * 8);
+    }
+
+    // mov rax, imm64; movq xmm<reg>, rax
+    void load_constant(int reg, double value) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, 8);
+        emit({0x48, 0xB8});
+        emit64(bits);
+        emit({0x66, 0x48, 0x0F, 0x6E, uint8_t(0xC0 | reg << 3)});
+    }
+
+    // Calls a print helper with the value in xmm0 and the stream in rdi.
+    void print(void (*helper)(double, std::ostream*)) {
+        // mov rdi, imm64; mov rax, imm64; call rax
+        emit({0x48, 0xBF});
+        emit64(reinterpret_cast<uint64_t>(&out_));
+        emit({0x48, 0xB8});
+        emit64(reinterpret_cast<uint64_t>(helper));
+        emit({0xFF, 0xD0});
+    }
+
+    // Emits a jump with a zero displacement and returns where to patch it.
+    size_t jump() {
+        emit({0xE9});
+        emit32(0);
+        return code_.size();
+    }
+
+    size_t jump(Condition cc) {
+        emit({0x0F, uint8_t(0x80 | cc)});
+        emit32(0);
+        return code_.size();
+    }
+
+    void bind(size_t patch) {
+        int32_t offset = code_.size() - patch;
+        std::memcpy(&code_[patch - 4], &offset, 4);
+    }
+
+    void jump_back(size_t target) {
+        emit({0xE9});
+        emit32(int32_t(target) - int32_t(code_.size() + 4));
+    }
+
+    // Takes a step of fuel in place. Every slot is in the frame at a
+    // back-edge, so the refill call has no registers to save.
+    void take_step() {
+        // mov rax, imm64; dec qword [rax]
+        emit({0x48, 0xB8});
+        emit64(reinterpret_cast<uint64_t>(&fuel_->countdown_));
+        emit({0x48, 0xFF, 0x08});
+        size_t enough = jump(CC_NS);
+
+        // mov rdi, imm64; mov rax, imm64; call rax; test al, al
+        emit({0x48, 0xBF});
+        emit64(reinterpret_cast<uint64_t>(fuel_));
+        emit({0x48, 0xB8});
+        emit64(reinterpret_cast<uint64_t>(&refuel));
+        emit({0xFF, 0xD0, 0x84, 0xC0});
+        out_of_fuel_.push_back(jump(CC_E));
+        bind(enough);
+    }
+
+    int temp() {
+        if (depth_ == temps_.size()) temps_.push_back(slots_++);
+        return temps_[depth_];
+    }
+
+    int resolve(const Token& name) {
+        for (auto scope = scopes_.rbegin(); scope != scopes_.rend(); scope++) {
+            auto it = scope->find(name.lexeme);
+            if (it != scope->end()) return it->second;
+        }
+        for (const auto& [token, slot]: externals_) if (token.lexeme == name.lexeme) return slot;
+
+        externals_.emplace_back(name, slots_);
+        return slots_++;
+    }
+
+    static bool is_comparison(TokenType type) {
+        return type == GREATER || type == GREATER_EQUAL || type == LESS || type == LESS_EQUAL;
+    }
+
+    // Leaves the left operand in xmm0 and the right one in xmm1. Operands that
+    // are a literal or a variable load straight into xmm1 without a spill.
+    void operands(Binary* expr, Kind& left, Kind& right) {
+        left = expression(expr->left_);
+
+        if (auto literal = dynamic_cast<Literal*>(expr->right_); literal && IS_TYPE(literal->value_, double)) {
+            load_constant(1, std::any_cast<double>(literal->value_));
+            right = NUMBER;
+            return;
+        }
+        if (auto variable = dynamic_cast<Variable*>(expr->right_); variable && variable->binding_.kind == Binding::DYNAMIC) {
+            load(1, resolve(variable->name_));
+            right = NUMBER;
+            return;
+        }
+
+        int spill = temp();
+        store(spill);
+        depth_++;
+        right = expression(expr->right_);
+        depth_--;
+        emit({0x66, 0x0F, 0x28, 0xC8}); // movapd xmm1, xmm0
+        load(0, spill);
+    }
+
+    void compare(TokenType type) {
+        if (type == GREATER || type == GREATER_EQUAL) emit({0x66, 0x0F, 0x2E, 0xC1}); // ucomisd xmm0, xmm1
+        else                                          emit({0x66, 0x0F, 0x2E, 0xC8}); // ucomisd xmm1, xmm0
+    }
+
+    // movzx eax, al; cvtsi2sd xmm0, eax
+    void bool_from_al() { emit({0x0F, 0xB6, 0xC0, 0xF2, 0x0F, 0x2A, 0xC0}); }
+
+    Kind binary(Binary* expr) {
+        // Compiling recurses along the chain.
+        if (expr->chain_ > MAX_RECURSIVE_CHAIN) {
+            reject();
+            return NUMBER;
+        }
+        Kind left, right;
+        operands(expr, left, right);
+
+        TokenType type = expr->op_.type;
+        if (type == EQUAL_EQUAL || type == BANG_EQUAL) {
+            bool equal = type == EQUAL_EQUAL;
+            if (left != right) {
+                load_constant(0, equal ? 0.0 : 1.0);
+                return BOOL;
+            }
+            emit({0x66, 0x0F, 0x2E, 0xC1}); // ucomisd xmm0, xmm1
+            if (equal) emit({0x0F, 0x94, 0xC0, 0x0F, 0x9B, 0xC1, 0x20, 0xC8}); // sete al; setnp cl; and al, cl
+            else       emit({0x0F, 0x95, 0xC0, 0x0F, 0x9A, 0xC1, 0x08, 0xC8}); // setne al; setp cl; or al, cl
+            bool_from_al();
+            return BOOL;
+        }
+
+        if (left != NUMBER || right != NUMBER) {
+            reject();
+            return NUMBER;
+        }
+
+        switch (type) {
+            case PLUS:  emit({0xF2, 0x0F, 0x58, 0xC1}); return NUMBER; // addsd xmm0, xmm1
+            case MINUS: emit({0xF2, 0x0F, 0x5C, 0xC1}); return NUMBER; // subsd xmm0, xmm1
+            case STAR:  emit({0xF2, 0x0F, 0x59, 0xC1}); return NUMBER; // mulsd xmm0, xmm1
+            case SLASH: emit({0xF2, 0x0F, 0x5E, 0xC1}); return NUMBER; // divsd xmm0, xmm1
+            default: break;
+        }
+
+        compare(type);
+        bool strict = type == GREATER || type == LESS;
+        emit({0x0F, uint8_t(0x90 | (strict ? CC_A : CC_AE)), 0xC0}); // seta/setae al
+        bool_from_al();
+        return BOOL;
+    }
+
+    Kind logical(Logical* expr) {
+        if (expr->chain_ > MAX_RECURSIVE_CHAIN) {
+            reject();
+            return NUMBER;
+        }
+        Kind left = expression(expr->left_);
+
+        if (left == NUMBER) {
+            // Numbers are always truthy: `or` yields the left operand, `and` the right one.
+            if (expr->op_.type == OR) return NUMBER;
+            return expression(expr->right_);
+        }
+
+        emit({0x66, 0x0F, 0x57, 0xC9, 0x66, 0x0F, 0x2E, 0xC1}); // xorpd xmm1, xmm1; ucomisd xmm0, xmm1
+        size_t done = jump(expr->op_.type == OR ? CC_NE : CC_E);
+        if (expression(expr->right_) != BOOL) reject();
+        bind(done);
+        return BOOL;
+    }
+
+    Kind unary(Unary* expr) {
+        Kind right = expression(expr->right_);
+
+        if (expr->op_.type == MINUS) {
+            if (right != NUMBER) reject();
+            load_constant(1, -0.0);
+            emit({0x66, 0x0F, 0x57, 0xC1}); // xorpd xmm0, xmm1
+            return NUMBER;
+        }
+
+        if (right == NUMBER) {
+            load_constant(0, 0.0);
+            return BOOL;
+        }
+        load_constant(1, 1.0);
+        emit({0xF2, 0x0F, 0x5C, 0xC8, 0x66, 0x0F, 0x28, 0xC1}); // subsd xmm1, xmm0; movapd xmm0, xmm1
+        return BOOL;
+    }
+
+    Kind expression(Expr* expr) {
+        if (auto binary   = dynamic_cast<Binary*  >(expr)) return this->binary(binary);
+        if (auto logical  = dynamic_cast<Logical* >(expr)) return this->logical(logical);
+        if (auto unary    = dynamic_cast<Unary*   >(expr)) return this->unary(unary);
+        if (auto grouping = dynamic_cast<Grouping*>(expr)) return expression(grouping->expr_);
+
+        // Variables the resolver bound to a call frame are not in any
+        // environment, so loops that use them stay interpreted.
+        if (auto variable = dynamic_cast<Variable*>(expr)) {
+            if (variable->binding_.kind != Binding::DYNAMIC) reject();
+            load(0, resolve(variable->name_));
+            return NUMBER;
+        }
+
+        if (auto assign = dynamic_cast<Assign*>(expr)) {
+            if (assign->binding_.kind != Binding::DYNAMIC) reject();
+            // Frame slots only ever hold numbers, which is what the entry guard relies on.
+            if (expression(assign->value_) != NUMBER) reject();
+            store(resolve(assign->name_));
+            return NUMBER;
+        }
+
+        auto literal = dynamic_cast<Literal*>(expr);
+        if (!literal) {
+            reject();
+            return NUMBER;
+        }
+        if (IS_TYPE(literal->value_, double)) {
+            load_constant(0, std::any_cast<double>(literal->value_));
+            return NUMBER;
+        }
+        if (IS_TYPE(literal->value_, bool)) {
+            load_constant(0, std::any_cast<bool>(literal->value_) ? 1.0 : 0.0);
+            return BOOL;
+        }
+
+        reject();
+        return NUMBER;
+    }
+
+    // Returns the patch site of the jump taken when `condition` is falsey, or
+    // zero when the condition is a number and therefore always truthy.
+    size_t branch_if_false(Expr* condition) {
+        while (auto grouping = dynamic_cast<Grouping*>(condition)) condition = grouping->expr_;
+
+        if (auto binary = dynamic_cast<Binary*>(condition); binary && is_comparison(binary->op_.type)) {
+            Kind left, right;
+            operands(binary, left, right);
+            if (left != NUMBER || right != NUMBER) reject();
+
+            compare(binary->op_.type);
+            bool strict = binary->op_.type == GREATER || binary->op_.type == LESS;
+            return jump(strict ? CC_BE : CC_B);
+        }
+
+        if (expression(condition) == NUMBER) return 0;
+
+        emit({0x66, 0x0F, 0x57, 0xC9, 0x66, 0x0F, 0x2E, 0xC1}); // xorpd xmm1, xmm1; ucomisd xmm0, xmm1
+        return jump(CC_E);
+    }
+
+    void while_stmt(While* stmt) {
+        size_t head = code_.size();
+        size_t exit = branch_if_false(stmt->condition_);
+        statement(stmt->body_);
+        if (fuel_) take_step();
+        jump_back(head);
+        if (exit) bind(exit);
+    }
+
+    void statement(Stmt* stmt) {
+        if (!ok_) return;
+
+        if (auto expression = dynamic_cast<Expression*>(stmt)) {
+            this->expression(expression->expr_);
+            return;
+        }
+
+        if (auto print = dynamic_cast<Print*>(stmt)) {
+            this->print(expression(print->expr_) == NUMBER ? print_number : print_bool);
+            return;
+        }
+
+        if (auto var = dynamic_cast<Var*>(stmt)) {
+            if (!var->initializer_ || expression(var->initializer_) != NUMBER) return reject();
+            auto [it, inserted] = scopes_.back().try_emplace(var->name_.lexeme, slots_);
+            if (inserted) slots_++;
+            store(it->second);
+            return;
+        }
+
+        if (auto block = dynamic_cast<Block*>(stmt)) {
+            if (block->tokens_) return reject();
+            scopes_.emplace_back();
+            for (auto inner: block->statements_) statement(inner);
+            scopes_.pop_back();
+            return;
+        }
+
+        if (auto if_stmt = dynamic_cast<If*>(stmt)) {
+            size_t otherwise = branch_if_false(if_stmt->condition_);
+            statement(if_stmt->then_branch_);
+            if (!if_stmt->else_branch_) {
+                if (otherwise) bind(otherwise);
+                return;
+            }
+
+            size_t done = jump();
+            if (otherwise) bind(otherwise);
+            statement(if_stmt->else_branch_);
+            bind(done);
+            return;
+        }
+
+        if (auto loop = dynamic_cast<While*>(stmt)) return while_stmt(loop);
+        reject();
+    }
+};
+} // namespace
+
+Jit::~Jit() {
+    for (auto& [loop, compiled]: loops_) if (compiled) munmap((void*)compiled->code, compiled->size);
+}
+
+std::unique_ptr<Jit::CompiledLoop> Jit::compile(While* loop) {
+    alloc::PhaseScope phase(alloc::OTHER);
+
+    LoopCompiler compiler(out_, fuel_);
+    if (!compiler.compile(loop)) return nullptr;
+
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t size = (compiler.code_.size() + page - 1) / page * page;
+
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) return nullptr;
+
+    std::memcpy(memory, compiler.code_.data(), compiler.code_.size());
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, size);
+        return nullptr;
+    }
+
+    auto compiled = std::make_unique<CompiledLoop>();
+    compiled->code = reinterpret_cast<CompiledLoop::Entry>(memory);
+    compiled->size = size;
+    compiled->externals = std::move(compiler.externals_);
+    compiled->values.resize(compiled->externals.size());
+    compiled->frame.resize(compiler.slots_);
+    return compiled;
+}
+
+bool Jit::run(While* loop, Environment* environment) {
+    auto it = loops_.find(loop);
+    if (it == loops_.end()) it = loops_.emplace(loop, compile(loop)).first;
+
+    CompiledLoop* compiled = it->second.get();
+    if (!compiled) return false;
+
+    auto& values = compiled->values;
+    for (size_t i = 0; i < values.size(); i++) {
+        const auto& [name, slot] = compiled->externals[i];
+        values[i] = environment->get(name);
+        if (!values[i] || !(IS_TYPE((*values[i]), double))) return false;
+
+        compiled->frame[slot] = std::any_cast<double>(*values[i]);
+    }
+
+    compiled->code(compiled->frame.data());
+
+    for (size_t i = 0; i < values.size(); i++) *values[i] = compiled->frame[compiled->externals[i].second];
+    return true;
+}
+#else
+Jit::~Jit() {}
+
+std::unique_ptr<Jit::CompiledLoop> Jit::compile(While*) { return nullptr; }
+
+bool Jit::run(While*, Environment*) { return false; }
+#endif
+} // namespace lox
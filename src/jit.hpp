@@ -0,0 +1,64 @@
+#pragma once
+
+#include "ast/statements.hpp"
+#include "environment.hpp"
+#include "fuel.hpp"
+
+#include <memory>
+#include <unordered_map>
+
+// The baseline JIT emits x86-64 SSE2 code and needs mmap/mprotect.
+#if defined(__x86_64__) && defined(__linux__)
+#define LOX_JIT_AVAILABLE 1
+#else
+#define LOX_JIT_AVAILABLE 0
+#endif
+
+namespace lox {
+// Compiles hot `While` loops whose condition and body only do numeric work on
+// variables into native code. Variables are unboxed into a frame of doubles on
+// entry and boxed back on exit; if any of them is not a number when the loop
+// is entered the guard fails and the interpreter keeps running the loop.
+//
+// Given fuel, every back-edge takes a step from it, and a loop that runs out
+// returns early with the fuel exhausted.
+class Jit {
+public:
+    Jit(int threshold, std::ostream& out, Fuel* fuel = nullptr): threshold_(threshold), out_(out), fuel_(fuel) {}
+    ~Jit();
+
+    inline int threshold() const { return threshold_; }
+
+    inline bool is_compiled(While* loop) const {
+        auto it = loops_.find(loop);
+        return it != loops_.end() && it->second;
+    }
+
+    // Runs the remaining iterations of `loop` natively. Returns false, without
+    // side effects, when the loop cannot be compiled or a type guard fails.
+    bool run(While* loop, Environment* environment);
+
+private:
+    struct CompiledLoop {
+        using Entry = void (*)(double*);
+
+        Entry  code;
+        size_t size;
+
+        // Variables defined outside the loop, by frame slot.
+        std::vector<std::pair<Token, int>> externals;
+        std::vector<std::any*> values;
+        std::vector<double> frame;
+    };
+
+    int threshold_;
+    // Where compiled `print` statements write.
+    std::ostream& out_;
+    Fuel* fuel_;
+
+    // A null entry marks a loop the compiler rejected, so it is not retried.
+    std::unordered_map<While*, std::unique_ptr<CompiledLoop>> loops_;
+
+    std::unique_ptr<CompiledLoop> compile(While*);
+};
+} // namespace lox
@@ -0,0 +1,66 @@
+#include "lines.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#include <unistd.h>
+
+namespace lox {
+bool LineReader::next(std::string_view& line) {
+    while (true) {
+        const char* start = buffer_.data() + begin_;
+        if (auto newline = static_cast<const char*>(std::memchr(start, '\n', end_ - begin_))) {
+            line = std::string_view(start, newline - start);
+            begin_ += line.size() + 1;
+            return true;
+        }
+
+        if (eof_) {
+            if (begin_ == end_) return false;
+            line = std::string_view(start, end_ - begin_);
+            begin_ = end_;
+            return true;
+        }
+        fill();
+    }
+}
+
+void LineReader::fill() {
+    std::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+    end_ -= begin_;
+    begin_ = 0;
+    if (end_ == buffer_.size()) buffer_.resize(buffer_.size() * 2);
+
+    ssize_t count;
+    do count = ::read(fd_, buffer_.data() + end_, buffer_.size() - end_);
+    while (count < 0 && errno == EINTR);
+
+    if (count > 0) end_ += count;
+    else {
+        eof_ = true;
+        failed_ = count < 0;
+    }
+}
+
+BlockWriter::BlockWriter(int fd, size_t block): fd_(fd), buffer_(block) {
+    setp(buffer_.data(), buffer_.data() + buffer_.size());
+}
+
+bool BlockWriter::drain() {
+    for (const char* data = pbase(); data < pptr() && !failed_;) {
+        ssize_t count = ::write(fd_, data, pptr() - data);
+        if (count >= 0) data += count;
+        else if (errno != EINTR) failed_ = true;
+    }
+    setp(buffer_.data(), buffer_.data() + buffer_.size());
+    return !failed_;
+}
+
+BlockWriter::int_type BlockWriter::overflow(int_type c) {
+    if (!drain()) return traits_type::eof();
+    if (traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+    return c;
+}
+} // namespace lox
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <streambuf>
+#include <string_view>
+#include <vector>
+
+// Block-buffered input and output for `run --each-line`, which runs a
+// program once per line of a large input.
+namespace lox {
+// Reads a file descriptor in large blocks and splits them into lines with
+// memchr. A line is a view into the block, valid until the next call; a line
+// longer than the block grows it.
+class LineReader {
+public:
+    explicit LineReader(int fd, size_t block = size_t(1) << 20): fd_(fd), buffer_(block) {}
+
+    // The next line without its newline, or false at the end of the input. A
+    // last line without a newline still counts.
+    bool next(std::string_view& line);
+
+    inline bool failed() const { return failed_; }
+
+private:
+    int fd_;
+    std::vector<char> buffer_;
+    // The unread part of the buffer.
+    size_t begin_{0};
+    size_t end_{0};
+    bool eof_{false};
+    bool failed_{false};
+
+    // Moves what is unread to the front and reads after it.
+    void fill();
+};
+
+// Writes to a file descriptor a block at a time. Flushing, which `print`
+// does after every line, writes nothing: the buffer goes out when it fills
+// up and on `drain`.
+class BlockWriter: public std::streambuf {
+public:
+    explicit BlockWriter(int fd, size_t block = size_t(1) << 16);
+    ~BlockWriter() override { drain(); }
+
+    // Writes out what is buffered; false if writing failed.
+    bool drain();
+
+protected:
+    int_type overflow(int_type c) override;
+    int sync() override { return 0; }
+
+private:
+    int fd_;
+    std::vector<char> buffer_;
+    bool failed_{false};
+};
+} // namespace lox
@@ -0,0 +1,185 @@
+#include "loader.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+
+namespace lox {
+namespace fs = std::filesystem;
+
+namespace {
+std::string normalize(const fs::path& path) {
+    std::error_code error;
+    fs::path canonical = fs::weakly_canonical(path, error);
+    return error ? fs::absolute(path).lexically_normal().string() : canonical.string();
+}
+} // namespace
+
+ModuleGraph ModuleLoader::load(const std::string& entry) {
+    ModuleGraph graph;
+    graph.entry = module(normalize(entry));
+    if (!graph.entry) return graph;
+    graph.modules.emplace(graph.entry->path, graph.entry);
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::string> queue;
+    // Modules being loaded. The load is over once none are and nothing is
+    // queued.
+    size_t busy = 0;
+
+    // Queues the imports not seen yet; with `mutex` held. Each path gets its
+    // entry right away, so two modules importing it only queue it once.
+    auto follow = [&](const ParsedModule& module) {
+        for (auto import: module.imports) {
+            if (graph.modules.try_emplace(import->file_).second) queue.push_back(import->file_);
+        }
+    };
+
+    auto work = [&]() {
+        std::unique_lock lock(mutex);
+        while (true) {
+            changed.wait(lock, [&]() { return !queue.empty() || busy == 0; });
+            if (queue.empty()) return;
+
+            std::string path = std::move(queue.front());
+            queue.pop_front();
+            busy++;
+            lock.unlock();
+            auto loaded = module(path);
+            lock.lock();
+            busy--;
+
+            graph.modules[path] = loaded;
+            if (loaded) follow(*loaded);
+            changed.notify_all();
+        }
+    };
+
+    follow(*graph.entry);
+    std::vector<std::thread> threads;
+    if (!queue.empty()) {
+        for (size_t i = 1; i < options_.threads; i++) threads.emplace_back(work);
+    }
+    work();
+    for (auto& thread: threads) thread.join();
+
+    {
+        std::lock_guard lock(mutex_);
+        graph.sites = sites_;
+    }
+    report(graph);
+    return graph;
+}
+
+std::shared_ptr<const ParsedModule> ModuleLoader::module(const std::string& path) {
+    std::error_code error;
+    auto modified = fs::last_write_time(path, error);
+    uintmax_t size = error ? 0 : fs::file_size(path, error);
+    if (error) return nullptr;
+
+    {
+        std::lock_guard lock(mutex_);
+        auto cached = cache_.find(path);
+        if (cached != cache_.end() && cached->second->modified == modified && cached->second->size == size) return cached->second;
+    }
+
+    std::shared_ptr<ParsedModule> parsed = parse(path, modified, size);
+    if (!parsed) return nullptr;
+
+    // A module that failed to parse is parsed again next time, so its errors
+    // are reported again.
+    std::lock_guard lock(mutex_);
+    if (parsed->errors.empty()) cache_[path] = parsed;
+    return parsed;
+}
+
+std::shared_ptr<ParsedModule> ModuleLoader::parse(const std::string& path, fs::file_time_type modified, uintmax_t size) {
+    std::ifstream file(path);
+    if (!file.is_open()) return nullptr;
+    std::stringstream source;
+    source << file.rdbuf();
+
+    auto parsed = std::make_shared<ParsedModule>();
+    parsed->path = path;
+    parsed->modified = modified;
+    parsed->size = size;
+
+    // The scanner and parser report through this thread's error channel.
+    std::ostringstream errors;
+    std::ostream* output = std::exchange(err::output, &errors);
+    bool had_error = std::exchange(err::had_error, false);
+
+    parsed->tokens = Scanner(source.str()).scan_tokens();
+    uint32_t sites = 0;
+    if (!err::had_error) {
+        Parser parser(parsed->tokens, options_.lazy, &parsed->nodes, options_.max_nesting);
+        parsed->statements = parser.parse();
+        sites = parser.sites();
+    }
+
+    err::output = output;
+    err::had_error = had_error;
+    parsed->errors = errors.str();
+    if (!parsed->errors.empty()) return parsed;
+
+    // Sites are numbered from zero in each module; move them past the ones
+    // of the modules parsed before, so that modules loaded together can keep
+    // their caches in one table.
+    uint32_t base;
+    {
+        std::lock_guard lock(mutex_);
+        base = sites_;
+        sites_ += sites;
+    }
+    if (base) {
+        for (const auto& expr: parsed->nodes.exprs) {
+            if      (auto get = dynamic_cast<Get*>(expr.get())) get->site_ += base;
+            else if (auto set = dynamic_cast<Set*>(expr.get())) set->site_ += base;
+        }
+    }
+
+    fs::path directory = fs::path(path).parent_path();
+    for (auto stmt: parsed->statements) {
+        auto import = dynamic_cast<Import*>(stmt);
+        if (!import) continue;
+        import->file_ = normalize(directory / std::any_cast<std::string>(import->path_.literal));
+        parsed->imports.push_back(import);
+    }
+    return parsed;
+}
+
+void ModuleLoader::report(const ModuleGraph& graph) const {
+    // Depth first in import order, which the threads did not keep.
+    std::vector<const ParsedModule*> pending{graph.entry.get()};
+    std::unordered_set<const ParsedModule*> seen{graph.entry.get()};
+    while (!pending.empty()) {
+        const ParsedModule* module = pending.back();
+        pending.pop_back();
+
+        std::ostringstream errors;
+        errors << module->errors;
+        std::ostream* output = std::exchange(err::output, &errors);
+        for (auto import: module->imports) {
+            if (!graph.find(import->file_)) err::error(import->path_, "Can't read module.");
+        }
+        err::output = output;
+
+        std::istringstream lines(errors.str());
+        std::string prefix = module == graph.entry.get() ? "" : fs::proximate(module->path).string() + ": ";
+        for (std::string line; std::getline(lines, line);) {
+            *err::output << prefix << line << std::endl;
+            err::had_error = true;
+        }
+
+        for (auto import = module->imports.rbegin(); import != module->imports.rend(); ++import) {
+            const ParsedModule* next = graph.find((*import)->file_);
+            if (next && seen.insert(next).second) pending.push_back(next);
+        }
+    }
+}
+} // namespace lox
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "parser.hpp"
+
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Loading for programs split across files with `import "path";`. Starting
+// from the entry file, the loader follows imports and scans, parses and
+// resolves every module it finds on a pool of threads; the interpreter then
+// runs each one the first time it is imported.
+//
+// Parsed modules are kept for the life of the loader and reused by later
+// loads while their file's modification time and size are unchanged, so a
+// library shared by many programs is parsed once per process.
+namespace lox {
+struct ParsedModule {
+    // Absolute and normalized; modules are known by it.
+    std::string path;
+    // Lazily parsed blocks point into the tokens, so a module is never moved.
+    TokenStream tokens;
+    Nodes nodes;
+    std::vector<Stmt*> statements;
+    // The module's top-level imports, with their `file_` filled in.
+    std::vector<Import*> imports;
+    // Syntax errors as the parser reported them; empty when it parsed.
+    std::string errors;
+
+    std::filesystem::file_time_type modified;
+    uintmax_t size{0};
+};
+
+// What one load found: the entry file and every module it imports, directly
+// or not.
+struct ModuleGraph {
+    std::shared_ptr<const ParsedModule> entry;
+    std::unordered_map<std::string, std::shared_ptr<const ParsedModule>> modules;
+    // Inline cache sites numbered so far by the loader, which numbers the
+    // sites of all its modules apart; see Interpreter::isolate_caches.
+    uint32_t sites{0};
+
+    // The module at `path`, or nullptr when it could not be read.
+    const ParsedModule* find(const std::string& path) const {
+        auto it = modules.find(path);
+        return it == modules.end() ? nullptr : it->second.get();
+    }
+};
+
+struct LoaderOptions {
+    // Threads that scan and parse, the calling one included.
+    size_t threads{1};
+    // Parse lazily; see Parser.
+    bool lazy{false};
+    int max_nesting{Parser::MAX_NESTING};
+};
+
+class ModuleLoader {
+public:
+    explicit ModuleLoader(LoaderOptions options = {}): options_(options) {}
+
+    // Loads `entry` and the modules it imports. Syntax errors, and imports of
+    // files that can't be read, are reported through err:: once everything
+    // is loaded, in import order and prefixed with the file of any module
+    // other than the entry. The entry is null when its file can't be read.
+    ModuleGraph load(const std::string& entry);
+
+private:
+    LoaderOptions options_;
+
+    // Guards the cache and the site count, which threads of a load share.
+    std::mutex mutex_;
+    std::unordered_map<std::string, std::shared_ptr<const ParsedModule>> cache_;
+    uint32_t sites_{0};
+
+    // The cached module when its file is unchanged, a freshly parsed one
+    // otherwise, or nullptr when the file can't be read.
+    std::shared_ptr<const ParsedModule> module(const std::string& path);
+    std::shared_ptr<ParsedModule> parse(const std::string& path, std::filesystem::file_time_type modified, uintmax_t size);
+
+    void report(const ModuleGraph&) const;
+};
+} // namespace lox
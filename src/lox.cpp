@@ -0,0 +1,122 @@
+#include "lox.hpp"
+#include "interpreter.hpp"
+#include "parser.hpp"
+#include "loader.hpp"
+
+#include <algorithm>
+#include <sstream>
+#include <thread>
+#include <utility>
+
+namespace lox {
+struct Program::Compiled {
+    Nodes nodes;
+    std::vector<Stmt*> statements;
+    uint32_t sites{0};
+    std::vector<std::string> errors;
+    // What `compile_file` loaded, which owns the statements.
+    ModuleGraph modules;
+};
+
+namespace {
+// Hands what the interpreter streams to a sink; `print` flushes once a line.
+class SinkBuffer: public std::streambuf {
+public:
+    explicit SinkBuffer(OutputSink& sink): sink_(sink) { setp(buffer_, buffer_ + sizeof(buffer_)); }
+
+protected:
+    int_type overflow(int_type c) override {
+        sync();
+        if (traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+        return c;
+    }
+
+    int sync() override {
+        if (pptr() > pbase()) sink_.write(std::string_view(pbase(), pptr() - pbase()));
+        setp(buffer_, buffer_ + sizeof(buffer_));
+        return 0;
+    }
+
+private:
+    OutputSink& sink_;
+    char buffer_[1024];
+};
+} // namespace
+
+const std::vector<std::string>& Program::errors() const { return compiled_->errors; }
+
+Program compile(std::string_view source) {
+    auto compiled = std::make_shared<Program::Compiled>();
+
+    // The scanner and parser report through this thread's error channel.
+    std::ostringstream errors;
+    std::ostream* output = std::exchange(err::output, &errors);
+    bool had_error = std::exchange(err::had_error, false);
+
+    TokenStream tokens = Scanner(std::string(source)).scan_tokens();
+    if (!err::had_error) {
+        Parser parser(tokens, false, &compiled->nodes);
+        compiled->statements = parser.parse();
+        compiled->sites = parser.sites();
+    }
+
+    err::output = output;
+    err::had_error = had_error;
+
+    std::istringstream lines(errors.str());
+    for (std::string line; std::getline(lines, line);) compiled->errors.push_back(std::move(line));
+    return Program(std::move(compiled));
+}
+
+Program compile_file(const std::string& path) {
+    static ModuleLoader loader({.threads = std::max(1u, std::thread::hardware_concurrency())});
+    auto compiled = std::make_shared<Program::Compiled>();
+
+    std::ostringstream errors;
+    std::ostream* output = std::exchange(err::output, &errors);
+    bool had_error = std::exchange(err::had_error, false);
+
+    compiled->modules = loader.load(path);
+    if (!compiled->modules.entry) *err::output << "Error reading file: " << path << std::endl;
+    else {
+        compiled->statements = compiled->modules.entry->statements;
+        compiled->sites = compiled->modules.sites;
+    }
+
+    err::output = output;
+    err::had_error = had_error;
+
+    std::istringstream lines(errors.str());
+    for (std::string line; std::getline(lines, line);) compiled->errors.push_back(std::move(line));
+    return Program(std::move(compiled));
+}
+
+bool Runtime::run(const Program& program, OutputSink& sink) const {
+    for (const auto& error: program.errors()) sink.error(error + "\n");
+    if (!program.ok()) return false;
+
+    SinkBuffer buffer(sink);
+    std::ostream out(&buffer);
+
+    InterpreterOptions options;
+    options.jit = options.jit && options_.jit;
+    options.heap.limit = options_.heap_limit;
+    options.max_steps = options_.max_steps;
+    options.timeout_ms = options_.timeout_ms;
+    options.out = &out;
+    options.modules = &program.compiled_->modules;
+
+    Interpreter interpreter(options);
+    interpreter.isolate_caches(program.compiled_->sites);
+    interpreter.run(program.compiled_->statements);
+    out.flush();
+
+    if (!interpreter.error()) return true;
+    std::ostringstream error;
+    err::runtime_error(*interpreter.error(), error);
+    sink.error(error.str());
+    return false;
+}
+} // namespace lox
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// The embedding API. A script is compiled once into a Program, which is
+// immutable and cheap to copy; a Runtime then runs it as often as needed,
+// from any number of threads at once. Every run has its own heap, globals,
+// inline caches and output sink, so runs share nothing they write to.
+namespace lox {
+// Receives what one run writes.
+class OutputSink {
+public:
+    virtual ~OutputSink() = default;
+
+    // Output of `print` statements, newlines included.
+    virtual void write(std::string_view text) = 0;
+    // A compile or runtime error, formatted as the command line prints it.
+    virtual void error(std::string_view text) = 0;
+};
+
+class Program {
+public:
+    // One "[line N] Error..." line per compile error; empty when the script
+    // compiled.
+    const std::vector<std::string>& errors() const;
+    inline bool ok() const { return errors().empty(); }
+
+private:
+    struct Compiled;
+    std::shared_ptr<const Compiled> compiled_;
+
+    explicit Program(std::shared_ptr<const Compiled> compiled): compiled_(std::move(compiled)) {}
+
+    friend Program compile(std::string_view);
+    friend Program compile_file(const std::string&);
+    friend class Runtime;
+};
+
+// Scans, parses and resolves `source`, which can't import modules.
+Program compile(std::string_view source);
+// Compiles the script at `path` and the modules it imports, parsing them on
+// several threads. Modules are cached for the life of the process and only
+// parsed again once their file changes.
+Program compile_file(const std::string& path);
+
+struct RuntimeOptions {
+    // Zero means no limit.
+    size_t heap_limit{0};
+    uint64_t max_steps{0};
+    uint64_t timeout_ms{0};
+
+    bool jit{true};
+};
+
+class Runtime {
+public:
+    explicit Runtime(RuntimeOptions options = {}): options_(options) {}
+
+    // Runs `program` in a fresh interpreter. Returns false when it failed to
+    // compile or raised a runtime error; either way the error went to `sink`.
+    bool run(const Program& program, OutputSink& sink) const;
+
+private:
+    RuntimeOptions options_;
+};
+} // namespace lox
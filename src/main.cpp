@@ -1,19 +1,55 @@
+#include <charconv>
+#include <chrono>
 #include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <string>
 #include <iostream>
+#include <thread>
+
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include "printer.hpp"
 #include "parser.hpp"
+#include "loader.hpp"
 #include "interpreter.hpp"
-
-bool lox::err::had_error = false;
-bool lox::err::hadRuntimeError = false;
+#include "closure.hpp"
+#include "flat.hpp"
+#include "snapshot.hpp"
+#include "aot.hpp"
+#include "lines.hpp"
+#include "tasks.hpp"
+#include "allocation.hpp"
+#include "memprofile.hpp"
+#include "bench.hpp"
 
 void run(std::string);
 
 int repl();
 std::string read_file_contents(const std::string& filename);
+template <typename T> T flag_value(const std::string& flag, std::string_view text);
+lox::ModuleGraph load(lox::ModuleLoader&, const std::string& filename);
+int jit_diff(const std::vector<lox::Stmt*>&, lox::InterpreterOptions);
+int compile_test(const std::vector<std::string>& files);
+int each_line(const std::vector<lox::Stmt*>&, lox::InterpreterOptions, const std::string& snapshot);
+
+// What `--help` prints.
+const char* const help = R"(Usage: ./your_program <command> [options] <file>
+
+Commands:
+  tokenize, parse, evaluate   Print the tokens, the syntax tree or the value.
+  run                         Run a program.
+  bench                       Time repeated runs of a program.
+  compile                     Translate a program to C; --test checks it.
+  snapshot, memprofile        Save the globals after a run; profile memory.
+
+Engines, for run and bench (--engine=...):
+  tree      The interpreter; runs everything. The default.
+  closure   Arithmetic, variables, print, if and loops only: programs with
+            calls, functions, classes, arrays or imports are rejected.
+  flat      The same subset as closure.
+)";
 
 int main(int argc, char *argv[]) {
     // Disable output buffering
@@ -22,48 +58,112 @@ int main(int argc, char *argv[]) {
 
     if (argc == 1) return repl();
 
+    if (argc == 2 && (std::strcmp(argv[1], "--help") == 0 || std::strcmp(argv[1], "help") == 0)) {
+        std::cout << help;
+        return 0;
+    }
     if (argc < 3) {
-        std::cerr << "Usage: ./your_program <command> <filename>" << std::endl;
+        std::cerr << "Usage: ./your_program <command> <filename>; --help lists the commands." << std::endl;
         return 1;
     }
 
     const std::string command = argv[1];
 
+    std::string filename;
+    std::vector<std::string> files;
+    std::string engine = "tree";
+    bool diff_jit = false;
+    bool flat_ast = false;
+    bool gc_stats = false;
+    int iterations = 10;
+    int warmup = 2;
+    bool quiet = false;
+    bool test = false;
+    bool lines = false;
+    // Worker threads for --tasks; zero runs without the task scheduler.
+    size_t workers = 0;
+    std::string output;
+    std::string snapshot;
+    // Strict parsing reports every syntax error before anything runs; lazy
+    // parsing skims blocks outside functions until they first run.
+    std::string parsing = "strict";
+    int max_nesting = lox::Parser::MAX_NESTING;
+    // `run` and `bench` load imported modules on this many threads.
+    lox::LoaderOptions loading{.threads = std::max(1u, std::thread::hardware_concurrency())};
+    lox::InterpreterOptions options;
+    for (int i = 2; i < argc; i++) {
+        const std::string arg = argv[i];
+        if      (arg.starts_with("--engine=")) engine = arg.substr(9);
+        else if (arg == "--no-jit") options.jit = false;
+        else if (arg.starts_with("--jit-threshold=")) options.jit_threshold = flag_value<int>("--jit-threshold", arg.substr(16));
+        else if (arg == "--jit-diff") diff_jit = true;
+        else if (arg == "--flat") flat_ast = true;
+        else if (arg.starts_with("--heap-limit=")) options.heap.limit = flag_value<size_t>("--heap-limit", arg.substr(13));
+        else if (arg.starts_with("--max-steps=")) options.max_steps = flag_value<uint64_t>("--max-steps", arg.substr(12));
+        else if (arg.starts_with("--timeout-ms=")) options.timeout_ms = flag_value<uint64_t>("--timeout-ms", arg.substr(13));
+        else if (arg == "--gc-stats") gc_stats = true;
+        else if (arg.starts_with("--gc-threshold=")) options.heap.initial_threshold = flag_value<size_t>("--gc-threshold", arg.substr(15));
+        else if (arg == "--no-inline-caches") options.inline_caches = false;
+        else if (arg.starts_with("--iterations=")) iterations = flag_value<int>("--iterations", arg.substr(13));
+        else if (arg == "--iterations" && i + 1 < argc) iterations = flag_value<int>("--iterations", argv[++i]);
+        else if (arg.starts_with("--warmup=")) warmup = flag_value<int>("--warmup", arg.substr(9));
+        else if (arg == "--warmup" && i + 1 < argc) warmup = flag_value<int>("--warmup", argv[++i]);
+        else if (arg == "--quiet") quiet = true;
+        else if (arg.starts_with("--output=")) output = arg.substr(9);
+        else if (arg == "-o" && i + 1 < argc) output = argv[++i];
+        else if (arg == "--test") test = true;
+        else if (arg == "--each-line") lines = true;
+        else if (arg == "--tasks") workers = std::max(1u, std::thread::hardware_concurrency());
+        else if (arg.starts_with("--tasks=")) workers = std::max(1, flag_value<int>("--tasks", arg.substr(8)));
+        else if (arg.starts_with("--parse=")) parsing = arg.substr(8);
+        else if (arg.starts_with("--max-nesting=")) max_nesting = std::max(1, flag_value<int>("--max-nesting", arg.substr(14)));
+        else if (arg.starts_with("--load-threads=")) loading.threads = std::max(1, flag_value<int>("--load-threads", arg.substr(15)));
+        else if (arg.starts_with("--snapshot=")) snapshot = arg.substr(11);
+        else if (arg == "--snapshot" && i + 1 < argc) snapshot = argv[++i];
+        else files.push_back(filename = arg);
+    }
+    loading.max_nesting = max_nesting;
+
     if (command == "tokenize") {
-        std::string file_contents = read_file_contents(argv[2]);
+        std::string file_contents = read_file_contents(filename);
         
-        auto scanner = lox::Scanner(file_contents);
+        auto scanner = lox::Scanner(std::move(file_contents));
         auto tokens = scanner.scan_tokens();
 
-        for (lox::Token token: tokens) std::cout << token.to_string() << std::endl;
+        for (size_t i = 0; i < tokens.size(); i++) std::cout << tokens.to_string(i) << std::endl;
 
         if (lox::err::had_error) return 65;
 
     } else if (command == "parse") {
-        std::string file_contents = read_file_contents(argv[2]);
+        std::string file_contents = read_file_contents(filename);
 
-        auto scanner = lox::Scanner(file_contents);
+        auto scanner = lox::Scanner(std::move(file_contents));
         auto tokens = scanner.scan_tokens();
 
         if (lox::err::had_error) return 65;
 
-        auto parser = lox::Parser(tokens);
+        auto parser = lox::Parser(tokens, false, nullptr, max_nesting);
         auto statement = parser.parse(1);
 
         if (!statement) return 65;
-        
-        auto printer = lox::ASTPrinter();
-        std::cout << printer.print(statement) << std::endl;
+
+        if (flat_ast) {
+            lox::FlatAst ast(statement);
+            std::cout << lox::FlatPrinter(ast).print(ast.root()) << std::endl;
+        } else {
+            auto printer = lox::ASTPrinter();
+            std::cout << printer.print(statement) << std::endl;
+        }
 
     } else if (command == "evaluate") {
-        std::string file_contents = read_file_contents(argv[2]);
+        std::string file_contents = read_file_contents(filename);
 
-        auto scanner = lox::Scanner(file_contents);
+        auto scanner = lox::Scanner(std::move(file_contents));
         auto tokens = scanner.scan_tokens();
 
         if (lox::err::had_error) return 65;
 
-        auto parser = lox::Parser(tokens);
+        auto parser = lox::Parser(tokens, false, nullptr, max_nesting);
         auto statement = parser.parse(1);
 
         if (!statement) return 65;
@@ -71,25 +171,246 @@ int main(int argc, char *argv[]) {
         auto interpreter = lox::Interpreter();
         interpreter.interpret(statement);
 
-        if (lox::err::hadRuntimeError) return 70;
+        if (interpreter.had_runtime_error()) return 70;
 
     } else if (command == "run") {
-        std::string file_contents = read_file_contents(argv[2]);
+        if (parsing != "strict" && parsing != "lazy") {
+            std::cerr << "Unknown parsing mode: " << parsing << std::endl;
+            return 1;
+        }
+        if (parsing == "lazy" && (engine != "tree" || diff_jit)) {
+            std::cerr << "Lazy parsing needs the tree engine." << std::endl;
+            return 1;
+        }
+
+        loading.lazy = parsing == "lazy";
+        lox::ModuleLoader loader(loading);
+        lox::ModuleGraph graph = load(loader, filename);
+        const auto& statements = graph.entry->statements;
 
-        auto scanner = lox::Scanner(file_contents);
+        if (lox::err::had_error || statements.size() == 0) return 65;
+        options.modules = &graph;
+
+        if (diff_jit) return jit_diff(statements, options);
+
+        if (!snapshot.empty() && engine != "tree") {
+            std::cerr << "Snapshots need the tree engine." << std::endl;
+            return 1;
+        }
+        if ((options.max_steps || options.timeout_ms) && engine != "tree") {
+            std::cerr << "Execution limits need the tree engine." << std::endl;
+            return 1;
+        }
+        if (lines && engine != "tree") {
+            std::cerr << "Line mode needs the tree engine." << std::endl;
+            return 1;
+        }
+
+        if (workers && (engine != "tree" || lines || !snapshot.empty() || parsing == "lazy" || graph.modules.size() > 1)) {
+            std::cerr << "Tasks need the tree engine, without --each-line, --snapshot, lazy parsing or imports." << std::endl;
+            return 1;
+        }
+
+        if (lines) return each_line(statements, options, snapshot);
+
+        if (workers) {
+            lox::Scheduler scheduler(options, graph.sites, {.workers = workers});
+            scheduler.run(statements);
+            if (!scheduler.error()) return 0;
+            lox::err::runtime_error(*scheduler.error());
+            return 70;
+        }
+
+        if (engine == "closure") {
+            auto closure_engine = lox::ClosureEngine();
+            closure_engine.interpret(statements);
+
+            if (closure_engine.had_runtime_error()) return 70;
+        } else if (engine == "flat") {
+            lox::FlatAst ast(statements);
+            auto flat_interpreter = lox::FlatInterpreter();
+            flat_interpreter.interpret(ast);
+
+            if (flat_interpreter.had_runtime_error()) return 70;
+        } else if (engine == "tree") {
+            auto interpreter = lox::Interpreter(options);
+            if (!snapshot.empty()) {
+                std::string error = lox::snapshot::load(interpreter, snapshot);
+                if (!error.empty()) {
+                    std::cerr << error << std::endl;
+                    return 1;
+                }
+            }
+            interpreter.interpret(statements);
+
+            if (gc_stats) lox::print_heap_stats(interpreter.heap_stats());
+            if (lox::err::had_error) return 65;
+            if (interpreter.had_runtime_error()) return 70;
+        } else {
+            std::cerr << "Unknown engine: " << engine << std::endl;
+            return 1;
+        }
+
+    } else if (command == "snapshot") {
+        // Runs a prelude and saves the globals it leaves behind, for
+        // `run --snapshot` to start from.
+        std::string file_contents = read_file_contents(filename);
+
+        auto scanner = lox::Scanner(std::move(file_contents));
         auto tokens = scanner.scan_tokens();
 
         if (lox::err::had_error) return 65;
 
-        auto parser = lox::Parser(tokens);
+        auto parser = lox::Parser(tokens, false, nullptr, max_nesting);
         auto statements = parser.parse();
 
         if (lox::err::had_error || statements.size() == 0) return 65;
 
-        auto interpreter = lox::Interpreter();
+        auto interpreter = lox::Interpreter(options);
         interpreter.interpret(statements);
 
-        if (lox::err::hadRuntimeError) return 70;
+        if (interpreter.had_runtime_error()) return 70;
+
+        if (output.empty()) output = std::filesystem::path(filename).replace_extension(".snap").string();
+        std::string error = lox::snapshot::save(interpreter, output);
+        if (!error.empty()) {
+            std::cerr << error << std::endl;
+            return 70;
+        }
+
+    } else if (command == "compile") {
+        // Translates the program to C. With --test, translates, builds and
+        // runs each file given instead, comparing the result with `run`.
+        if (test) return compile_test(files);
+
+        std::string file_contents = read_file_contents(filename);
+
+        auto scanner = lox::Scanner(std::move(file_contents));
+        auto tokens = scanner.scan_tokens();
+
+        if (lox::err::had_error) return 65;
+
+        auto parser = lox::Parser(tokens, false, nullptr, max_nesting);
+        auto statements = parser.parse();
+
+        if (lox::err::had_error || statements.size() == 0) return 65;
+
+        std::string source;
+        std::string error = lox::aot::translate(statements, source);
+        if (!error.empty()) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+
+        if (output.empty()) output = std::filesystem::path(filename).replace_extension(".c").string();
+        std::ofstream file(output);
+        file << source;
+        if (!file.flush()) {
+            std::cerr << "Error writing file: " << output << std::endl;
+            return 1;
+        }
+
+    } else if (command == "bench") {
+        // Parses once, then times --warmup + --iterations runs of the program,
+        // each in a fresh interpreter, and reports the timed ones.
+        lox::ModuleLoader loader(loading);
+        lox::ModuleGraph graph = load(loader, filename);
+        const auto& statements = graph.entry->statements;
+
+        if (lox::err::had_error || statements.size() == 0) return 65;
+        options.modules = &graph;
+        if (engine != "tree" && engine != "closure" && engine != "flat") {
+            std::cerr << "Unknown engine: " << engine << std::endl;
+            return 1;
+        }
+
+        lox::NullBuffer discard;
+        auto* out = std::cout.rdbuf();
+        if (quiet) std::cout.rdbuf(&discard);
+
+        std::vector<double> samples;
+        bool failed = false;
+        for (int run = 0; run < warmup + iterations && !failed; run++) {
+            auto start = std::chrono::steady_clock::now();
+            if (engine == "closure") {
+                auto closure_engine = lox::ClosureEngine();
+                closure_engine.interpret(statements);
+                failed = closure_engine.had_runtime_error();
+            } else if (engine == "flat") {
+                lox::FlatAst ast(statements);
+                auto flat_interpreter = lox::FlatInterpreter();
+                flat_interpreter.interpret(ast);
+                failed = flat_interpreter.had_runtime_error();
+            } else {
+                auto interpreter = lox::Interpreter(options);
+                interpreter.interpret(statements);
+                failed = interpreter.had_runtime_error();
+            }
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+            if (run >= warmup) samples.push_back(elapsed.count());
+        }
+
+        std::cout.rdbuf(out);
+        if (failed) return 70;
+
+        std::cout << "bench: " << filename << " (" << engine << ", " << warmup << " warmup, "
+                  << iterations << " iterations)\n";
+        lox::summarize(samples).write(std::cout);
+
+    } else if (command == "memprofile") {
+#ifndef LOX_ALLOCATION_COUNTERS
+        std::cerr << "memprofile needs the interpreter-memprofile build, which counts allocations." << std::endl;
+        return 1;
+#else
+        lox::alloc::start_profiling();
+
+        std::string file_contents;
+        lox::TokenStream tokens;
+        std::vector<lox::Stmt*> statements;
+        {
+            lox::alloc::PhaseScope phase(lox::alloc::SOURCE);
+            file_contents = read_file_contents(filename);
+        }
+        {
+            lox::alloc::PhaseScope phase(lox::alloc::TOKENS);
+            auto scanner = lox::Scanner(std::move(file_contents));
+            tokens = scanner.scan_tokens();
+        }
+        if (lox::err::had_error) return 65;
+        {
+            lox::alloc::PhaseScope phase(lox::alloc::AST);
+            auto parser = lox::Parser(tokens, false, nullptr, max_nesting);
+            statements = parser.parse();
+        }
+        if (lox::err::had_error || statements.size() == 0) return 65;
+
+        lox::MemoryProfile profile;
+        profile.file = filename;
+
+        auto interpreter = lox::Interpreter(options);
+        auto record = [&](const lox::Object& object) {
+            if (auto environment = dynamic_cast<const lox::Environment*>(&object)) profile.scopes.record(*environment);
+        };
+        interpreter.heap().set_release_observer(record);
+        {
+            // Apart from environments, what the program allocates while
+            // running is the string payloads of its values.
+            lox::alloc::PhaseScope phase(lox::alloc::STRINGS);
+            interpreter.interpret(statements);
+        }
+        interpreter.heap().for_each(record);
+
+        lox::alloc::stop_profiling();
+        profile.allocations = lox::alloc::profile();
+        profile.read_rss();
+
+        profile.write_summary(std::cerr);
+        std::ofstream json(output.empty() ? "memprofile.json" : output);
+        profile.write_json(json);
+
+        if (interpreter.had_runtime_error()) return 70;
+#endif
 
     } else {
         std::cerr << "Unknown command: " << command << std::endl;
@@ -116,6 +437,18 @@ int repl() {
     return 0;
 }
 
+// The number given to a flag, or a usage error when it isn't one.
+template <typename T>
+T flag_value(const std::string& flag, std::string_view text) {
+    T value{};
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (error != std::errc() || end != text.data() + text.size()) {
+        std::cerr << "Invalid value for " << flag << ": '" << text << "'." << std::endl;
+        std::exit(1);
+    }
+    return value;
+}
+
 std::string read_file_contents(const std::string& filename) {
     std::ifstream file(filename);
     if (!file.is_open()) {
@@ -129,3 +462,186 @@ std::string read_file_contents(const std::string& filename) {
 
     return buffer.str();
 }
+
+lox::ModuleGraph load(lox::ModuleLoader& loader, const std::string& filename) {
+    lox::ModuleGraph graph = loader.load(filename);
+    if (!graph.entry) {
+        std::cerr << "Error reading file: " << filename << std::endl;
+        std::exit(1);
+    }
+    return graph;
+}
+
+// Runs the program with and without the JIT, capturing stdout and stderr, and
+// fails if the two runs disagree on output or runtime errors.
+int jit_diff(const std::vector<lox::Stmt*>& statements, lox::InterpreterOptions options) {
+    auto capture = [&](bool jit, std::string& output) {
+        std::ostringstream buffer;
+        auto* out = std::cout.rdbuf(buffer.rdbuf());
+        auto* err = std::cerr.rdbuf(buffer.rdbuf());
+
+        options.jit = jit;
+        auto interpreter = lox::Interpreter(options);
+        interpreter.interpret(statements);
+
+        std::cout.rdbuf(out);
+        std::cerr.rdbuf(err);
+        output = buffer.str();
+        return interpreter.had_runtime_error();
+    };
+
+    std::string interpreted, compiled;
+    bool interpreted_error = capture(false, interpreted);
+    bool compiled_error = capture(true, compiled);
+
+    if (interpreted != compiled || interpreted_error != compiled_error) {
+        std::cerr << "JIT output differs from the interpreter.\n"
+                  << "--- interpreter\n" << interpreted
+                  << "--- jit\n" << compiled << std::flush;
+        return 1;
+    }
+
+    std::cout << compiled;
+    return compiled_error ? 70 : 0;
+}
+
+// Runs the program once for every line of stdin, with the line in the global
+// `line` and its number, from 1, in `lineno`. The global scope persists
+// between lines; a --snapshot prelude can set up state there beforehand.
+// Stops at the first runtime error.
+int each_line(const std::vector<lox::Stmt*>& statements, lox::InterpreterOptions options, const std::string& snapshot) {
+    lox::BlockWriter writer(STDOUT_FILENO);
+    std::ostream out(&writer);
+    options.out = &out;
+
+    auto interpreter = lox::Interpreter(options);
+    if (interpreter.had_runtime_error()) {
+        lox::err::runtime_error(*interpreter.error());
+        return 70;
+    }
+    if (!snapshot.empty()) {
+        std::string error = lox::snapshot::load(interpreter, snapshot);
+        if (!error.empty()) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+    }
+
+    // Entries in the global scope stay put, so the two are bound once.
+    auto global = [&](const std::string& name, std::any value) {
+        interpreter.globals().define(name, value);
+        return interpreter.globals().get(lox::Token{.type = lox::IDENTIFIER, .lexeme = name, .literal = nullptr, .line = 0});
+    };
+    std::any* line = global("line", std::string());
+    std::any* lineno = global("lineno", 0.0);
+
+    lox::LineReader reader(STDIN_FILENO);
+    double number = 0;
+    for (std::string_view text; reader.next(text);) {
+        // Reuses the string's buffer unless the program stored something
+        // else in `line`.
+        if (auto string = std::any_cast<std::string>(line)) string->assign(text);
+        else *line = std::string(text);
+        *lineno = ++number;
+
+        interpreter.run(statements);
+        if (interpreter.had_runtime_error()) break;
+    }
+
+    if (!writer.drain()) {
+        std::cerr << "Error writing standard output." << std::endl;
+        return 1;
+    }
+    if (lox::err::had_error) return 65;
+    if (interpreter.had_runtime_error()) {
+        lox::err::runtime_error(*interpreter.error());
+        return 70;
+    }
+    if (reader.failed()) {
+        std::cerr << "Error reading standard input." << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Translates each file to C, builds it with the system C compiler ($CC, or
+// cc) and checks that the binary prints, fails and exits as `run` does.
+// Files that don't parse or can't be translated are skipped.
+int compile_test(const std::vector<std::string>& files) {
+    namespace fs = std::filesystem;
+    fs::path self = fs::read_symlink("/proc/self/exe");
+    fs::path directory = fs::temp_directory_path() / ("lox-compile-test-" + std::to_string(getpid()));
+    fs::create_directories(directory);
+
+    auto quote = [](const fs::path& path) {
+        std::string quoted = "'";
+        for (char c: path.string()) quoted += c == '\'' ? std::string("'\\''") : std::string(1, c);
+        return quoted + "'";
+    };
+    // Runs `command` with its output in `name`.out and `name`.err; returns
+    // its exit code.
+    auto execute = [&](const std::string& command, const std::string& name) {
+        int status = std::system((command + " >" + quote(directory / (name + ".out")) + " 2>" +
+                                  quote(directory / (name + ".err"))).c_str());
+        return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    };
+    auto contents = [&](const std::string& name) { return read_file_contents((directory / name).string()); };
+
+    const char* cc = std::getenv("CC");
+    std::string compiler = std::string(cc ? cc : "cc") + " " + lox::aot::cflags;
+
+    int passed = 0, failed = 0, skipped = 0;
+    for (const auto& filename: files) {
+        std::ostringstream errors;
+        std::ostream* output = std::exchange(lox::err::output, &errors);
+        lox::err::had_error = false;
+
+        auto scanner = lox::Scanner(read_file_contents(filename));
+        auto tokens = scanner.scan_tokens();
+        std::vector<lox::Stmt*> statements;
+        if (!lox::err::had_error) statements = lox::Parser(tokens).parse();
+
+        lox::err::output = output;
+        if (lox::err::had_error || statements.empty()) {
+            std::cout << "skip " << filename << ": syntax errors" << std::endl;
+            skipped++;
+            continue;
+        }
+
+        std::string source;
+        std::string error = lox::aot::translate(statements, source);
+        if (!error.empty()) {
+            std::cout << "skip " << filename << ": " << error << std::endl;
+            skipped++;
+            continue;
+        }
+
+        fs::path c_file = directory / "program.c", binary = directory / "program";
+        std::ofstream(c_file) << source;
+        if (execute(compiler + " -o " + quote(binary) + " " + quote(c_file) + " -lm", "cc") != 0) {
+            std::cout << "FAIL " << filename << ": the C compiler failed\n" << contents("cc.err") << std::flush;
+            failed++;
+            continue;
+        }
+
+        int expected = execute(quote(self) + " run " + quote(filename), "run");
+        int actual = execute(quote(binary), "compiled");
+
+        std::string difference;
+        if (contents("run.out") != contents("compiled.out")) difference = "output differs";
+        else if (contents("run.err") != contents("compiled.err")) difference = "errors differ";
+        else if (expected != actual) difference = "exit code " + std::to_string(actual) + ", expected " + std::to_string(expected);
+
+        if (difference.empty()) {
+            std::cout << "ok   " << filename << std::endl;
+            passed++;
+        } else {
+            std::cout << "FAIL " << filename << ": " << difference << std::endl;
+            failed++;
+        }
+    }
+    fs::remove_all(directory);
+
+    std::cout << passed << " passed, " << failed << " failed, " << skipped << " skipped" << std::endl;
+    return failed ? 1 : 0;
+}
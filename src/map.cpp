@@ -0,0 +1,206 @@
+#include "map.hpp"
+#include "function.hpp"
+#include "value.hpp"
+
+#include <bit>
+#include <functional>
+#include <string_view>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace lox {
+namespace {
+// Control bytes. Full slots hold the low seven bits of their hash, so the
+// sign bit alone tells a full slot from a vacant one.
+constexpr int8_t EMPTY   = -128;
+constexpr int8_t DELETED = -2;
+
+inline size_t mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    return x ^ (x >> 33);
+}
+
+// h1 picks the group to start probing from, h2 goes in the control byte.
+inline size_t h1(size_t hash) { return hash >> 7; }
+inline int8_t h2(size_t hash) { return int8_t(hash & 0x7f); }
+
+// The sixteen control bytes starting at `control`. Each query returns a mask
+// with bit i set when byte i qualifies.
+struct Group {
+    const int8_t* control;
+
+#if defined(__SSE2__)
+    inline uint32_t match(int8_t byte) const {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(control));
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(byte)));
+    }
+    inline uint32_t vacant() const {
+        return _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(control)));
+    }
+#else
+    inline uint32_t match(int8_t byte) const {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < Map::GROUP; i++) mask |= uint32_t(control[i] == byte) << i;
+        return mask;
+    }
+    inline uint32_t vacant() const {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < Map::GROUP; i++) mask |= uint32_t(control[i] < 0) << i;
+        return mask;
+    }
+#endif
+    inline uint32_t empty() const { return match(EMPTY); }
+};
+
+// Visits groups in triangular order, which reaches every group once when
+// their count is a power of two.
+struct Probe {
+    size_t group;
+    size_t mask;
+    size_t step{0};
+
+    Probe(size_t hash, size_t capacity): group(h1(hash) & (capacity / Map::GROUP - 1)), mask(capacity / Map::GROUP - 1) {}
+
+    inline size_t offset() const { return group * Map::GROUP; }
+    inline void next() { group = (group + ++step) & mask; }
+};
+
+inline const void* identity(const std::any& value) {
+    if (auto object = std::any_cast<Closure*     >(&value)) return *object;
+    if (auto object = std::any_cast<const Native*>(&value)) return *object;
+    if (auto object = std::any_cast<LoxClass*    >(&value)) return *object;
+    if (auto object = std::any_cast<Instance*    >(&value)) return *object;
+    if (auto object = std::any_cast<BoundMethod* >(&value)) return *object;
+    if (auto object = std::any_cast<Array*       >(&value)) return *object;
+    if (auto object = std::any_cast<Map*         >(&value)) return *object;
+    return nullptr;
+}
+
+// is_equal for keys, with numbers and strings compared without asking either
+// value for its type.
+inline bool same_key(const std::any& slot, const std::any& key) {
+    if (auto number = std::any_cast<double>(&key)) {
+        auto other = std::any_cast<double>(&slot);
+        return other && *other == *number;
+    }
+    if (auto string = std::any_cast<std::string>(&key)) {
+        auto other = std::any_cast<std::string>(&slot);
+        return other && *other == *string;
+    }
+    return is_equal(slot, key);
+}
+} // namespace
+
+size_t hash_value(const std::any& value) {
+    if (auto string = std::any_cast<std::string>(&value)) return mix(std::hash<std::string_view>()(*string));
+    if (auto number = std::any_cast<double>(&value)) return mix(std::bit_cast<uint64_t>(*number == 0 ? 0.0 : *number));
+    if (auto boolean = std::any_cast<bool>(&value)) return mix(*boolean ? 2 : 1);
+    if (IS_TYPE(value, std::nullptr_t)) return mix(0);
+    return mix(reinterpret_cast<uintptr_t>(identity(value)));
+}
+
+size_t Map::lookup(const std::any& key, size_t hash) const {
+    if (!count_) return capacity();
+    for (Probe probe(hash, capacity());; probe.next()) {
+        Group group{&control_[probe.offset()]};
+        for (uint32_t matches = group.match(h2(hash)); matches; matches &= matches - 1) {
+            size_t index = probe.offset() + std::countr_zero(matches);
+            if (slots_[index].hash == hash && same_key(slots_[index].key, key)) return index;
+        }
+        if (group.empty()) return capacity();
+    }
+}
+
+size_t Map::vacancy(size_t hash) const {
+    for (Probe probe(hash, capacity());; probe.next()) {
+        uint32_t vacant = Group{&control_[probe.offset()]}.vacant();
+        if (vacant) return probe.offset() + std::countr_zero(vacant);
+    }
+}
+
+std::any* Map::find(const std::any& key) {
+    size_t index = lookup(key, hash_value(key));
+    return index == capacity() ? nullptr : &slots_[index].value;
+}
+
+void Map::insert(const std::any& key, std::any value) {
+    size_t hash = hash_value(key);
+    size_t index = lookup(key, hash);
+    if (index != capacity()) {
+        slots_[index].value = std::move(value);
+        return;
+    }
+
+    if (!capacity()) rehash(GROUP);
+    index = vacancy(hash);
+    if (control_[index] == EMPTY && !growth_left_) {
+        // Out of empty slots: grow when at least half the load is live
+        // entries, otherwise the rest are tombstones and a same-size rehash
+        // reclaims them.
+        rehash(count_ * 16 >= capacity() * 7 ? capacity() * 2 : capacity());
+        index = vacancy(hash);
+    }
+
+    if (control_[index] == EMPTY) growth_left_--;
+    control_[index] = h2(hash);
+    slots_[index] = Slot{key, std::move(value), hash};
+    count_++;
+}
+
+bool Map::erase(const std::any& key) {
+    size_t index = lookup(key, hash_value(key));
+    if (index == capacity()) return false;
+
+    // A group that still has an empty slot has never been full, so no probe
+    // sequence runs past it and the slot can go straight back to empty.
+    Group group{&control_[index & ~(GROUP - 1)]};
+    if (group.empty()) {
+        control_[index] = EMPTY;
+        growth_left_++;
+    } else {
+        control_[index] = DELETED;
+    }
+    slots_[index] = Slot{};
+    count_--;
+    return true;
+}
+
+size_t Map::next(size_t index) const {
+    while (index < capacity() && control_[index] < 0) index++;
+    return std::min(index, capacity());
+}
+
+size_t Map::growth() const {
+    if (growth_left_) return 0;
+    return std::max(GROUP, capacity() * 2) * (sizeof(Slot) + 1);
+}
+
+void Map::rehash(size_t capacity) {
+    std::pmr::vector<int8_t> control(capacity, EMPTY, control_.get_allocator());
+    std::pmr::vector<Slot>   slots(capacity, slots_.get_allocator());
+    std::swap(control, control_);
+    std::swap(slots,   slots_);
+
+    // Cached hashes make this a move per entry; no key is hashed again.
+    for (size_t i = 0; i < control.size(); i++) {
+        if (control[i] < 0) continue;
+        size_t index = vacancy(slots[i].hash);
+        control_[index] = control[i];
+        slots_[index] = std::move(slots[i]);
+    }
+    growth_left_ = capacity * 7 / 8 - count_;
+}
+
+void Map::trace(Heap& heap) {
+    for (size_t i = 0; i < capacity(); i++) {
+        if (control_[i] < 0) continue;
+        heap.mark_value(slots_[i].key);
+        heap.mark_value(slots_[i].value);
+    }
+}
+} // namespace lox
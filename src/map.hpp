@@ -0,0 +1,67 @@
+#pragma once
+
+#include "heap.hpp"
+
+#include <any>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+namespace lox {
+// Keys that are equal under `==` hash alike; -0 and 0 included. Objects and
+// natives hash by identity. NaN is never equal to itself, so it can't be a key.
+size_t hash_value(const std::any& value);
+
+// A map from values to values, laid out as a Swiss table. Slots live in one
+// open-addressed array with a control byte each: empty, deleted, or the low
+// seven bits of the key's hash. Lookups scan a group of sixteen control bytes
+// at a time (with SSE2, in one comparison) and only compare keys whose byte
+// matches. Each slot keeps its key's full hash, so growing never hashes a
+// string twice and most mismatches are rejected without comparing keys.
+struct Map: public Object {
+    static constexpr size_t GROUP = 16;
+
+    struct Slot {
+        std::any key;
+        std::any value;
+        size_t hash;
+    };
+
+    Map(std::pmr::memory_resource* resource = std::pmr::get_default_resource()): control_(resource), slots_(resource) {}
+
+    inline size_t count() const { return count_; }
+    inline size_t capacity() const { return slots_.size(); }
+    // Bytes inserting a new key may allocate: the table it would rehash
+    // into, if it is full.
+    size_t growth() const;
+
+    // Keys must not be NaN. find returns nullptr when the key is absent.
+    std::any* find(const std::any& key);
+    void insert(const std::any& key, std::any value);
+    bool erase(const std::any& key);
+
+    // Iteration by slot index: the first full slot at or after `index`, or
+    // capacity() when there is none. Indices stay valid across erase but not
+    // across an insert, which may rehash the table.
+    size_t next(size_t index) const;
+    inline const Slot* at(size_t index) const { return index < capacity() && control_[index] >= 0 ? &slots_[index] : nullptr; }
+
+    void trace(Heap& heap) override;
+    size_t size() const override { return sizeof(Map) + capacity() * (sizeof(Slot) + 1); }
+
+private:
+    std::pmr::vector<int8_t> control_;
+    std::pmr::vector<Slot> slots_;
+    size_t count_{0};
+    // Empty slots that may still be filled before the table must grow; a
+    // deleted slot does not count as empty until the next rehash.
+    size_t growth_left_{0};
+
+    // Returns the slot index of `key`, or capacity() when it is absent.
+    size_t lookup(const std::any& key, size_t hash) const;
+    // Returns the first empty or deleted slot on `hash`'s probe sequence.
+    size_t vacancy(size_t hash) const;
+    void rehash(size_t capacity);
+};
+} // namespace lox
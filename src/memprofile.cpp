@@ -0,0 +1,131 @@
+#include "memprofile.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
+namespace lox {
+namespace {
+constexpr size_t LARGEST_SCOPES = 10;
+constexpr size_t TOP_LINES = 10;
+
+std::vector<std::pair<std::pair<int, alloc::Phase>, alloc::Usage>> top_lines(const alloc::Profile& profile, size_t limit) {
+    std::vector<std::pair<std::pair<int, alloc::Phase>, alloc::Usage>> lines(profile.lines.begin(), profile.lines.end());
+    std::sort(lines.begin(), lines.end(), [](const auto& a, const auto& b) { return a.second.total > b.second.total; });
+    if (lines.size() > limit) lines.resize(limit);
+    return lines;
+}
+
+double mean_depth(const ScopeStats& scopes) {
+    size_t total = 0;
+    for (size_t depth = 0; depth < scopes.depths.size(); depth++) total += depth * scopes.depths[depth];
+    return scopes.count ? double(total) / scopes.count : 0.0;
+}
+} // namespace
+
+void ScopeStats::record(const Environment& environment) {
+    count++;
+    entries += environment.entries();
+
+    if (depths.size() <= environment.depth_) depths.resize(environment.depth_ + 1);
+    depths[environment.depth_]++;
+
+    // Keep only the largest scope opened by each statement.
+    Scope scope{environment.line_, environment.entries(), environment.depth_};
+    auto same = std::find_if(largest.begin(), largest.end(), [&](const Scope& s) { return s.line == scope.line; });
+    if (same != largest.end()) {
+        if (same->entries >= scope.entries) return;
+        largest.erase(same);
+    }
+
+    auto position = std::upper_bound(largest.begin(), largest.end(), scope,
+        [](const Scope& a, const Scope& b) { return a.entries > b.entries; });
+    if (position - largest.begin() < LARGEST_SCOPES) {
+        largest.insert(position, scope);
+        if (largest.size() > LARGEST_SCOPES) largest.pop_back();
+    }
+}
+
+void MemoryProfile::read_rss() {
+    std::ifstream status("/proc/self/status");
+    std::string key;
+    size_t kilobytes;
+    while (status >> key) {
+        if      (key == "VmHWM:" && status >> kilobytes) peak_rss = kilobytes * 1024;
+        else if (key == "VmRSS:" && status >> kilobytes)      rss = kilobytes * 1024;
+    }
+}
+
+void MemoryProfile::write_json(std::ostream& out) const {
+    out << "{\n";
+    out << "  \"file\": " << std::quoted(file) << ",\n";
+    out << "  \"rss\": {\"peak\": " << peak_rss << ", \"current\": " << rss << "},\n";
+
+    out << "  \"peak\": {\"tracked\": " << allocations.peak << ", \"phases\": {";
+    for (int phase = 0; phase < alloc::PHASES; phase++) {
+        out << (phase ? ", " : "") << "\"" << alloc::phase_names[phase] << "\": " << allocations.peak_phases[phase];
+    }
+    out << "}},\n";
+
+    out << "  \"phases\": {\n";
+    for (int phase = 0; phase < alloc::PHASES; phase++) {
+        const auto& usage = allocations.phases[phase];
+        out << "    \"" << alloc::phase_names[phase] << "\": {\"live\": " << usage.live << ", \"total\": " << usage.total
+            << ", \"allocations\": " << usage.allocations << "}" << (phase + 1 < alloc::PHASES ? "," : "") << "\n";
+    }
+    out << "  },\n";
+
+    out << "  \"lines\": [";
+    bool first = true;
+    for (const auto& [key, usage]: allocations.lines) {
+        out << (first ? "\n" : ",\n") << "    {\"line\": " << key.first << ", \"phase\": \"" << alloc::phase_names[key.second]
+            << "\", \"live\": " << usage.live << ", \"total\": " << usage.total << ", \"allocations\": " << usage.allocations << "}";
+        first = false;
+    }
+    out << "\n  ],\n";
+
+    out << "  \"scopes\": {\n";
+    out << "    \"count\": " << scopes.count << ",\n";
+    out << "    \"entries\": " << scopes.entries << ",\n";
+    out << "    \"depth\": {\"max\": " << (scopes.depths.empty() ? 0 : scopes.depths.size() - 1)
+        << ", \"mean\": " << mean_depth(scopes) << ", \"histogram\": [";
+    for (size_t depth = 0; depth < scopes.depths.size(); depth++) out << (depth ? ", " : "") << scopes.depths[depth];
+    out << "]},\n";
+    out << "    \"largest\": [";
+    for (size_t i = 0; i < scopes.largest.size(); i++) {
+        const auto& scope = scopes.largest[i];
+        out << (i ? ",\n" : "\n") << "      {\"line\": " << scope.line << ", \"entries\": " << scope.entries
+            << ", \"depth\": " << scope.depth << "}";
+    }
+    out << "\n    ]\n";
+    out << "  }\n";
+    out << "}\n";
+}
+
+void MemoryProfile::write_summary(std::ostream& out) const {
+    out << "memprofile: " << file << "\n"
+        << "peak RSS " << peak_rss << " bytes, tracked peak " << allocations.peak << " bytes\n";
+
+    out << std::left << std::setw(14) << "phase" << std::right
+        << std::setw(14) << "at peak" << std::setw(14) << "live" << std::setw(14) << "total" << "\n";
+    for (int phase = 0; phase < alloc::PHASES; phase++) {
+        const auto& usage = allocations.phases[phase];
+        out << std::left << std::setw(14) << alloc::phase_names[phase] << std::right
+            << std::setw(14) << allocations.peak_phases[phase]
+            << std::setw(14) << usage.live << std::setw(14) << usage.total << "\n";
+    }
+
+    out << "top lines by total bytes:\n";
+    for (const auto& [key, usage]: top_lines(allocations, TOP_LINES)) {
+        out << "  line " << key.first << " (" << alloc::phase_names[key.second] << "): "
+            << usage.total << " bytes in " << usage.allocations << " allocations\n";
+    }
+
+    out << "scopes: " << scopes.count << ", max depth "
+        << (scopes.depths.empty() ? 0 : scopes.depths.size() - 1) << ", mean depth " << mean_depth(scopes) << "\n";
+    for (const auto& scope: scopes.largest) {
+        out << "  line " << scope.line << ": " << scope.entries << " entries at depth " << scope.depth << "\n";
+    }
+    out << std::flush;
+}
+} // namespace lox
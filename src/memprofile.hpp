@@ -0,0 +1,41 @@
+#pragma once
+
+#include "allocation.hpp"
+#include "environment.hpp"
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace lox {
+// Environment statistics, recorded as the collector frees scopes and for the
+// scopes still alive when the program ends.
+struct ScopeStats {
+    struct Scope {
+        int    line;
+        size_t entries;
+        int    depth;
+    };
+
+    size_t count{0};
+    size_t entries{0};
+    std::vector<size_t> depths; // Scopes seen at each chain depth.
+    std::vector<Scope> largest; // By entry count, descending, one per line.
+
+    void record(const Environment&);
+};
+
+struct MemoryProfile {
+    std::string file;
+    alloc::Profile allocations;
+    ScopeStats scopes;
+    // From /proc/self/status, in bytes; zero where unavailable.
+    size_t peak_rss{0};
+    size_t rss{0};
+
+    void read_rss();
+
+    void write_json(std::ostream&) const;
+    void write_summary(std::ostream&) const;
+};
+} // namespace lox
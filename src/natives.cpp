@@ -0,0 +1,252 @@
+#include "function.hpp"
+#include "array.hpp"
+#include "map.hpp"
+
+#include <chrono>
+#include <cmath>
+
+namespace lox::natives {
+namespace {
+// Argument checks happen here, once per call; the kernels assume them.
+Array* array_argument(NativeCall& call, int i, const char* native) {
+    auto array = std::any_cast<Array*>(&call.arguments[i]);
+    if (!array) call.fail(std::string("Argument to '") + native + "' must be an array.");
+    return array ? *array : nullptr;
+}
+
+const double* number_argument(NativeCall& call, int i, const char* native) {
+    auto number = std::any_cast<double>(&call.arguments[i]);
+    if (!number) call.fail(std::string("Argument to '") + native + "' must be a number.");
+    return number;
+}
+
+std::any out_of_memory(NativeCall& call) {
+    return call.fail("Out of memory: heap limit of " + std::to_string(call.heap.options().limit) + " bytes exceeded.");
+}
+
+// Room for the elements is made first, while nothing new needs rooting.
+Array* make_array(NativeCall& call, size_t size) {
+    Array* array = call.heap.make_room(size * sizeof(double)) ? call.heap.make<Array>(call.heap.resource()) : nullptr;
+    if (!array) {
+        out_of_memory(call);
+        return nullptr;
+    }
+    array->values_.resize(size);
+    return array;
+}
+
+Map* map_argument(NativeCall& call, int i, const char* native) {
+    auto map = std::any_cast<Map*>(&call.arguments[i]);
+    if (!map) call.fail(std::string("Argument to '") + native + "' must be a map.");
+    return map ? *map : nullptr;
+}
+
+// The map argument, provided the key after it can be looked up.
+Map* keyed(NativeCall& call, const char* native) {
+    Map* map = map_argument(call, 0, native);
+    auto key = std::any_cast<double>(&call.arguments[1]);
+    if (map && key && std::isnan(*key)) {
+        call.fail("Map key can't be NaN.");
+        return nullptr;
+    }
+    return map;
+}
+
+// The slot a cursor from `next` points at, or nullptr after an error.
+const Map::Slot* cursor(NativeCall& call, const char* native) {
+    Map* map = map_argument(call, 0, native);
+    auto index = map ? std::any_cast<double>(&call.arguments[1]) : nullptr;
+    bool valid = index && *index >= 0 && *index < map->capacity() && *index == std::floor(*index);
+    const Map::Slot* slot = valid ? map->at(size_t(*index)) : nullptr;
+    if (map && !slot) call.fail("Invalid map cursor.");
+    return slot;
+}
+
+Array* nonempty(NativeCall& call, const char* native) {
+    Array* array = array_argument(call, 0, native);
+    if (array && array->values_.empty()) {
+        call.fail(std::string("Can't take the ") + native + " of an empty array.");
+        return nullptr;
+    }
+    return array;
+}
+
+Array* same_length(NativeCall& call, const char* native, Array*& left) {
+    left = array_argument(call, 0, native);
+    Array* right = left ? array_argument(call, 1, native) : nullptr;
+    if (right && left->values_.size() != right->values_.size()) {
+        call.fail(std::string("Arrays passed to '") + native + "' must have the same length.");
+        return nullptr;
+    }
+    return right;
+}
+} // namespace
+
+// Seconds since the epoch, with sub-microsecond resolution.
+const Native clock{"clock", 0, [](NativeCall&) -> std::any {
+    using seconds = std::chrono::duration<double>;
+    return seconds(std::chrono::system_clock::now().time_since_epoch()).count();
+}};
+
+// `array(n)`: n zeros.
+const Native array{"array", 1, [](NativeCall& call) -> std::any {
+    auto size = number_argument(call, 0, "array");
+    if (!size) return {};
+    if (*size < 0 || *size != std::floor(*size)) return call.fail("Array size must be a non-negative integer.");
+
+    Array* array = make_array(call, size_t(*size));
+    if (!array) return {};
+    return array;
+}};
+
+const Native len{"len", 1, [](NativeCall& call) -> std::any {
+    if (auto array = std::any_cast<Array*>(&call.arguments[0])) return double((*array)->values_.size());
+    if (auto map   = std::any_cast<  Map*>(&call.arguments[0])) return double((*map)->count());
+    return call.fail("Argument to 'len' must be an array or a map.");
+}};
+
+const Native push{"push", 2, [](NativeCall& call) -> std::any {
+    Array* array = array_argument(call, 0, "push");
+    auto value = array ? number_argument(call, 1, "push") : nullptr;
+    if (!value) return {};
+
+    auto& values = array->values_;
+    if (values.size() == values.capacity() && !call.heap.make_room(std::max<size_t>(1, values.capacity() * 2) * sizeof(double))) {
+        return out_of_memory(call);
+    }
+    values.push_back(*value);
+    return array;
+}};
+
+const Native sum{"sum", 1, [](NativeCall& call) -> std::any {
+    Array* array = array_argument(call, 0, "sum");
+    if (!array) return {};
+    return kernels::sum(array->values_.data(), array->values_.size());
+}};
+
+const Native min{"min", 1, [](NativeCall& call) -> std::any {
+    Array* array = nonempty(call, "min");
+    if (!array) return {};
+    return kernels::min(array->values_.data(), array->values_.size());
+}};
+
+const Native max{"max", 1, [](NativeCall& call) -> std::any {
+    Array* array = nonempty(call, "max");
+    if (!array) return {};
+    return kernels::max(array->values_.data(), array->values_.size());
+}};
+
+const Native dot{"dot", 2, [](NativeCall& call) -> std::any {
+    Array* left;
+    Array* right = same_length(call, "dot", left);
+    if (!right) return {};
+    return kernels::dot(left->values_.data(), right->values_.data(), left->values_.size());
+}};
+
+// `scale(a, k)` and `add(a, b)` return new arrays; their arguments are
+// still on the caller's stack, so allocating the result cannot free them.
+const Native scale{"scale", 2, [](NativeCall& call) -> std::any {
+    Array* source = array_argument(call, 0, "scale");
+    auto factor = source ? number_argument(call, 1, "scale") : nullptr;
+    if (!factor) return {};
+
+    Array* result = make_array(call, source->values_.size());
+    if (!result) return {};
+    kernels::scale(result->values_.data(), source->values_.data(), *factor, source->values_.size());
+    return result;
+}};
+
+const Native add{"add", 2, [](NativeCall& call) -> std::any {
+    Array* left;
+    Array* right = same_length(call, "add", left);
+    if (!right) return {};
+
+    Array* result = make_array(call, left->values_.size());
+    if (!result) return {};
+    kernels::add(result->values_.data(), left->values_.data(), right->values_.data(), left->values_.size());
+    return result;
+}};
+
+// Sorts in place and returns the array.
+const Native sort{"sort", 1, [](NativeCall& call) -> std::any {
+    Array* array = array_argument(call, 0, "sort");
+    if (!array) return {};
+    kernels::sort(array->values_.data(), array->values_.size());
+    return array;
+}};
+
+const Native map{"map", 0, [](NativeCall& call) -> std::any {
+    Map* map = call.heap.make<Map>(call.heap.resource());
+    if (!map) return out_of_memory(call);
+    return map;
+}};
+
+// `get(m, k)`: the value under k, or nil when there is none.
+const Native get{"get", 2, [](NativeCall& call) -> std::any {
+    Map* map = keyed(call, "get");
+    if (!map) return {};
+    std::any* value = map->find(call.arguments[1]);
+    return value ? *value : nullptr;
+}};
+
+// `set(m, k, v)`: returns the map.
+const Native set{"set", 3, [](NativeCall& call) -> std::any {
+    Map* map = keyed(call, "set");
+    if (!map) return {};
+    if (!map->find(call.arguments[1]) && !call.heap.make_room(map->growth())) return out_of_memory(call);
+    map->insert(call.arguments[1], call.arguments[2]);
+    return map;
+}};
+
+const Native has{"has", 2, [](NativeCall& call) -> std::any {
+    Map* map = keyed(call, "has");
+    if (!map) return {};
+    return map->find(call.arguments[1]) != nullptr;
+}};
+
+// `delete(m, k)`: whether k was there.
+const Native erase{"delete", 2, [](NativeCall& call) -> std::any {
+    Map* map = keyed(call, "delete");
+    if (!map) return {};
+    return map->erase(call.arguments[1]);
+}};
+
+// Iteration goes through cursors:
+//
+//     for (var i = next(m, nil); i != nil; i = next(m, i)) print key(m, i);
+//
+// `next(m, nil)` starts and nil ends it. Setting a key while iterating may
+// rehash the map and invalidate the cursor; deleting one does not.
+const Native next{"next", 2, [](NativeCall& call) -> std::any {
+    Map* map = map_argument(call, 0, "next");
+    if (!map) return {};
+
+    size_t from = 0;
+    if (!(IS_TYPE(call.arguments[1], std::nullptr_t))) {
+        auto index = std::any_cast<double>(&call.arguments[1]);
+        if (!index || *index < 0 || *index != std::floor(*index)) return call.fail("Invalid map cursor.");
+        if (*index >= map->capacity()) return nullptr;
+        from = size_t(*index) + 1;
+    }
+
+    size_t index = map->next(from);
+    if (index == map->capacity()) return nullptr;
+    return double(index);
+}};
+
+const Native key{"key", 2, [](NativeCall& call) -> std::any {
+    const Map::Slot* slot = cursor(call, "key");
+    if (!slot) return {};
+    return slot->key;
+}};
+
+const Native value{"value", 2, [](NativeCall& call) -> std::any {
+    const Map::Slot* slot = cursor(call, "value");
+    if (!slot) return {};
+    return slot->value;
+}};
+
+const Native* const all[] = {&clock, &array, &len, &push, &sum, &min, &max, &dot, &scale, &add, &sort,
+                             &map, &get, &set, &has, &erase, &next, &key, &value};
+const size_t count = std::size(all);
+} // namespace lox::natives
@@ -1,36 +1,42 @@
 #include "parser.hpp"
 #include "errors.hpp"
+#include "allocation.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
 
 namespace lox {
-ParseError Parser::error(Token token, std::string message) {
+ParseError Parser::error(const TokenView& token, std::string message) {
     err::error(token, message);
-    return ParseError(message.data());
+    return ParseError(message);
 }
 
 void Parser::synchronize() {
     advance();
 
     while (!is_end()) {
-        if (previous().type == SEMICOLON) return;
+        if (tokens_.type(current_ - 1) == SEMICOLON) return;
 
-        switch (peek().type) {
+        switch (tokens_.type(current_)) {
             case CLASS: case    FUN: case   VAR:
             case   FOR: case     IF: case WHILE:
-            case PRINT: case RETURN:
+            case PRINT: case RETURN: case IMPORT:
                 return;
         }
         advance();
     }
 }
 
-Token Parser::advance() {
+TokenView Parser::advance() {
+    alloc::set_line(tokens_.line(current_));
     if (!is_end()) current_++;
     return previous();
 }
 
 bool Parser::check(TokenType type) {
     if (is_end()) return false;
-    return peek().type == type;
+    return tokens_.type(current_) == type;
 }
 
 bool Parser::match(std::vector<TokenType> types) {
@@ -41,28 +47,47 @@ bool Parser::match(std::vector<TokenType> types) {
     return false;
 }
 
-Token Parser::consume(TokenType type, std::string message) {
+TokenView Parser::consume(TokenType type, std::string message) {
     if (check(type)) return advance();
     throw error(peek(), message);
 }
 
 Expr* Parser::primary() {
-    if (match({FALSE})) return new Literal(false);
-    if (match({ TRUE})) return new Literal(true);
-    if (match({  NIL})) return new Literal(nullptr);
+    if (match({FALSE})) return make<Literal>(false);
+    if (match({ TRUE})) return make<Literal>(true);
+    if (match({  NIL})) return make<Literal>(nullptr);
 
     if (match({NUMBER, STRING})) {
-        return new Literal(previous().literal);
+        return make<Literal>(previous().literal());
     }
 
     if (match({IDENTIFIER})) {
-      return new Variable(previous());
+      return make<Variable>(previous());
+    }
+
+    if (match({THIS})) return make<This>(previous());
+
+    if (match({LEFT_BRACKET})) {
+        Token bracket = previous();
+        std::vector<Expr*> elements;
+        if (!check(RIGHT_BRACKET)) do {
+            elements.emplace_back(expression());
+        } while (match({COMMA}));
+        consume(RIGHT_BRACKET, "Expect ']' after array elements.");
+        return make<ArrayLiteral>(bracket, elements);
+    }
+
+    if (match({SUPER})) {
+        Token keyword = previous();
+        consume(DOT, "Expect '.' after 'super'.");
+        Token method = consume(IDENTIFIER, "Expect superclass method name.");
+        return make<Super>(keyword, method);
     }
 
     if (match({LEFT_PAREN})) {
         Expr* expr = expression();
         consume(RIGHT_PAREN, "Expect ')' after expression.");
-        return new Grouping(expr);
+        return make<Grouping>(expr);
     }
 
     throw error(peek(), "Expect expression.");
@@ -70,25 +95,66 @@ Expr* Parser::primary() {
 
 Expr* Parser::unary() {
     if (match({BANG, MINUS})) {
+        Nesting nesting(*this);
         Token op = previous();
         Expr* right = unary();
-        return new Unary(op, right);
+        return make<Unary>(op, right);
+    }
+
+    return call();
+}
+
+Expr* Parser::call() {
+    Expr* expr = primary();
+    // Each call, property or index nests what came before it one level deeper.
+    Nesting links(*this, 0);
+    while (true) {
+        if (match({LEFT_PAREN})) {
+            links.deeper();
+            expr = finish_call(expr);
+        } else if (match({DOT})) {
+            links.deeper();
+            Token name = consume(IDENTIFIER, "Expect property name after '.'.");
+            expr = make<Get>(expr, name, sites_++);
+        } else if (match({LEFT_BRACKET})) {
+            links.deeper();
+            Expr* index = expression();
+            Token bracket = consume(RIGHT_BRACKET, "Expect ']' after index.");
+            expr = make<Index>(expr, bracket, index);
+        } else {
+            break;
+        }
     }
+    return expr;
+}
 
-    return primary();
+Expr* Parser::finish_call(Expr* callee) {
+    std::vector<Expr*> arguments;
+    if (!check(RIGHT_PAREN)) do {
+        if (arguments.size() >= 255) error(peek(), "Can't have more than 255 arguments.");
+        arguments.emplace_back(expression());
+    } while (match({COMMA}));
+
+    Token paren = consume(RIGHT_PAREN, "Expect ')' after arguments.");
+    auto call = make<Call>(callee, paren, arguments);
+    call->method_ = dynamic_cast<Get*>(callee);
+    return call;
 }
 
 Expr* Parser::assignment() {
-    Expr* expr = or_expr();
+    Nesting nesting(*this);
+    Expr* expr = binary();
 
     if (match({EQUAL})) {
-        Token equals = previous();
+        TokenView equals = previous();
         Expr* value = assignment();
 
         if (dynamic_cast<Variable*>(expr)) {
             Token name = ((Variable*)expr)->name_;
-            return new Assign(name, value);
+            return make<Assign>(name, value);
         }
+        if (auto get = dynamic_cast<Get*>(expr)) return make<Set>(get->object_, get->name_, value, sites_++);
+        if (auto index = dynamic_cast<Index*>(expr)) return make<SetIndex>(index->object_, index->bracket_, index->index_, value);
         
         error(equals, "Invalid assignment target."); 
     }
@@ -96,28 +162,46 @@ Expr* Parser::assignment() {
     return expr;
 }
 
-Expr* Parser::or_expr() {
-    Expr* expr = and_expr();
-
-    while (match({OR})) {
-        Token op = previous();
-        Expr* right = and_expr();
-        expr = new Logical(expr, op, right);
+// How tightly a binary operator binds, from `or` up to `*` and `/`; zero for
+// any other token.
+static int precedence(TokenType type) {
+    switch (type) {
+        case OR:  return 1;
+        case AND: return 2;
+        case BANG_EQUAL: case EQUAL_EQUAL: return 3;
+        case GREATER: case GREATER_EQUAL: case LESS: case LESS_EQUAL: return 4;
+        case MINUS: case PLUS:  return 5;
+        case SLASH: case STAR:  return 6;
+        default: return 0;
     }
-
-    return expr;
 }
 
-Expr* Parser::and_expr() {
-    Expr* expr = equality();
+// Parses operators of every precedence in one loop. Left operands wait on a
+// stack with their operator until the next operator binds no tighter, which
+// keeps the stack to one entry per level and builds left-associative chains
+// without recursing.
+Expr* Parser::binary() {
+    struct Pending {
+        Expr* left;
+        Token op;
+        int precedence;
+    };
+    std::vector<Pending> pending;
+
+    Expr* expr = unary();
+    while (true) {
+        int level = is_end() ? 0 : precedence(tokens_.type(current_));
+        while (!pending.empty() && pending.back().precedence >= level) {
+            Pending& link = pending.back();
+            if (link.op.type == OR || link.op.type == AND) expr = make<Logical>(link.left, link.op, expr);
+            else                                           expr = make<Binary >(link.left, link.op, expr);
+            pending.pop_back();
+        }
+        if (!level) return expr;
 
-    while (match({AND})) {
-        Token op = previous();
-        Expr* right = equality();
-        expr = new Logical(expr, op, right);
+        pending.push_back({expr, advance(), level});
+        expr = unary();
     }
-
-    return expr;
 }
 
 std::vector<Stmt*> Parser::block() {
@@ -129,28 +213,49 @@ std::vector<Stmt*> Parser::block() {
     return statements;
 } 
 
-Expr* Parser::construct_binary(std::function<Expr*()> func, std::vector<TokenType> tokens) {
-    Expr* expr = func();
-
-    while (match(tokens)) {
-        Token op = previous();
-        Expr* right = func();
-        expr = new Binary(expr, op, right);
+// Steps over a block by matching braces alone, leaving the statements inside
+// for Block::tokens_ to parse later.
+Stmt* Parser::skim() {
+    int first = current_;
+    for (int depth = 1; depth; current_++) {
+        if (is_end()) throw error(peek(), "Expect '}' after block.");
+        TokenType type = tokens_.type(current_);
+        depth += (type == LEFT_BRACE) - (type == RIGHT_BRACE);
     }
-
-    return expr;
+    return make<Block>(&tokens_, first, depth_, max_nesting_);
 }
 
 Stmt* Parser::expression_statement() {
     Expr* expr = expression();
     consume(SEMICOLON, "Expect ';' after expression.");
-    return new Expression(expr);
+    return make<Expression>(expr);
+}
+
+Stmt* Parser::statement() {
+    Nesting nesting(*this);
+    int line = tokens_.line(current_);
+
+    Stmt* stmt;
+    if      (match({       FOR})) stmt =   for_statement();
+    else if (match({        IF})) stmt =    if_statement();
+    else if (match({     PRINT})) stmt = print_statement();
+    else if (match({    RETURN})) stmt = return_statement();
+    else if (match({     WHILE})) stmt = while_statement();
+    else if (match({LEFT_BRACE})) stmt = lazy_ && !functions_ ? skim() : make<Block>(block());
+    else                          stmt = expression_statement();
+
+    stmt->line_ = line;
+    return stmt;
 }
 
 Stmt* Parser::declaration() { try {
     if (match({VAR})) return var_declaration();
+    if (match({FUN})) return function("function");
+    if (match({CLASS})) return class_declaration();
+    if (match({IMPORT})) return import_declaration();
     return statement();
-} catch (ParseError error) {
+} catch (const ParseError&) {
+    if (too_deep_) throw;
     synchronize();
     return nullptr;
 }}
@@ -162,13 +267,87 @@ Stmt* Parser::var_declaration() {
     if (match({EQUAL})) initializer = expression();
 
     consume(SEMICOLON, "Expect ';' after variable declaration.");
-    return new Var(name, initializer);
+
+    Stmt* stmt = make<Var>(name, initializer);
+    stmt->line_ = name.line;
+    return stmt;
+}
+
+Stmt* Parser::import_declaration() {
+    TokenView keyword = previous();
+    if (depth_) error(keyword, "Imports must be at the top level.");
+    TokenView path = consume(STRING, "Expect module path after 'import'.");
+    consume(SEMICOLON, "Expect ';' after module path.");
+
+    std::string name = std::filesystem::path(std::any_cast<std::string>(path.literal())).stem().string();
+    bool identifier = !name.empty() && !std::isdigit(uint8_t(name[0])) && !keywords.contains(name) &&
+                      std::all_of(name.begin(), name.end(), [](char c) { return std::isalnum(uint8_t(c)) || c == '_'; });
+    if (!identifier) error(path, "Module name '" + name + "' is not an identifier.");
+
+    Stmt* stmt = make<Import>(keyword, path, Token{.type = IDENTIFIER, .lexeme = name, .literal = nullptr, .line = keyword.line});
+    stmt->line_ = keyword.line;
+    return stmt;
+}
+
+Stmt* Parser::class_declaration() {
+    Token name = consume(IDENTIFIER, "Expect class name.");
+
+    Variable* superclass = nullptr;
+    if (match({LESS})) {
+        consume(IDENTIFIER, "Expect superclass name.");
+        superclass = make<Variable>(previous());
+    }
+
+    consume(LEFT_BRACE, "Expect '{' before class body.");
+
+    std::vector<Function*> methods;
+    while (!check(RIGHT_BRACE) && !is_end()) {
+        auto method = static_cast<Function*>(function("method"));
+        method->kind_ = method->name_.lexeme == "init" ? Function::INITIALIZER : Function::METHOD;
+        methods.emplace_back(method);
+    }
+    consume(RIGHT_BRACE, "Expect '}' after class body.");
+
+    Stmt* stmt = make<Class>(name, superclass, methods);
+    stmt->line_ = name.line;
+    return stmt;
+}
+
+Stmt* Parser::function(std::string kind) {
+    Token name = consume(IDENTIFIER, "Expect " + kind + " name.");
+    consume(LEFT_PAREN, "Expect '(' after " + kind + " name.");
+
+    std::vector<Token> params;
+    if (!check(RIGHT_PAREN)) do {
+        if (params.size() >= 255) error(peek(), "Can't have more than 255 parameters.");
+        params.emplace_back(consume(IDENTIFIER, "Expect parameter name."));
+    } while (match({COMMA}));
+    consume(RIGHT_PAREN, "Expect ')' after parameters.");
+
+    consume(LEFT_BRACE, "Expect '{' before " + kind + " body.");
+    Nesting nesting(*this);
+    functions_++;
+    std::vector<Stmt*> body = block();
+    functions_--;
+
+    Stmt* stmt = make<Function>(name, params, body);
+    stmt->line_ = name.line;
+    return stmt;
+}
+
+Stmt* Parser::return_statement() {
+    Token keyword = previous();
+    Expr* value = nullptr;
+    if (!check(SEMICOLON)) value = expression();
+
+    consume(SEMICOLON, "Expect ';' after return value.");
+    return make<Return>(keyword, value);
 }
 
 Stmt* Parser::print_statement() {
     Expr* value = expression();
     consume(SEMICOLON, "Expect ';' after value.");
-    return new Print(value);
+    return make<Print>(value);
 }
 
 Stmt* Parser::if_statement() {
@@ -180,7 +359,7 @@ Stmt* Parser::if_statement() {
     Stmt* else_branch = nullptr;
     if (match({ELSE})) else_branch = statement();
 
-    return new If(condition, then_branch, else_branch);
+    return make<If>(condition, then_branch, else_branch);
 }
 
 Stmt* Parser::while_statement() {
@@ -189,10 +368,42 @@ Stmt* Parser::while_statement() {
     consume(RIGHT_PAREN, "Expect ')' after while condition.");
     
     Stmt* body = statement();
-    return new While(condition, body);
+    return make<While>(condition, body);
+}
+
+// Matches `var i = ...; i <cmp> <number or variable>; i = i +/- <number>`.
+Stmt* Parser::counted_loop(Stmt* initializer, While* loop, Stmt* body, Expression* step) {
+    auto var = dynamic_cast<Var*>(initializer);
+    if (!var || !step) return nullptr;
+    const std::string& name = var->name_.lexeme;
+
+    auto condition = dynamic_cast<Binary*>(loop->condition_);
+    if (!condition) return nullptr;
+    switch (condition->op_.type) {
+        case LESS: case LESS_EQUAL: case GREATER: case GREATER_EQUAL: break;
+        default: return nullptr;
+    }
+    auto counter = dynamic_cast<Variable*>(condition->left_);
+    if (!counter || counter->name_.lexeme != name) return nullptr;
+    if (!dynamic_cast<Variable*>(condition->right_)) {
+        auto bound = dynamic_cast<Literal*>(condition->right_);
+        if (!bound || !(IS_TYPE(bound->value_, double))) return nullptr;
+    }
+
+    auto assign = dynamic_cast<Assign*>(step->expr_);
+    if (!assign || assign->name_.lexeme != name) return nullptr;
+    auto sum = dynamic_cast<Binary*>(assign->value_);
+    if (!sum || (sum->op_.type != PLUS && sum->op_.type != MINUS)) return nullptr;
+    auto self = dynamic_cast<Variable*>(sum->left_);
+    auto amount = dynamic_cast<Literal*>(sum->right_);
+    if (!self || self->name_.lexeme != name || !amount || !(IS_TYPE(amount->value_, double))) return nullptr;
+
+    double delta = std::any_cast<double>(amount->value_);
+    return make<CountedLoop>(var, loop, body, step, sum->op_.type == PLUS ? delta : -delta);
 }
 
 Stmt* Parser::for_statement() {
+    int line = tokens_.line(current_ - 1);
     consume(LEFT_PAREN, "Expect '(' after 'for'.");
 
     Stmt* initializer;
@@ -209,13 +420,23 @@ Stmt* Parser::for_statement() {
     consume(RIGHT_PAREN, "Expect ')' after for clauses.");
 
     Stmt* body = statement();
-    if (increment) body = new Block({body, new Expression(increment)});
+    Stmt* loop_body = body;
+    Expression* step = nullptr;
+    if (increment) {
+        step = make<Expression>(increment);
+        loop_body = make<Block>(std::vector<Stmt*>{body, step});
+        loop_body->line_ = step->line_ = line;
+    }
 
-    if (!condition) condition = new Literal(true);
-    body = new While(condition, body);
+    if (!condition) condition = make<Literal>(true);
+    While* loop = make<While>(condition, loop_body);
+    loop->line_ = line;
 
-    if (initializer) body = new Block({initializer, body});
-    
-    return body;
+    if (!initializer) return loop;
+
+    Stmt* stmt = counted_loop(initializer, loop, body, step);
+    if (!stmt) stmt = make<Block>(std::vector<Stmt*>{initializer, loop});
+    stmt->line_ = line;
+    return stmt;
 }
 } // namespace lox
@@ -1,86 +1,157 @@
 #pragma once
 
 #include "ast/statements.hpp"
+#include "errors.hpp"
+#include "resolver.hpp"
 
-#include <functional>
+#include <memory>
 
 namespace lox {
+// Owns the nodes a parser allocates, for callers that free their AST. Without
+// one, the nodes live as long as the process.
+struct Nodes {
+    std::vector<std::unique_ptr<Expr>> exprs;
+    std::vector<std::unique_ptr<Stmt>> stmts;
+};
+
 class ParseError: public std::exception {
 public:
-    ParseError(char* message): message_(message) {}
+    ParseError(std::string message): message_(std::move(message)) {}
 
-    inline char* what() { return message_; }
+    inline const char* what() const noexcept override { return message_.c_str(); }
 
 private:
-    char* message_;
+    std::string message_;
 };
 
 class Parser {
 public:
-    Parser(std::vector<Token> tokens): tokens_(tokens) {}
+    static constexpr int MAX_NESTING = 256;
+
+    // The tokens must outlive the parser; the AST copies what it keeps. A lazy
+    // parser only skims blocks outside functions, which then keep a reference
+    // to the tokens and parse themselves when they first run.
+    //
+    // Expressions, statements and blocks may nest `max_nesting` levels deep;
+    // deeper input is a syntax error rather than a native stack overflow.
+    Parser(const TokenStream& tokens, bool lazy = false, Nodes* nodes = nullptr, int max_nesting = MAX_NESTING)
+        : tokens_(tokens), lazy_(lazy), nodes_(nodes), max_nesting_(max_nesting) {}
     std::vector<Stmt*> parse() {
         try {
             std::vector<Stmt*> statements;
             while (!is_end()) {
                 statements.emplace_back(declaration());
             }
+            if (!err::had_error) Resolver().resolve(statements);
             return statements;
-        } catch (ParseError e) {
+        } catch (const ParseError&) {
             return {};
         }
     }
     inline Expr* parse(int i) {
         try { return expression(); }
-        catch (ParseError error) { return nullptr; }
+        catch (const ParseError&) { return nullptr; }
+    }
+    // Parses and resolves the statements of a skimmed block, which start at
+    // token `first` and `depth` levels deep, inside blocks outside functions
+    // that declared `scopes`. Blocks nested in it are skimmed in turn.
+    std::vector<Stmt*> parse_block(int first, int depth, const std::vector<std::unordered_set<std::string>>& scopes) {
+        current_ = first;
+        depth_ = depth;
+        try {
+            std::vector<Stmt*> statements = block();
+            if (!err::had_error) Resolver(scopes).resolve_skimmed(statements);
+            return statements;
+        } catch (const ParseError&) {
+            return {};
+        }
     }
 
+    // Property access sites numbered so far; see Get::site_.
+    inline uint32_t sites() const { return sites_; }
+
 private:
-    std::vector<Token> tokens_;
+    const TokenStream& tokens_;
     int current_{0};
+    bool lazy_;
+    Nodes* nodes_;
+    uint32_t sites_{0};
+    // Nonzero inside function bodies, whose blocks are always parsed: their
+    // variables become frame slots, which are counted before the first call.
+    int functions_{0};
+    int max_nesting_;
+    int depth_{0};
+    // Set once the input nests too deeply, which ends the parse: recovering
+    // would only report the same error for every level on the way out.
+    bool too_deep_{false};
+
+    // Holds levels of nesting for as long as it lives.
+    class Nesting {
+    public:
+        Nesting(Parser& parser, int levels = 1): parser_(parser) { while (levels_ < levels) deeper(); }
+        ~Nesting() { parser_.depth_ -= levels_; }
+
+        void deeper() {
+            if (parser_.depth_ == parser_.max_nesting_) {
+                parser_.too_deep_ = true;
+                throw parser_.error(parser_.peek(), "Can't nest more than " + std::to_string(parser_.max_nesting_) + " levels deep.");
+            }
+            parser_.depth_++;
+            levels_++;
+        }
 
-    ParseError error(Token, std::string);
+    private:
+        Parser& parser_;
+        int levels_{0};
+    };
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        T* node = new T(std::forward<Args>(args)...);
+        if (nodes_) {
+            if constexpr (std::is_base_of_v<Expr, T>) nodes_->exprs.emplace_back(node);
+            else nodes_->stmts.emplace_back(node);
+        }
+        return node;
+    }
+
+    ParseError error(const TokenView&, std::string);
     void synchronize();
 
-    inline Token     peek() { return tokens_.at(current_); }
-    inline Token previous() { return tokens_.at(current_ - 1); }
+    inline TokenView     peek() { return tokens_[current_]; }
+    inline TokenView previous() { return tokens_[current_ - 1]; }
 
-    inline bool    is_end() { return peek().type == tk_EOF; }
+    inline bool    is_end() { return tokens_.type(current_) == tk_EOF; }
 
-    Token advance();
+    TokenView advance();
     bool    check(            TokenType );
     bool    match(std::vector<TokenType>);
 
-    Token consume(TokenType, std::string);
-
-    Expr* construct_binary(std::function<Expr*()>, std::vector<TokenType>);
+    TokenView consume(TokenType, std::string);
 
            Expr*    primary();
+           Expr*       call();
+           Expr* finish_call(Expr*);
            Expr*      unary();
-    inline Expr*     factor() { return construct_binary(std::bind(&Parser::unary,      this), {SLASH, STAR}); }
-    inline Expr*       term() { return construct_binary(std::bind(&Parser::factor,     this), {MINUS, PLUS}); }
-    inline Expr* comparison() { return construct_binary(std::bind(&Parser::term,       this), {GREATER, GREATER_EQUAL, LESS, LESS_EQUAL}); }
-    inline Expr*   equality() { return construct_binary(std::bind(&Parser::comparison, this), {BANG_EQUAL, EQUAL_EQUAL}); }
+           Expr*     binary();
            Expr* assignment();
-           Expr*    or_expr();
-           Expr*   and_expr();
     inline Expr* expression() { return assignment(); }
 
     std::vector<Stmt*> block();
+    Stmt* skim();
 
     Stmt* expression_statement();
     Stmt*      print_statement();
+    Stmt*     return_statement();
     Stmt*        for_statement();
+    Stmt*         counted_loop(Stmt*, While*, Stmt*, Expression*);
     Stmt*         if_statement();
     Stmt*      while_statement();
-    Stmt*            statement() {
-        if (match({       FOR})) return   for_statement();
-        if (match({        IF})) return    if_statement();
-        if (match({     PRINT})) return print_statement();
-        if (match({     WHILE})) return while_statement();
-        if (match({LEFT_BRACE})) return new Block(block());
-        return expression_statement();
-    }
+    Stmt*            statement();
     Stmt*      declaration();
     Stmt*  var_declaration();
+    Stmt*         function(std::string kind);
+    Stmt* class_declaration();
+    Stmt* import_declaration();
 };
 } // namespace lox
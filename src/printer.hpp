@@ -1,31 +1,52 @@
 #pragma once
 
 #include "ast/expressions.hpp"
+#include "flat.hpp"
 #include <iostream>
 
 namespace lox {
+inline std::string print_literal(const std::any& value) {
+    if (IS_TYPE(value, std::nullptr_t)) return "nil";
+    if (IS_TYPE(value, std::string)) return std::any_cast<std::string>(value);
+    if (IS_TYPE(value, double)) return trimmed_double(std::any_cast<double>(value));
+    if (IS_TYPE(value, bool)) return std::any_cast<bool>(value) ? "true" : "false";
+    return "?";
+}
+
 class ASTPrinter: public ExprVisitor<std::string> {
 public:
     inline std::string print(Expr* expr) { return expr->accept(this); }
 
-    inline std::string visit_binary_expr(Binary* expr) override {
-        return parenthesize(expr->op_.lexeme, {expr->left_, expr->right_});
+    inline std::string visit_binary_expr(Binary* expr) override { return print_chain(expr); }
+    inline std::string visit_call_expr(Call* expr) override {
+        std::vector<Expr*> exprs{expr->callee_};
+        exprs.insert(exprs.end(), expr->arguments_.begin(), expr->arguments_.end());
+        return parenthesize("call", exprs);
+    }
+    inline std::string visit_array_expr(ArrayLiteral* expr) override {
+        return parenthesize("array", expr->elements_);
+    }
+    inline std::string visit_index_expr(Index* expr) override {
+        return parenthesize("index", {expr->object_, expr->index_});
+    }
+    inline std::string visit_set_index_expr(SetIndex* expr) override {
+        return parenthesize("set-index", {expr->object_, expr->index_, expr->value_});
+    }
+    inline std::string visit_get_expr(Get* expr) override {
+        return parenthesize("get " + expr->name_.lexeme, {expr->object_});
     }
+    inline std::string visit_set_expr(Set* expr) override {
+        return parenthesize("set " + expr->name_.lexeme, {expr->object_, expr->value_});
+    }
+    inline std::string visit_super_expr(Super* expr) override { return "super." + expr->method_.lexeme; }
+    inline std::string visit_this_expr(This*) override { return "this"; }
     inline std::string visit_grouping_expr(Grouping* expr) override {
         return parenthesize("group", {expr->expr_});
     }
   
-    std::string visit_literal_expr(Literal* expr) override {
-        if (IS_TYPE(expr->value_, std::nullptr_t)) return "nil";
-        if (IS_TYPE(expr->value_, std::string)) return std::any_cast<std::string>(expr->value_);
-        if (IS_TYPE(expr->value_, double)) return trimmed_double(std::any_cast<double>(expr->value_));
-        if (IS_TYPE(expr->value_, bool)) return std::any_cast<bool>(expr->value_) ? "true" : "false";
-        return "?";
-    }
+    inline std::string visit_literal_expr(Literal* expr) override { return print_literal(expr->value_); }
     
-    inline std::string visit_logical_expr(Logical* expr) override {
-        return parenthesize(expr->op_.lexeme, {expr->left_, expr->right_});
-    }
+    inline std::string visit_logical_expr(Logical* expr) override { return print_chain(expr); }
   
     inline std::string visit_unary_expr(Unary* expr) override {
         return parenthesize(expr->op_.lexeme, {expr->right_});
@@ -38,6 +59,19 @@ public:
     }
 
 private:
+    // Prints `(op (op a b) c)` for an operator chain without recursing along it.
+    template <typename Link>
+    std::string print_chain(Link* link) {
+        std::vector<Link*> links{link};
+        while (links.back()->chain_ > 1) links.push_back(static_cast<Link*>(links.back()->left_));
+
+        std::ostringstream out;
+        for (auto link: links) out << "(" << link->op_.lexeme << " ";
+        out << links.back()->left_->accept(this);
+        for (auto it = links.rbegin(); it != links.rend(); it++) out << " " << (*it)->right_->accept(this) << ")";
+        return out.str();
+    }
+
     std::string parenthesize(std::string name, std::vector<Expr*> exprs) {
         std::ostringstream out;
 
@@ -48,4 +82,66 @@ private:
         return out.str();
     }
 };
+
+// ASTPrinter over the flat encoding, printing the same text.
+class FlatPrinter {
+public:
+    FlatPrinter(const FlatAst& ast): ast_(ast) {}
+
+    std::string print(uint32_t index) {
+        const FlatAst::Node& node = ast_[index];
+        switch (node.kind) {
+            case FlatAst::BINARY:
+            case FlatAst::LOGICAL:   return print_chain(index);
+            case FlatAst::UNARY:     return parenthesize(lexeme(node), {node.a});
+            case FlatAst::GROUPING:  return parenthesize("group", {node.a});
+            case FlatAst::LITERAL:   return print_literal(ast_.constant(node));
+            case FlatAst::GLOBAL:
+            case FlatAst::LOCAL:     return lexeme(node);
+            case FlatAst::ASSIGN_GLOBAL:
+            case FlatAst::ASSIGN_LOCAL: return parenthesize(lexeme(node), {node.a});
+            case FlatAst::CALL: {
+                std::vector<uint32_t> children{node.a};
+                children.insert(children.end(), ast_.list(node), ast_.list(node) + node.c);
+                return parenthesize("call", children);
+            }
+            case FlatAst::ARRAY:     return parenthesize("array", std::vector<uint32_t>(ast_.list(node), ast_.list(node) + node.c));
+            case FlatAst::INDEX:     return parenthesize("index", {node.a, node.b});
+            case FlatAst::SET_INDEX: return parenthesize("set-index", {node.a, node.b, node.c});
+            case FlatAst::GET:       return parenthesize("get " + lexeme(node), {node.a});
+            case FlatAst::SET:       return parenthesize("set " + lexeme(node), {node.a, node.b});
+            case FlatAst::SUPER:     return "super." + lexeme(node);
+            case FlatAst::THIS:      return "this";
+            default:                 return "?";
+        }
+    }
+
+private:
+    const FlatAst& ast_;
+
+    // Literals and groupings have no token.
+    const std::string& lexeme(const FlatAst::Node& node) { return ast_.token(node).lexeme; }
+
+    // As ASTPrinter::print_chain, following each link's left operand.
+    std::string print_chain(uint32_t index) {
+        std::vector<uint32_t> links{index};
+        while (ast_[links.back()].c > 1) links.push_back(ast_[links.back()].a);
+
+        std::ostringstream out;
+        for (auto link: links) out << "(" << lexeme(ast_[link]) << " ";
+        out << print(ast_[links.back()].a);
+        for (auto it = links.rbegin(); it != links.rend(); it++) out << " " << print(ast_[*it].b) << ")";
+        return out.str();
+    }
+
+    std::string parenthesize(std::string name, std::vector<uint32_t> children) {
+        std::ostringstream out;
+
+        out << "(" << name;
+        for (auto child : children) out << " " << print(child);
+        out << ")";
+
+        return out.str();
+    }
+};
 } // namespace lox
@@ -0,0 +1,264 @@
+#include "resolver.hpp"
+#include "errors.hpp"
+
+namespace lox {
+void Resolver::resolve(const std::vector<Stmt*>& stmts) {
+    for (auto stmt: stmts) resolve(stmt);
+}
+
+void Resolver::resolve_skimmed(const std::vector<Stmt*>& stmts) {
+    resolve_scope(stmts, Block::declares(stmts));
+}
+
+void Resolver::resolve(Stmt* stmt) {
+    if (auto expression = dynamic_cast<Expression*>(stmt)) return resolve(expression->expr_);
+    if (auto print      = dynamic_cast<Print*     >(stmt)) return resolve(print->expr_);
+    if (auto function   = dynamic_cast<Function*  >(stmt)) return resolve_function(function);
+    if (auto klass      = dynamic_cast<Class*     >(stmt)) return resolve_class(klass);
+    if (auto import     = dynamic_cast<Import*    >(stmt)) return declare(import->name_, import->binding_);
+
+    if (auto var = dynamic_cast<Var*>(stmt)) {
+        // Declared after the initializer, so `var a = a;` reads the outer `a`.
+        if (var->initializer_) resolve(var->initializer_);
+        return declare(var->name_, var->binding_);
+    }
+
+    if (auto return_stmt = dynamic_cast<Return*>(stmt)) {
+        if (functions_.empty()) err::error(return_stmt->keyword_, "Can't return from top-level code.");
+        else if (return_stmt->value_ && functions_.back().function->kind_ == Function::INITIALIZER) {
+            err::error(return_stmt->keyword_, "Can't return a value from an initializer.");
+        }
+        if (return_stmt->value_) resolve(return_stmt->value_);
+        return;
+    }
+
+    if (auto block = dynamic_cast<Block*>(stmt)) {
+        if (functions_.empty()) {
+            if (block->tokens_) block->scopes_ = scopes_;
+            return resolve_scope(block->statements_, block->declares_);
+        }
+        block->declares_ = false;
+        return resolve_block(block->statements_);
+    }
+
+    if (auto if_stmt = dynamic_cast<If*>(stmt)) {
+        resolve(if_stmt->condition_);
+        resolve(if_stmt->then_branch_);
+        if (if_stmt->else_branch_) resolve(if_stmt->else_branch_);
+        return;
+    }
+
+    auto while_stmt = static_cast<While*>(stmt);
+    resolve(while_stmt->condition_);
+    resolve(while_stmt->body_);
+}
+
+void Resolver::resolve(Expr* expr) {
+    if (auto variable = dynamic_cast<Variable*>(expr)) return use(variable->name_, variable->binding_);
+    if (auto grouping = dynamic_cast<Grouping*>(expr)) return resolve(grouping->expr_);
+    if (auto unary    = dynamic_cast<Unary*   >(expr)) return resolve(unary->right_);
+
+    if (auto assign = dynamic_cast<Assign*>(expr)) {
+        resolve(assign->value_);
+        return use(assign->name_, assign->binding_);
+    }
+    if (auto binary  = dynamic_cast<Binary* >(expr)) return resolve_chain(binary);
+    if (auto logical = dynamic_cast<Logical*>(expr)) return resolve_chain(logical);
+    if (auto call = dynamic_cast<Call*>(expr)) {
+        resolve(call->callee_);
+        for (auto argument: call->arguments_) resolve(argument);
+        return;
+    }
+    if (auto get = dynamic_cast<Get*>(expr)) return resolve(get->object_);
+    if (auto array = dynamic_cast<ArrayLiteral*>(expr)) {
+        for (auto element: array->elements_) resolve(element);
+        return;
+    }
+    if (auto index = dynamic_cast<Index*>(expr)) {
+        resolve(index->object_);
+        return resolve(index->index_);
+    }
+    if (auto set = dynamic_cast<SetIndex*>(expr)) {
+        resolve(set->object_);
+        resolve(set->index_);
+        return resolve(set->value_);
+    }
+    if (auto set = dynamic_cast<Set*>(expr)) {
+        resolve(set->value_);
+        return resolve(set->object_);
+    }
+
+    if (auto this_expr = dynamic_cast<This*>(expr)) {
+        if (class_ == NONE) return err::error(this_expr->keyword_, "Can't use 'this' outside of a class.");
+        return use(this_expr->keyword_, this_expr->binding_);
+    }
+    if (auto super = dynamic_cast<Super*>(expr)) {
+        if (class_ == NONE) return err::error(super->keyword_, "Can't use 'super' outside of a class.");
+        if (class_ != SUBCLASS) return err::error(super->keyword_, "Can't use 'super' in a class with no superclass.");
+        Token receiver{.type = THIS, .lexeme = "this", .literal = nullptr, .line = super->keyword_.line};
+        use(receiver, super->this_);
+        return use(super->keyword_, super->binding_);
+    }
+}
+
+template <typename Link>
+void Resolver::resolve_chain(Link* link) {
+    std::vector<Link*> links{link};
+    while (links.back()->chain_ > 1) links.push_back(static_cast<Link*>(links.back()->left_));
+
+    resolve(links.back()->left_);
+    for (auto it = links.rbegin(); it != links.rend(); it++) resolve((*it)->right_);
+}
+
+void Resolver::resolve_function(Function* function) {
+    // Declared before the body so the function can call itself. Methods are
+    // found through their class instead.
+    if (!function->method()) declare(function->name_, function->binding_);
+
+    functions_.push_back({.function = function});
+    functions_.back().blocks.emplace_back();
+    if (function->method()) {
+        Token receiver{.type = THIS, .lexeme = "this", .literal = nullptr, .line = function->name_.line};
+        declare(receiver, function->this_);
+    }
+    for (size_t i = 0; i < function->params_.size(); i++) declare(function->params_[i], function->parameters_[i]);
+    resolve(function->body_);
+    functions_.pop_back();
+}
+
+void Resolver::resolve_class(Class* klass) {
+    ClassKind enclosing = class_;
+    class_ = CLASS;
+    declare(klass->name_, klass->binding_);
+
+    if (klass->superclass_) {
+        if (klass->superclass_->name_.lexeme == klass->name_.lexeme) {
+            err::error(klass->superclass_->name_, "A class can't inherit from itself.");
+        }
+        class_ = SUBCLASS;
+        resolve(klass->superclass_);
+    }
+
+    // `super` is declared in a scope of its own around the methods.
+    bool scoped = klass->superclass_ && !functions_.empty();
+    int first_slot = scoped ? begin_block() : 0;
+    if (klass->superclass_ && !scoped) scopes_.emplace_back();
+    if (klass->superclass_) {
+        Token super{.type = SUPER, .lexeme = "super", .literal = nullptr, .line = klass->name_.line};
+        declare(super, klass->super_);
+    }
+
+    for (auto method: klass->methods_) resolve_function(method);
+
+    if (scoped) end_block(first_slot);
+    else if (klass->superclass_) scopes_.pop_back();
+    class_ = enclosing;
+}
+
+void Resolver::resolve_block(const std::vector<Stmt*>& stmts) {
+    int first_slot = begin_block();
+    resolve(stmts);
+    end_block(first_slot);
+}
+
+void Resolver::resolve_scope(const std::vector<Stmt*>& stmts, bool declares) {
+    if (declares) scopes_.emplace_back();
+    resolve(stmts);
+    if (declares) scopes_.pop_back();
+}
+
+int Resolver::begin_block() {
+    FunctionScope& scope = functions_.back();
+    scope.blocks.emplace_back();
+    return scope.next_slot;
+}
+
+void Resolver::end_block(int first_slot) {
+    // Sibling blocks reuse the slots; the frame covers the deepest nesting.
+    FunctionScope& scope = functions_.back();
+    scope.blocks.pop_back();
+    scope.next_slot = first_slot;
+}
+
+void Resolver::declare(const Token& name, Binding& binding) {
+    if (functions_.empty()) {
+        if (!scopes_.empty()) scopes_.back().insert(name.lexeme);
+        return;
+    }
+
+    FunctionScope& scope = functions_.back();
+    auto [it, inserted] = scope.blocks.back().try_emplace(name.lexeme, scope.locals.size());
+    if (inserted) {
+        scope.locals.push_back({.slot = scope.next_slot++});
+        scope.function->slots_ = std::max(scope.function->slots_, scope.next_slot);
+    }
+
+    Local& local = scope.locals[it->second];
+    binding = {local.captured ? Binding::CELL : Binding::LOCAL, local.slot};
+    local.bindings.push_back(&binding);
+}
+
+void Resolver::use(const Token& name, Binding& binding) {
+    if (functions_.empty()) return;
+
+    FunctionScope& scope = functions_.back();
+    if (int index = find_local(scope, name.lexeme); index >= 0) {
+        Local& local = scope.locals[index];
+        binding = {local.captured ? Binding::CELL : Binding::LOCAL, local.slot};
+        local.bindings.push_back(&binding);
+        return;
+    }
+
+    if (int cell = capture(functions_.size() - 1, name.lexeme); cell >= 0) {
+        binding = {Binding::UPVALUE, cell};
+        return;
+    }
+
+    // Found in the environment chain. A lookup by name finds the right
+    // variable unless a block between here and its declaration may still
+    // declare the name; only the scope of `super` can't.
+    int depth = scopes_.size();
+    bool shadowed = false;
+    for (; depth > 0 && !scopes_[depth - 1].contains(name.lexeme); depth--) {
+        if (!scopes_[depth - 1].contains("super")) shadowed = true;
+    }
+    if (shadowed) binding = {Binding::OUTER, depth};
+}
+
+int Resolver::find_local(FunctionScope& scope, const std::string& name) {
+    for (auto block = scope.blocks.rbegin(); block != scope.blocks.rend(); block++) {
+        auto it = block->find(name);
+        if (it != block->end()) return it->second;
+    }
+    return -1;
+}
+
+// Returns the index of `name` among the captures of `functions_[function]`,
+// adding it, and capturing it in every function in between, as needed.
+// Returns -1 when no enclosing function declares the name.
+int Resolver::capture(size_t function, const std::string& name) {
+    if (function == 0) return -1;
+
+    Function::Capture capture;
+    FunctionScope& enclosing = functions_[function - 1];
+    if (int index = find_local(enclosing, name); index >= 0) {
+        Local& local = enclosing.locals[index];
+        if (!local.captured) {
+            local.captured = true;
+            for (auto binding: local.bindings) binding->kind = Binding::CELL;
+        }
+        capture = {true, local.slot};
+    } else {
+        int cell = this->capture(function - 1, name);
+        if (cell < 0) return -1;
+        capture = {false, cell};
+    }
+
+    auto& captures = functions_[function].function->captures_;
+    for (size_t i = 0; i < captures.size(); i++) {
+        if (captures[i].local == capture.local && captures[i].index == capture.index) return i;
+    }
+    captures.push_back(capture);
+    return captures.size() - 1;
+}
+} // namespace lox
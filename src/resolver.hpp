@@ -0,0 +1,74 @@
+#pragma once
+
+#include "ast/statements.hpp"
+
+#include <unordered_map>
+#include <unordered_set>
+
+namespace lox {
+// Runs once over the parsed program. Parameters and variables declared inside
+// functions become call-frame slots; the ones a nested function refers to are
+// marked to live in a heap `Cell` that closures capture. Everything outside
+// functions is still looked up by name at run time, but functions declared in
+// blocks outside functions bind those blocks' names statically; see
+// Binding::OUTER.
+class Resolver {
+public:
+    Resolver() = default;
+    // Starts inside blocks outside functions that have declared `scopes`,
+    // outermost first.
+    explicit Resolver(std::vector<std::unordered_set<std::string>> scopes): scopes_(std::move(scopes)) {}
+
+    void resolve(const std::vector<Stmt*>&);
+    // Resolves the statements of a block skimmed outside functions; see
+    // Block::scopes_.
+    void resolve_skimmed(const std::vector<Stmt*>&);
+
+private:
+    struct Local {
+        int slot;
+        bool captured{false};
+        // Every binding of this declaration, so capturing it later can turn
+        // the ones already resolved into cell accesses.
+        std::vector<Binding*> bindings;
+    };
+
+    struct FunctionScope {
+        Function* function;
+        std::vector<Local> locals;
+        // Innermost block last; maps names to indices into `locals`.
+        std::vector<std::unordered_map<std::string, int>> blocks;
+        int next_slot{0};
+    };
+
+    enum ClassKind { NONE, CLASS, SUBCLASS };
+
+    std::vector<FunctionScope> functions_;
+    ClassKind class_{NONE};
+    // The blocks outside functions that run in an environment of their own,
+    // innermost last, with the names each has declared so far. The scope of
+    // `super` around a subclass's methods holds only that name.
+    std::vector<std::unordered_set<std::string>> scopes_;
+
+    void resolve(Stmt*);
+    void resolve(Expr*);
+    // Resolves the operands of an operator chain left to right, in a loop.
+    template <typename Link>
+    void resolve_chain(Link*);
+    void resolve_function(Function*);
+    void resolve_class(Class*);
+    void resolve_block(const std::vector<Stmt*>&);
+    // A block outside functions, in an environment of its own when it
+    // declares anything.
+    void resolve_scope(const std::vector<Stmt*>&, bool declares);
+
+    int  begin_block();
+    void   end_block(int first_slot);
+
+    void declare(const Token&, Binding&);
+    void     use(const Token&, Binding&);
+
+    int find_local(FunctionScope&, const std::string&);
+    int    capture(size_t function, const std::string&);
+};
+} // namespace lox
@@ -1,12 +1,17 @@
 #include "scanner.hpp"
 #include "errors.hpp"
+#include "allocation.hpp"
 
+#include <algorithm>
 #include <cctype>
+#include <charconv>
+#include <limits>
 
 namespace lox {
 std::map<TokenType, std::string> token_string = {
     {LEFT_PAREN, "LEFT_PAREN"}, {RIGHT_PAREN, "RIGHT_PAREN"},
     {LEFT_BRACE, "LEFT_BRACE"}, {RIGHT_BRACE, "RIGHT_BRACE"},
+    {LEFT_BRACKET, "LEFT_BRACKET"}, {RIGHT_BRACKET, "RIGHT_BRACKET"},
     {COMMA, "COMMA"}, {DOT, "DOT"},
     {MINUS, "MINUS"}, {PLUS, "PLUS"},
     {SEMICOLON, "SEMICOLON"}, {SLASH, "SLASH"},
@@ -22,7 +27,8 @@ std::map<TokenType, std::string> token_string = {
 
     {AND, "AND"}, {CLASS, "CLASS"}, {ELSE, "ELSE"},
     {FALSE, "FALSE"}, {FUN, "FUN"}, {FOR, "FOR"},
-    {IF, "IF"}, {NIL, "NIL"}, {OR, "OR"},
+    {IF, "IF"}, {IMPORT, "IMPORT"},
+    {NIL, "NIL"}, {OR, "OR"},
     {PRINT, "PRINT"}, {RETURN, "RETURN"},
     {SUPER, "SUPER"}, {THIS, "THIS"},
     {TRUE, "TRUE"}, {VAR, "VAR"}, {WHILE, "WHILE"},
@@ -30,10 +36,11 @@ std::map<TokenType, std::string> token_string = {
     {tk_EOF, "EOF"}
 };
 
-std::map<std::string, TokenType> keywords = {
+std::map<std::string, TokenType, std::less<>> keywords = {
     {"and", AND}, {"class", CLASS}, {"else", ELSE},
     {"false", FALSE}, {"for", FOR}, {"fun", FUN},
-    {"if", IF}, {"nil", NIL}, {"or", OR},
+    {"if", IF}, {"import", IMPORT},
+    {"nil", NIL}, {"or", OR},
     {"print", PRINT}, {"return", RETURN},
     {"super", SUPER}, {"this", THIS}, {"true", TRUE},
     {"var", VAR}, {"while", WHILE}
@@ -46,9 +53,66 @@ std::string trimmed_double(double value) {
     return vs;
 }
 
-void Scanner::addToken(TokenType type, std::any literal) {
-    std::string text = source_.substr(start_, current_ - start_);
-    tokens_.emplace_back(Token{type, text, literal, line_});
+int TokenStream::line(size_t i) const {
+    auto holds = [&](size_t run) {
+        return run < lines_.size() && lines_[run].first <= i && (run + 1 == lines_.size() || i < lines_[run + 1].first);
+    };
+    if (!holds(run_)) {
+        if (holds(run_ + 1)) run_++;
+        else run_ = std::upper_bound(lines_.begin(), lines_.end(), i, [](size_t i, const LineRun& run) { return i < run.first; })
+                  - lines_.begin() - 1;
+    }
+    return lines_[run_].line;
+}
+
+std::any TokenStream::literal(size_t i) const {
+    switch (type(i)) {
+        case STRING: {
+            std::string_view text = lexeme(i);
+            return std::string(text.substr(1, text.size() - 2));
+        }
+        case NUMBER:
+            return numbers_[std::lower_bound(number_tokens_.begin(), number_tokens_.end(), i) - number_tokens_.begin()];
+        default:
+            return nullptr;
+    }
+}
+
+std::string TokenStream::to_string(size_t i) const {
+    std::ostringstream out;
+    out << token_string[type(i)] << " " << lexeme(i) << " ";
+    switch (type(i)) {
+        case STRING: out << std::any_cast<std::string>(literal(i)); break;
+        case NUMBER: out << trimmed_double(std::any_cast<double>(literal(i))); break;
+        default:     out << "null"; break;
+    }
+    return out.str();
+}
+
+void TokenStream::add(TokenType type, size_t offset, size_t length, int line) {
+    if (lines_.empty() || lines_.back().line != line) lines_.push_back({uint32_t(size()), line});
+    types_.push_back(type);
+    offsets_.push_back(offset);
+    lengths_.push_back(length);
+}
+
+void TokenStream::add_number(size_t offset, size_t length, int line, double value) {
+    number_tokens_.push_back(size());
+    numbers_.push_back(value);
+    add(NUMBER, offset, length, line);
+}
+
+void TokenStream::shrink_to_fit() {
+    types_.shrink_to_fit();
+    offsets_.shrink_to_fit();
+    lengths_.shrink_to_fit();
+    lines_.shrink_to_fit();
+    number_tokens_.shrink_to_fit();
+    numbers_.shrink_to_fit();
+}
+
+void Scanner::addToken(TokenType type) {
+    tokens_.add(type, start_, current_ - start_, line_);
 }
 
 bool Scanner::match(char expected) {
@@ -81,9 +145,7 @@ void Scanner::string() {
     }
 
     advance(); // Close string
-
-    std::string value = source_.substr(start_ + 1, current_ - start_ - 2); // Trim
-    addToken(STRING, value);
+    addToken(STRING);
 }
 
 void Scanner::number() {
@@ -93,16 +155,22 @@ void Scanner::number() {
         while (::isdigit(peek())) advance();
     }
 
-    addToken(NUMBER, std::stod(source_.substr(start_, current_ - start_)));
+    const char* first = source_.data() + start_;
+    const char* last = source_.data() + current_;
+    double value = 0;
+    if (std::from_chars(first, last, value).ec == std::errc::result_out_of_range) {
+        // Too large, or too small to be told from zero, as strtod rounds it.
+        bool large = std::any_of(first, std::find(first, last, '.'), [](char digit) { return digit != '0'; });
+        value = large ? std::numeric_limits<double>::infinity() : 0;
+    }
+    tokens_.add_number(start_, current_ - start_, line_, value);
 }
 
 void Scanner::identifier() {
     while (::isalpha(peek()) || ::isdigit(peek()) || peek() == '_') advance();
 
-    std::string text = source_.substr(start_, current_ - start_);
-    TokenType type = keywords[text];
-    if (type == 0) type = IDENTIFIER;
-    addToken(type);
+    auto keyword = keywords.find(std::string_view(source_).substr(start_, current_ - start_));
+    addToken(keyword == keywords.end() ? IDENTIFIER : keyword->second);
 }
 
 void Scanner::scan_token() {
@@ -112,6 +180,8 @@ void Scanner::scan_token() {
         case ')': addToken(RIGHT_PAREN); break;
         case '{': addToken(LEFT_BRACE); break;
         case '}': addToken(RIGHT_BRACE); break;
+        case '[': addToken(LEFT_BRACKET); break;
+        case ']': addToken(RIGHT_BRACKET); break;
         case ',': addToken(COMMA); break;
         case '.': addToken(DOT); break;
         case '-': addToken(MINUS); break;
@@ -153,18 +223,16 @@ void Scanner::scan_token() {
     }
 }
 
-std::vector<Token> Scanner::scan_tokens() {
+TokenStream Scanner::scan_tokens() {
     while (!is_end()) {
         start_ = current_;
+        alloc::set_line(line_);
         scan_token();
     }
 
-    tokens_.emplace_back(Token{
-        .type    = tk_EOF, 
-        .lexeme  = "", 
-        .literal = nullptr, 
-        .line    = line_
-    });
-    return tokens_;
+    start_ = current_;
+    addToken(tk_EOF);
+    tokens_.shrink_to_fit();
+    return std::move(tokens_);
 }
 } // namespace lox
\ No newline at end of file
@@ -1,7 +1,9 @@
 #pragma once
 
 #include <any>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <sstream>
 #include <map>
 #include <vector>
@@ -12,6 +14,7 @@ namespace lox {
 enum TokenType {
      // Single-character tokens.
     LEFT_PAREN, RIGHT_PAREN, LEFT_BRACE, RIGHT_BRACE,
+    LEFT_BRACKET, RIGHT_BRACKET,
     COMMA, DOT, MINUS, PLUS, SEMICOLON, SLASH, STAR,
 
     // One or two character tokens.
@@ -24,49 +27,99 @@ enum TokenType {
     IDENTIFIER, STRING, NUMBER,
 
     // Keywords.
-    AND, CLASS, ELSE, FALSE, FUN, FOR, IF, NIL, OR,
+    AND, CLASS, ELSE, FALSE, FUN, FOR, IF, IMPORT, NIL, OR,
     PRINT, RETURN, SUPER, THIS, TRUE, VAR, WHILE,
 
     tk_EOF
 };
 
 extern std::map<TokenType, std::string> token_string;
-extern std::map<std::string, TokenType> keywords;
+extern std::map<std::string, TokenType, std::less<>> keywords;
 
 extern std::string trimmed_double(double);
 
+// An owning token, as the AST keeps them.
 struct Token {
-private:
-    std::string from_literal() {
-        if (IS_TYPE(literal, std::string)) return std::any_cast<std::string>(literal);
-        if (IS_TYPE(literal, double)) return trimmed_double(std::any_cast<double>(literal));
-        if (IS_TYPE(literal, std::nullptr_t)) return "null";
-        return "?";
-    }
-
-public:
     const TokenType type;
     const std::string lexeme;
     const std::any literal;
     const int line;
+};
+
+class TokenStream;
+
+// One token of a TokenStream, read in place: the lexeme points into the
+// stream's source. Converts to an owning Token where the AST needs one.
+struct TokenView {
+    const TokenStream* stream;
+    uint32_t index;
+    TokenType type;
+    std::string_view lexeme;
+    int line;
 
-    std::string to_string() {
-        std::ostringstream out;
-        out << token_string[type] << " "
-            << lexeme << " "
-            << from_literal();
-        return out.str();
-    }
+    std::any literal() const;
+    operator Token() const { return Token{type, std::string(lexeme), literal(), line}; }
 };
 
-class Scanner {
+// The scanner's output, stored as a structure of arrays: per token, a type
+// byte and the offset and length of its lexeme in the source. Lines are kept
+// once per run of tokens on the same line, and values only for NUMBER
+// tokens; a STRING's value is its lexeme without the quotes.
+class TokenStream {
 public:
-    Scanner(std::string source): source_(source) {}
+    TokenStream() = default;
+    explicit TokenStream(std::string source): source_(std::move(source)) {}
+
+    inline size_t size() const { return types_.size(); }
+    inline const std::string& source() const { return source_; }
+
+    inline TokenType type(size_t i) const { return TokenType(types_[i]); }
+    inline std::string_view lexeme(size_t i) const { return std::string_view(source_).substr(offsets_[i], lengths_[i]); }
+    int line(size_t i) const;
+    std::any literal(size_t i) const;
+
+    inline TokenView operator[](size_t i) const { return {this, uint32_t(i), type(i), lexeme(i), line(i)}; }
+
+    // The token as `tokenize` prints it.
+    std::string to_string(size_t i) const;
+
+    void add(TokenType, size_t offset, size_t length, int line);
+    void add_number(size_t offset, size_t length, int line, double value);
+    // Drops the spare capacity left from growing while scanning.
+    void shrink_to_fit();
 
-    std::vector<Token> scan_tokens();
 private:
+    static_assert(tk_EOF <= UINT8_MAX);
+
+    struct LineRun {
+        uint32_t first;
+        int line;
+    };
+
     std::string source_;
-    std::vector<Token> tokens_;
+    std::vector<uint8_t>  types_;
+    std::vector<uint32_t> offsets_;
+    std::vector<uint32_t> lengths_;
+    // Where each line's tokens start.
+    std::vector<LineRun> lines_;
+    // The run the last line() fell in; the parser asks in order.
+    mutable size_t run_{0};
+    // NUMBER tokens and their values, in token order.
+    std::vector<uint32_t> number_tokens_;
+    std::vector<double>   numbers_;
+};
+
+inline std::any TokenView::literal() const { return stream->literal(index); }
+
+class Scanner {
+public:
+    Scanner(std::string source): tokens_(std::move(source)), source_(tokens_.source()) {}
+
+    // Moves the tokens out; the scanner is done after this.
+    TokenStream scan_tokens();
+private:
+    TokenStream tokens_;
+    const std::string& source_;
 
     int start_{0};
     int current_{0};
@@ -74,8 +127,7 @@ private:
 
     void scan_token();
 
-           void addToken(TokenType, std::any);
-    inline void addToken(TokenType type) { addToken(type, nullptr); }
+    void addToken(TokenType);
 
     bool match(char);
     char peek();
@@ -0,0 +1,329 @@
+#include "snapshot.hpp"
+#include "array.hpp"
+#include "map.hpp"
+
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace lox::snapshot {
+namespace {
+// The file is a header followed by four sections, each starting on an 8-byte
+// boundary: global records, object records, value records for map entries,
+// and a blob of array elements and string bytes.
+constexpr char MAGIC[8] = {'L', 'O', 'X', 'S', 'N', 'A', 'P', '1'};
+constexpr uint32_t VERSION = 1;
+
+enum Kind: uint8_t { NIL, BOOL, NUMBER, STRING, ARRAY, MAP, NATIVE };
+
+std::string out_of_memory(const Heap& heap) {
+    return "Out of memory: heap limit of " + std::to_string(heap.options().limit) + " bytes exceeded.";
+}
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t globals;
+    uint32_t objects;
+    uint32_t values;
+    uint64_t blob;
+};
+
+// NUMBER keeps the double's bits in `bits`; BOOL keeps 0 or 1. STRING is
+// `length` bytes at blob offset `bits`, ARRAY and MAP an object index, and
+// NATIVE an index into natives::all.
+struct Value {
+    uint8_t kind;
+    uint8_t unused[3]{};
+    uint32_t length{0};
+    uint64_t bits{0};
+};
+
+struct Global {
+    uint64_t name;
+    uint32_t length;
+    uint32_t unused{0};
+    Value value;
+};
+
+// An ARRAY is `count` doubles at blob offset `offset`; a MAP is `count`
+// key/value pairs of Values starting at value index `offset`.
+struct Record {
+    uint8_t kind;
+    uint8_t unused[3]{};
+    uint32_t count;
+    uint64_t offset;
+};
+
+inline size_t aligned(size_t size) { return (size + 7) & ~size_t(7); }
+
+class Writer {
+public:
+    std::vector<Global> globals_;
+    std::vector<Record> records_;
+    std::vector<Value>  values_;
+    std::string blob_;
+    std::string error_;
+
+    void add(std::string_view name, const std::any& value) {
+        uint64_t offset = append(name.data(), name.size());
+        globals_.push_back({offset, uint32_t(name.size()), 0, encode(value)});
+        // Records for the objects this reaches are filled in here; each may
+        // queue more.
+        while (!pending_.empty()) {
+            auto [object, index] = pending_.back();
+            pending_.pop_back();
+            if (auto array = dynamic_cast<const Array*>(object)) {
+                blob_.resize(aligned(blob_.size()));
+                uint64_t first = append(array->values_.data(), array->values_.size() * sizeof(double));
+                records_[index] = {ARRAY, {}, uint32_t(array->values_.size()), first};
+            } else {
+                auto map = static_cast<const Map*>(object);
+                uint64_t first = values_.size();
+                records_[index] = {MAP, {}, uint32_t(map->count()), first};
+                values_.resize(values_.size() + 2 * map->count());
+                // encode() only queues objects, so these slots stay put.
+                uint64_t at = first;
+                for (size_t i = map->next(0); i < map->capacity(); i = map->next(i + 1)) {
+                    values_[at++] = encode(map->at(i)->key);
+                    values_[at++] = encode(map->at(i)->value);
+                }
+            }
+        }
+    }
+
+private:
+    std::unordered_map<const Object*, uint32_t> indices_;
+    std::vector<std::pair<const Object*, uint32_t>> pending_;
+
+    uint64_t append(const void* data, size_t size) {
+        uint64_t offset = blob_.size();
+        blob_.append(static_cast<const char*>(data), size);
+        return offset;
+    }
+
+    Value object(const Object* object) {
+        auto [it, inserted] = indices_.try_emplace(object, uint32_t(records_.size()));
+        if (inserted) {
+            records_.push_back({});
+            pending_.emplace_back(object, it->second);
+        }
+        return {dynamic_cast<const Array*>(object) ? ARRAY : MAP, {}, 0, it->second};
+    }
+
+    Value encode(const std::any& value) {
+        if (IS_TYPE(value, std::nullptr_t)) return {NIL};
+        if (auto boolean = std::any_cast<bool>(&value)) return {BOOL, {}, 0, *boolean};
+        if (auto number = std::any_cast<double>(&value)) return {NUMBER, {}, 0, std::bit_cast<uint64_t>(*number)};
+        if (auto string = std::any_cast<std::string>(&value)) {
+            return {STRING, {}, uint32_t(string->size()), append(string->data(), string->size())};
+        }
+        if (auto array = std::any_cast<Array*>(&value)) return object(*array);
+        if (auto map = std::any_cast<Map*>(&value)) return object(*map);
+        if (auto native = std::any_cast<const Native*>(&value)) {
+            for (size_t i = 0; i < natives::count; i++) {
+                if (natives::all[i] == *native) return {NATIVE, {}, 0, i};
+            }
+        }
+        if (error_.empty()) error_ = "Can't snapshot " + stringify(value) + ": only data values can be saved.";
+        return {NIL};
+    }
+};
+
+// A read-only mapping of a whole file, unmapped on destruction.
+class Mapping {
+public:
+    explicit Mapping(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                data_ = static_cast<const char*>(data);
+                size_ = info.st_size;
+            }
+        }
+        close(fd);
+    }
+    ~Mapping() { if (data_) munmap(const_cast<char*>(data_), size_); }
+
+    Mapping(const Mapping&) = delete;
+    Mapping& operator=(const Mapping&) = delete;
+
+    inline const char* data() const { return data_; }
+    inline size_t size() const { return size_; }
+
+private:
+    const char* data_{nullptr};
+    size_t size_{0};
+};
+
+class Reader {
+public:
+    Reader(const char* data, const Header& header): header_(header) {
+        size_t offset = aligned(sizeof(Header));
+        globals_ = reinterpret_cast<const Global*>(data + offset);
+        offset += aligned(header.globals * sizeof(Global));
+        records_ = reinterpret_cast<const Record*>(data + offset);
+        offset += aligned(header.objects * sizeof(Record));
+        values_ = reinterpret_cast<const Value*>(data + offset);
+        offset += aligned(header.values * sizeof(Value));
+        blob_ = data + offset;
+    }
+
+    static size_t size(const Header& header) {
+        return aligned(sizeof(Header)) + aligned(uint64_t(header.globals) * sizeof(Global))
+            + aligned(uint64_t(header.objects) * sizeof(Record)) + aligned(uint64_t(header.values) * sizeof(Value))
+            + header.blob;
+    }
+
+    // Allocates every object up front, so values can point at any of them,
+    // then fills them in and defines the globals.
+    std::string restore(Heap& heap, Environment& globals) {
+        objects_.reserve(header_.objects);
+        for (uint32_t i = 0; i < header_.objects; i++) {
+            Object* object = nullptr;
+            if (records_[i].kind == ARRAY) object = heap.make<Array>(heap.resource());
+            else if (records_[i].kind == MAP) object = heap.make<Map>(heap.resource());
+            else return release(heap, "Snapshot is corrupt.");
+            if (!object) return release(heap, out_of_memory(heap));
+            heap.push_root(object);
+            objects_.push_back(object);
+        }
+
+        for (uint32_t i = 0; i < header_.objects; i++) {
+            const Record& record = records_[i];
+            if (record.kind == ARRAY) {
+                if (record.offset % 8 || !in_blob(record.offset, uint64_t(record.count) * sizeof(double))) {
+                    return release(heap, "Snapshot is corrupt.");
+                }
+                auto& values = static_cast<Array*>(objects_[i])->values_;
+                if (!heap.make_room(record.count * sizeof(double))) return release(heap, out_of_memory(heap));
+                values.resize(record.count);
+                std::memcpy(values.data(), blob_ + record.offset, record.count * sizeof(double));
+            } else {
+                if (record.offset > header_.values || 2 * uint64_t(record.count) > header_.values - record.offset) {
+                    return release(heap, "Snapshot is corrupt.");
+                }
+                Map* map = static_cast<Map*>(objects_[i]);
+                for (uint32_t entry = 0; entry < record.count; entry++) {
+                    std::any key = decode(values_[record.offset + 2 * entry]);
+                    std::any value = decode(values_[record.offset + 2 * entry + 1]);
+                    if (corrupt_) return release(heap, "Snapshot is corrupt.");
+                    if (!heap.make_room(map->growth())) return release(heap, out_of_memory(heap));
+                    map->insert(key, std::move(value));
+                }
+            }
+        }
+
+        for (uint32_t i = 0; i < header_.globals; i++) {
+            const Global& global = globals_[i];
+            std::any value = decode(global.value);
+            if (corrupt_ || !in_blob(global.name, global.length)) return release(heap, "Snapshot is corrupt.");
+            globals.define(std::string(blob_ + global.name, global.length), value);
+        }
+        return release(heap, "");
+    }
+
+private:
+    const Header& header_;
+    const Global* globals_;
+    const Record* records_;
+    const Value*  values_;
+    const char*   blob_;
+
+    std::vector<Object*> objects_;
+    bool corrupt_{false};
+
+    inline bool in_blob(uint64_t offset, uint64_t length) const {
+        return offset <= header_.blob && length <= header_.blob - offset;
+    }
+
+    std::string release(Heap& heap, std::string error) {
+        for (size_t i = 0; i < objects_.size(); i++) heap.pop_root();
+        objects_.clear();
+        return error;
+    }
+
+    std::any decode(const Value& value) {
+        switch (value.kind) {
+            case NIL:    return nullptr;
+            case BOOL:   return value.bits != 0;
+            case NUMBER: return std::bit_cast<double>(value.bits);
+            case STRING:
+                if (in_blob(value.bits, value.length)) return std::string(blob_ + value.bits, value.length);
+                break;
+            case ARRAY:
+                if (value.bits < objects_.size() && records_[value.bits].kind == ARRAY) return static_cast<Array*>(objects_[value.bits]);
+                break;
+            case MAP:
+                if (value.bits < objects_.size() && records_[value.bits].kind == MAP) return static_cast<Map*>(objects_[value.bits]);
+                break;
+            case NATIVE:
+                if (value.bits < natives::count) return natives::all[value.bits];
+                break;
+        }
+        corrupt_ = true;
+        return nullptr;
+    }
+};
+
+void write(std::ofstream& file, const void* data, size_t size) {
+    file.write(static_cast<const char*>(data), size);
+    static const char zeros[8] = {};
+    file.write(zeros, aligned(size) - size);
+}
+} // namespace
+
+std::string save(Interpreter& interpreter, const std::string& path) {
+    Writer writer;
+    interpreter.globals().for_each([&](std::string_view name, const std::any& value) {
+        // The natives are defined anew by every interpreter.
+        auto native = std::any_cast<const Native*>(&value);
+        if (native && name == (*native)->name) return;
+        writer.add(name, value);
+    });
+    if (!writer.error_.empty()) return writer.error_;
+
+    Header header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.globals = uint32_t(writer.globals_.size());
+    header.objects = uint32_t(writer.records_.size());
+    header.values  = uint32_t(writer.values_.size());
+    header.blob    = writer.blob_.size();
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    write(file, &header, sizeof(header));
+    write(file, writer.globals_.data(), writer.globals_.size() * sizeof(Global));
+    write(file, writer.records_.data(), writer.records_.size() * sizeof(Record));
+    write(file, writer.values_.data(), writer.values_.size() * sizeof(Value));
+    file.write(writer.blob_.data(), writer.blob_.size());
+    if (!file) return "Could not write snapshot '" + path + "'.";
+    return "";
+}
+
+std::string load(Interpreter& interpreter, const std::string& path) {
+    // An interpreter without globals reports why when it is run.
+    if (interpreter.had_runtime_error()) return "";
+    Mapping mapping(path);
+    if (!mapping.data()) return "Could not read snapshot '" + path + "'.";
+
+    const Header& header = *reinterpret_cast<const Header*>(mapping.data());
+    if (mapping.size() < sizeof(Header) || std::memcmp(mapping.data(), MAGIC, sizeof(MAGIC)) != 0) {
+        return "'" + path + "' is not a snapshot.";
+    }
+    if (header.version != VERSION) return "Snapshot '" + path + "' is from an incompatible version.";
+    if (header.blob > mapping.size() || Reader::size(header) != mapping.size()) return "Snapshot is corrupt.";
+
+    return Reader(mapping.data(), header).restore(interpreter.heap(), interpreter.globals());
+}
+} // namespace lox::snapshot
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "interpreter.hpp"
+
+#include <string>
+
+// Snapshots of a program's globals, so a prelude can run once and later runs
+// start from its results. A snapshot holds nil, booleans, numbers, strings,
+// arrays, maps and natives, shared and cyclic references included. Functions
+// and classes point into the prelude's AST and can't be saved.
+//
+// The file is fixed-size records and a byte blob, read in place through
+// mmap: no scanning or parsing, and each array is one copy into the heap.
+namespace lox::snapshot {
+// Writes the globals defined in `interpreter`, and everything they reach,
+// to `path`. Returns an error message, or an empty string.
+std::string save(Interpreter& interpreter, const std::string& path);
+
+// Defines the snapshot's globals in `interpreter`'s global scope. Returns an
+// error message, or an empty string.
+std::string load(Interpreter& interpreter, const std::string& path);
+} // namespace lox::snapshot
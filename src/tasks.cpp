@@ -0,0 +1,539 @@
+#include "tasks.hpp"
+#include "closure.hpp"
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+namespace lox {
+namespace {
+// Collects what a task prints and writes it to the shared stream a whole line
+// at a time, when `print` flushes.
+class LineBuffer: public std::streambuf {
+public:
+    LineBuffer(std::ostream& out, std::mutex& mutex): out_(out), mutex_(mutex) {}
+
+protected:
+    int_type overflow(int_type c) override {
+        if (!traits_type::eq_int_type(c, traits_type::eof())) line_ += traits_type::to_char_type(c);
+        return traits_type::not_eof(c);
+    }
+
+    std::streamsize xsputn(const char* text, std::streamsize count) override {
+        line_.append(text, count);
+        return count;
+    }
+
+    int sync() override {
+        if (line_.empty()) return 0;
+        std::lock_guard lock(mutex_);
+        out_.write(line_.data(), line_.size());
+        out_.flush();
+        line_.clear();
+        return 0;
+    }
+
+private:
+    std::ostream& out_;
+    std::mutex& mutex_;
+    std::string line_;
+};
+
+// A native stack above a guard page, so that overflowing it crashes instead
+// of overwriting whatever lies below.
+struct Stack {
+    char* memory{nullptr};
+    size_t size{0};
+};
+
+size_t page_size() {
+    static const size_t size = sysconf(_SC_PAGESIZE);
+    return size;
+}
+
+Stack allocate_stack(size_t size) {
+    size_t page = page_size();
+    size = (size + page - 1) / page * page + page;
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+    if (memory == MAP_FAILED) return {};
+    mprotect(memory, page, PROT_NONE);
+    return {static_cast<char*>(memory), size};
+}
+
+// Values another task can use as they are.
+bool sendable(const std::any& value) {
+    return IS_TYPE(value, std::nullptr_t) || IS_TYPE(value, bool) || IS_TYPE(value, double) ||
+           IS_TYPE(value, std::string) || IS_TYPE(value, Channel*) || IS_TYPE(value, const Native*);
+}
+
+// The declaration of a function declared at the top level of `owner`'s
+// program, which another task can rebuild around its own globals.
+Function* top_level(const std::any& value, Interpreter& owner) {
+    auto closure = std::any_cast<Closure*>(&value);
+    if (!closure || !(*closure)->cells_.empty() || (*closure)->environment_ != &owner.globals()) return nullptr;
+    return (*closure)->declaration_;
+}
+
+// Stands in a task's copied globals for `Task::classes[index]`.
+struct ClassCopy {
+    size_t index;
+};
+
+std::string out_of_memory(const Heap& heap) {
+    return "Out of memory: heap limit of " + std::to_string(heap.options().limit) + " bytes exceeded.";
+}
+} // namespace
+
+struct Worker {
+    std::mutex mutex;
+    std::deque<Task*> queue;
+    // Waited on, with the scheduler's mutex, while there is nothing to run.
+    std::condition_variable wakeup;
+    bool sleeping{false};
+
+    // The scheduling loop, while one of its tasks runs.
+    ucontext_t context;
+    // Stacks of finished tasks, for new ones to start on.
+    std::vector<Stack> stacks;
+};
+
+struct Task {
+    Task(Scheduler& scheduler, size_t id, std::ostream& out, std::mutex& output)
+        : scheduler(scheduler), id(id), buffer(out, output), out(&buffer) {}
+
+    Scheduler& scheduler;
+    size_t id;
+    LineBuffer buffer;
+    std::ostream out;
+    // Created when the task starts.
+    std::unique_ptr<Interpreter> interpreter;
+
+    // The first task runs the program; the others call a function. Functions
+    // declared at the top level are held as their declarations until then.
+    const std::vector<Stmt*>* program{nullptr};
+    std::vector<std::pair<std::string, std::any>> globals;
+    // Classes declared at the top level, as their declarations, each after
+    // its superclass, which `superclass` indexes.
+    struct SharedClass {
+        Class* declaration;
+        size_t superclass;
+    };
+    std::vector<SharedClass> classes;
+    std::any callee;
+    std::vector<std::any> arguments;
+    int line{0};
+
+    // Set when the task starts; from then on it only runs there.
+    Worker* home{nullptr};
+    Stack stack;
+    ucontext_t context;
+    bool done{false};
+
+    // Handed over by `send` while the task waits in `receive`.
+    std::any received;
+    // Why the native the task is suspended in should fail, if it should.
+    std::string interrupt;
+};
+
+namespace {
+// The task running on this thread. Natives read it before they suspend, and
+// a task only ever resumes on the thread it suspended on.
+thread_local Task* current = nullptr;
+
+void enter() {
+    Task* task = current;
+    if (task->program) task->interpreter->run(*task->program);
+    else task->interpreter->run_call(task->callee, task->arguments, task->line);
+    task->done = true;
+}
+} // namespace
+
+struct TaskNatives {
+    static constexpr size_t NO_CLASS = SIZE_MAX;
+
+    // Adds `klass` and its superclasses to the classes `task` rebuilds and
+    // returns its index, or NO_CLASS when one of them wasn't declared at the
+    // top level.
+    static size_t share(LoxClass* klass, Task& task, std::unordered_map<LoxClass*, size_t>& shared) {
+        if (!klass->declaration_) return NO_CLASS;
+        if (auto it = shared.find(klass); it != shared.end()) return it->second;
+
+        size_t superclass = NO_CLASS;
+        if (klass->superclass_ && (superclass = share(klass->superclass_, task, shared)) == NO_CLASS) return NO_CLASS;
+        task.classes.push_back({klass->declaration_, superclass});
+        return shared[klass] = task.classes.size() - 1;
+    }
+
+    static std::any spawn(NativeCall& call) {
+        Task* spawner = current;
+        Scheduler& scheduler = spawner->scheduler;
+        Interpreter& from = *spawner->interpreter;
+
+        if (call.count == 0) return call.fail("Expected a function to spawn.");
+        const std::any& callee = call.arguments[0];
+        Function* function = top_level(callee, from);
+        auto native = std::any_cast<const Native*>(&callee);
+        if (!function && !native) return call.fail("Can only spawn functions declared at the top level.");
+
+        // Checked here, where an error has a line to report.
+        int arity = function ? function->arity() : (*native)->arity;
+        if (arity >= 0 && size_t(arity) != call.count - 1) {
+            return call.fail("Expected " + std::to_string(arity) + " arguments but got " + std::to_string(call.count - 1) + ".");
+        }
+        for (size_t i = 1; i < call.count; i++) {
+            if (!sendable(call.arguments[i])) return call.fail("Only nil, booleans, numbers, strings and channels can be passed to a task.");
+        }
+
+        // What the task will find in its globals, copied now; functions and
+        // classes are rebuilt from their declarations when it starts.
+        std::unique_ptr<Task> task = scheduler.make_task();
+        std::unordered_map<LoxClass*, size_t> shared;
+        from.globals().for_each([&](std::string_view name, const std::any& value) {
+            if (sendable(value)) task->globals.emplace_back(name, value);
+            else if (Function* declaration = top_level(value, from)) task->globals.emplace_back(name, declaration);
+            else if (auto klass = std::any_cast<LoxClass*>(&value)) {
+                size_t index = share(*klass, *task, shared);
+                if (index != NO_CLASS) task->globals.emplace_back(name, ClassCopy{index});
+            }
+        });
+        if (function) task->callee = function;
+        else task->callee = callee;
+        task->arguments.assign(call.arguments + 1, call.arguments + call.count);
+        // The statement that called `spawn`, as tracked for the memory profiler.
+        task->line = alloc::current.line;
+        scheduler.submit(std::move(task), *spawner->home);
+        return nullptr;
+    }
+
+    static std::any yield(NativeCall& call) {
+        Task* task = current;
+        task->scheduler.push(task, *task->home);
+
+        std::string message;
+        if (!task->scheduler.suspend(task, message)) return call.fail(message);
+        return nullptr;
+    }
+
+    static std::any channel(NativeCall&) {
+        Scheduler& scheduler = current->scheduler;
+        std::lock_guard lock(scheduler.mutex_);
+        return scheduler.channels_.emplace_back(std::make_unique<Channel>()).get();
+    }
+
+    static std::any send(NativeCall& call) {
+        auto channel = std::any_cast<Channel*>(&call.arguments[0]);
+        if (!channel) return call.fail("Argument to 'send' must be a channel.");
+        if (!sendable(call.arguments[1])) return call.fail("Only nil, booleans, numbers, strings and channels can be sent.");
+
+        std::unique_lock lock((*channel)->mutex_);
+        auto& receivers = (*channel)->receivers_;
+        if (receivers.empty()) {
+            (*channel)->values_.push_back(call.arguments[1]);
+            return nullptr;
+        }
+
+        Task* receiver = receivers.front();
+        receivers.pop_front();
+        receiver->received = call.arguments[1];
+        lock.unlock();
+
+        current->scheduler.push(receiver, *receiver->home);
+        return nullptr;
+    }
+
+    static std::any receive(NativeCall& call) {
+        auto channel = std::any_cast<Channel*>(&call.arguments[0]);
+        if (!channel) return call.fail("Argument to 'receive' must be a channel.");
+
+        Task* task = current;
+        std::unique_lock lock((*channel)->mutex_);
+        auto& values = (*channel)->values_;
+        if (!values.empty()) {
+            std::any value = std::move(values.front());
+            values.pop_front();
+            return value;
+        }
+
+        // Checked under the channel's lock, which cancelling takes to wake
+        // the tasks waiting on it.
+        if (task->scheduler.cancelled_) return call.fail("Cancelled.");
+        (*channel)->receivers_.push_back(task);
+        lock.unlock();
+
+        std::string message;
+        if (!task->scheduler.suspend(task, message)) return call.fail(message);
+        return std::exchange(task->received, std::any());
+    }
+};
+
+namespace {
+const Native spawn  {"spawn",   -1, TaskNatives::spawn};
+const Native yield  {"yield",    0, TaskNatives::yield};
+const Native channel{"channel",  0, TaskNatives::channel};
+const Native send   {"send",     2, TaskNatives::send};
+const Native receive{"receive",  1, TaskNatives::receive};
+
+const Native* const task_natives[] = {&spawn, &yield, &channel, &send, &receive};
+} // namespace
+
+Scheduler::Scheduler(InterpreterOptions options, uint32_t sites, TaskOptions tasks)
+    : options_(options), sites_(sites), tasks_(tasks) {
+    for (size_t i = 0; i < std::max<size_t>(tasks.workers, 1); i++) workers_.push_back(std::make_unique<Worker>());
+}
+
+Scheduler::~Scheduler() {
+    for (auto& worker: workers_) {
+        for (auto stack: worker->stacks) munmap(stack.memory, stack.size);
+    }
+}
+
+void Scheduler::run(const std::vector<Stmt*>& program) {
+    std::unique_ptr<Task> task = make_task();
+    task->program = &program;
+    submit(std::move(task), *workers_[0]);
+
+    for (size_t i = 1; i < workers_.size(); i++) threads_.emplace_back([this, i] { work(*workers_[i]); });
+    work(*workers_[0]);
+    for (auto& thread: threads_) thread.join();
+    threads_.clear();
+}
+
+std::unique_ptr<Task> Scheduler::make_task() {
+    return std::make_unique<Task>(*this, next_id_++, *options_.out, output_);
+}
+
+void Scheduler::submit(std::unique_ptr<Task> task, Worker& worker) {
+    {
+        std::lock_guard lock(mutex_);
+        live_++;
+    }
+    push(task.release(), worker);
+}
+
+void Scheduler::work(Worker& self) {
+    while (Task* task = next(self)) {
+        if (!task->home) {
+            if (cancelled_) {
+                finish(task, self);
+                continue;
+            }
+            if (!start(task, self)) {
+                finish(task, self);
+                continue;
+            }
+        }
+
+        current = task;
+        swapcontext(&self.context, &task->context);
+        current = nullptr;
+
+        if (task->done) finish(task, self);
+    }
+}
+
+Task* Scheduler::next(Worker& self) {
+    while (true) {
+        {
+            std::lock_guard lock(self.mutex);
+            if (!self.queue.empty()) {
+                Task* task = self.queue.front();
+                self.queue.pop_front();
+                if (!task->home) fresh_--;
+                return task;
+            }
+        }
+        if (Task* task = steal(self)) return task;
+
+        std::unique_lock lock(mutex_);
+        if (live_ == 0) return nullptr;
+        {
+            std::lock_guard queue(self.mutex);
+            if (fresh_ > 0 || !self.queue.empty()) continue;
+        }
+
+        // With every worker idle, the tasks left are all waiting to receive.
+        self.sleeping = true;
+        if (++idle_ == workers_.size()) interrupt("Deadlock: every task is waiting to receive.", false);
+        self.wakeup.wait(lock, [&] { return !self.sleeping || live_ == 0; });
+        if (self.sleeping) {
+            self.sleeping = false;
+            idle_--;
+        }
+    }
+}
+
+Task* Scheduler::steal(Worker& self) {
+    if (fresh_ == 0) return nullptr;
+
+    size_t index = std::find_if(workers_.begin(), workers_.end(), [&](auto& worker) { return worker.get() == &self; }) - workers_.begin();
+    for (size_t i = 1; i < workers_.size(); i++) {
+        Worker& victim = *workers_[(index + i) % workers_.size()];
+        std::lock_guard lock(victim.mutex);
+        // The newest task that has not started.
+        auto it = std::find_if(victim.queue.rbegin(), victim.queue.rend(), [](Task* task) { return !task->home; });
+        if (it == victim.queue.rend()) continue;
+
+        Task* task = *it;
+        victim.queue.erase(std::next(it).base());
+        fresh_--;
+        return task;
+    }
+    return nullptr;
+}
+
+bool Scheduler::start(Task* task, Worker& self) {
+    InterpreterOptions options = options_;
+    options.out = &task->out;
+    options.cancel = &cancelled_;
+    task->interpreter = std::make_unique<Interpreter>(options);
+    Interpreter& interpreter = *task->interpreter;
+    if (interpreter.had_runtime_error()) {
+        fail(*interpreter.error());
+        return false;
+    }
+    interpreter.isolate_caches(sites_);
+    for (auto native: task_natives) interpreter.globals().define(native->name, native);
+
+    // Each closure is reachable from the globals, or from the callee, as soon
+    // as it is made, so a collection cannot free the ones made before it.
+    Heap& heap = interpreter.heap();
+    auto closure = [&](std::any& value) {
+        auto declaration = std::any_cast<Function*>(&value);
+        if (!declaration) return true;
+        Closure* closure = heap.make<Closure>(*declaration, &interpreter.globals(), heap.resource());
+        if (closure) value = closure;
+        return closure != nullptr;
+    };
+    // Classes are rooted until they are defined, since a superclass may not
+    // be a global of its own.
+    std::vector<LoxClass*> classes;
+    bool built = true;
+    for (const auto& shared: task->classes) {
+        LoxClass* superclass = shared.superclass == TaskNatives::NO_CLASS ? nullptr : classes[shared.superclass];
+        LoxClass* klass = interpreter.rebuild_class(shared.declaration, superclass);
+        if (!(built = klass != nullptr)) break;
+        heap.push_root(klass);
+        classes.push_back(klass);
+    }
+    for (auto& [name, value]: task->globals) {
+        if (!built) break;
+        if (auto copy = std::any_cast<ClassCopy>(&value)) value = classes[copy->index];
+        else if (!(built = closure(value))) break;
+        interpreter.globals().define(name, value);
+    }
+    for (size_t i = 0; i < classes.size(); i++) heap.pop_root();
+    task->globals.clear();
+    task->classes.clear();
+    if (!built || !closure(task->callee)) {
+        fail(RuntimeError(task->line, out_of_memory(heap)));
+        return false;
+    }
+
+    if (self.stacks.empty()) {
+        Stack stack = allocate_stack(tasks_.stack_size);
+        if (!stack.memory) {
+            fail(RuntimeError(task->line, "Out of memory: can't allocate a stack for a task."));
+            return false;
+        }
+        self.stacks.push_back(stack);
+    }
+    task->stack = self.stacks.back();
+    self.stacks.pop_back();
+    task->home = &self;
+
+    getcontext(&task->context);
+    task->context.uc_stack.ss_sp = task->stack.memory + page_size();
+    task->context.uc_stack.ss_size = task->stack.size - page_size();
+    task->context.uc_link = &self.context;
+    makecontext(&task->context, enter, 0);
+    return true;
+}
+
+void Scheduler::finish(Task* task, Worker& self) {
+    if (task->interpreter && task->interpreter->error()) fail(*task->interpreter->error());
+
+    // A few stacks are kept for reuse; their pages stay committed.
+    if (task->stack.memory && self.stacks.size() < 16) self.stacks.push_back(task->stack);
+    else if (task->stack.memory) munmap(task->stack.memory, task->stack.size);
+    delete task;
+
+    std::lock_guard lock(mutex_);
+    if (--live_ == 0) for (auto& worker: workers_) worker->wakeup.notify_all();
+}
+
+void Scheduler::push(Task* task, Worker& worker) {
+    bool fresh = !task->home;
+    if (fresh) fresh_++;
+    {
+        std::lock_guard lock(worker.mutex);
+        worker.queue.push_back(task);
+    }
+
+    std::lock_guard lock(mutex_);
+    if (worker.sleeping || !fresh) return wake(worker);
+    // Someone idle can take the new task.
+    for (auto& other: workers_) if (other->sleeping) return wake(*other);
+}
+
+void Scheduler::wake(Worker& worker) {
+    if (!worker.sleeping) return;
+    worker.sleeping = false;
+    idle_--;
+    worker.wakeup.notify_one();
+}
+
+bool Scheduler::suspend(Task* task, std::string& message) {
+    swapcontext(&task->context, &task->home->context);
+
+    message = std::exchange(task->interrupt, std::string());
+    if (message.empty() && cancelled_) message = "Cancelled.";
+    return message.empty();
+}
+
+void Scheduler::fail(const RuntimeError& error) {
+    std::lock_guard lock(mutex_);
+    if (error_) return;
+    error_.emplace(error);
+    cancelled_ = true;
+    interrupt("Cancelled.", true);
+}
+
+void Scheduler::interrupt(const std::string& message, bool all) {
+    auto resume = [&](Task* task) {
+        task->interrupt = message;
+        {
+            std::lock_guard lock(task->home->mutex);
+            task->home->queue.push_back(task);
+        }
+        wake(*task->home);
+    };
+
+    Task* oldest = nullptr;
+    Channel* waiting = nullptr;
+    for (auto& channel: channels_) {
+        std::lock_guard lock(channel->mutex_);
+        if (all) {
+            for (Task* task: channel->receivers_) resume(task);
+            channel->receivers_.clear();
+            continue;
+        }
+        for (Task* task: channel->receivers_) {
+            if (!oldest || task->id < oldest->id) {
+                oldest = task;
+                waiting = channel.get();
+            }
+        }
+    }
+    if (!oldest) return;
+
+    // Every worker is idle, so nothing else touches the channel meanwhile.
+    auto& receivers = waiting->receivers_;
+    receivers.erase(std::find(receivers.begin(), receivers.end(), oldest));
+    resume(oldest);
+}
+} // namespace lox
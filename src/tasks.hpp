@@ -0,0 +1,119 @@
+#pragma once
+
+#include "interpreter.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+// Lightweight tasks for `run --tasks`. The program runs as the first task and
+// may start more with the natives
+//
+//     spawn(f, arguments...)   runs f(arguments...) as a new task
+//     yield()                  lets other tasks run
+//     channel()                a new, unbounded channel
+//     send(c, value)           queues value on c
+//     receive(c)               takes the oldest value from c, waiting for one
+//
+// Every task has its own interpreter, with its own heap, globals and native
+// stack, so tasks share no mutable state. A spawned task starts from a copy of
+// its spawner's globals: nil, booleans, numbers, strings, channels, and
+// functions and classes declared at the top level are copied, and anything
+// else is left out. Only the values that can be copied may be passed to `spawn` or sent.
+//
+// Tasks are scheduled M:N onto worker threads, each with its own run queue.
+// An idle worker steals from the others, but only tasks that have not started
+// yet: a started task stays on the thread it started on, because compiled
+// code may keep thread-local addresses across the switch.
+namespace lox {
+struct Task;
+struct Worker;
+
+struct Channel {
+    std::mutex mutex_;
+    std::deque<std::any> values_;
+    // Tasks waiting in `receive`, oldest first.
+    std::deque<Task*> receivers_;
+};
+
+struct TaskOptions {
+    // Worker threads, the calling one included.
+    size_t workers{1};
+    // The native stack of each task, which the interpreter's recursion runs
+    // on. Pages are only committed as they are touched.
+    size_t stack_size{size_t(8) << 20};
+};
+
+class Scheduler {
+public:
+    // `sites` is the program's number of inline cache sites; every task keeps
+    // its own caches.
+    Scheduler(InterpreterOptions options, uint32_t sites, TaskOptions tasks = {});
+    ~Scheduler();
+
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    // Runs `program` and every task it spawns, and returns once all of them
+    // have finished. The first runtime error cancels the tasks still running.
+    void run(const std::vector<Stmt*>& program);
+
+    inline const std::optional<RuntimeError>& error() const { return error_; }
+
+private:
+    friend struct TaskNatives;
+
+    InterpreterOptions options_;
+    uint32_t sites_;
+    TaskOptions tasks_;
+
+    // Serializes whole lines of output from tasks on different threads.
+    std::mutex output_;
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+
+    // Guards the counts below, idle workers and the list of channels.
+    std::mutex mutex_;
+    size_t live_{0};
+    size_t idle_{0};
+    std::vector<std::unique_ptr<Channel>> channels_;
+    std::atomic<size_t> next_id_{0};
+    // Queued tasks that have not started, which any worker may take.
+    std::atomic<size_t> fresh_{0};
+
+    std::atomic<bool> cancelled_{false};
+    std::optional<RuntimeError> error_;
+
+    std::unique_ptr<Task> make_task();
+    void submit(std::unique_ptr<Task>, Worker&);
+
+    void work(Worker&);
+    Task* next(Worker&);
+    Task* steal(Worker&);
+    // Builds the task's interpreter and gives it a stack on `worker`; false,
+    // after failing the run, when either runs out of memory.
+    bool start(Task*, Worker&);
+    void finish(Task*, Worker&);
+
+    // Queues a task that has not started on `worker`, or a started one on its
+    // own worker.
+    void push(Task*, Worker&);
+    // With `mutex_` held.
+    void wake(Worker&);
+    // Switches from the running task back to its worker. Returns false, with
+    // the error to raise in `message`, when the task was resumed to fail.
+    bool suspend(Task*, std::string& message);
+
+    void fail(const RuntimeError&);
+    // Resumes tasks waiting in `receive` to fail with `message`: all of them
+    // once cancelled, the oldest one when every task is waiting. With `mutex_`
+    // held.
+    void interrupt(const std::string& message, bool all);
+};
+} // namespace lox
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "scanner.hpp"
+#include "instance.hpp"
+#include "array.hpp"
+#include "map.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+namespace lox {
+// Shared between tasks and owned by their scheduler; see tasks.hpp.
+struct Channel;
+
+inline bool is_truthy(const std::any& value) {
+    if (IS_TYPE(value, std::nullptr_t)) return false;
+    if (IS_TYPE(value, bool)) return std::any_cast<bool>(value);
+    return true;
+}
+
+inline bool is_equal(const std::any& left, const std::any& right) {
+    if (left.type().name() != right.type().name()) return false;
+
+    if (IS_TYPE(left, std::nullptr_t)) return true;
+    if (IS_TYPE(left,           bool)) return std::any_cast<       bool>(left) == std::any_cast<       bool>(right);
+    if (IS_TYPE(left,         double)) return std::any_cast<     double>(left) == std::any_cast<     double>(right);
+    if (IS_TYPE(left,    std::string)) return std::any_cast<std::string>(left) == std::any_cast<std::string>(right);
+    if (IS_TYPE(left,       Closure*)) return std::any_cast<   Closure*>(left) == std::any_cast<   Closure*>(right);
+    if (IS_TYPE(left,  const Native*)) return std::any_cast<const Native*>(left) == std::any_cast<const Native*>(right);
+    if (IS_TYPE(left,      LoxClass*)) return std::any_cast<  LoxClass*>(left) == std::any_cast<  LoxClass*>(right);
+    if (IS_TYPE(left,      Instance*)) return std::any_cast<  Instance*>(left) == std::any_cast<  Instance*>(right);
+    if (IS_TYPE(left,   BoundMethod*)) return std::any_cast<BoundMethod*>(left) == std::any_cast<BoundMethod*>(right);
+    if (IS_TYPE(left,         Array*)) return std::any_cast<     Array*>(left) == std::any_cast<     Array*>(right);
+    if (IS_TYPE(left,           Map*)) return std::any_cast<       Map*>(left) == std::any_cast<       Map*>(right);
+    if (IS_TYPE(left,       Channel*)) return std::any_cast<   Channel*>(left) == std::any_cast<   Channel*>(right);
+    if (IS_TYPE(left,        Module*)) return std::any_cast<    Module*>(left) == std::any_cast<    Module*>(right);
+
+    return false;
+}
+
+// Large enough for "%f" of any double.
+using NumberBuffer = char[352];
+
+// Runtime number formatting: integral values print without a fractional part.
+// Formats into `buffer` so printing numbers does not allocate.
+inline std::string_view format_number(double value, NumberBuffer& buffer) {
+    std::string_view vs(buffer, std::snprintf(buffer, sizeof(NumberBuffer), "%f", value));
+    vs = vs.substr(0, vs.find_last_not_of('0') + 1);
+    if (vs.back() == '.') vs.remove_suffix(1);
+    return vs;
+}
+
+inline std::string number_to_string(double value) {
+    NumberBuffer buffer;
+    return std::string(format_number(value, buffer));
+}
+
+inline std::string stringify(const Array& array) {
+    std::string text = "[";
+    NumberBuffer buffer;
+    for (size_t i = 0; i < array.values_.size(); i++) {
+        if (i) text += ", ";
+        text += format_number(array.values_[i], buffer);
+    }
+    return text + "]";
+}
+
+inline std::string stringify(const std::any& value);
+
+// Entries in slot order. A map that is already being printed further up
+// shows as {...}, so cycles terminate.
+inline std::string stringify(const Map& map) {
+    thread_local std::vector<const Map*> open;
+    if (std::find(open.begin(), open.end(), &map) != open.end()) return "{...}";
+
+    open.push_back(&map);
+    std::string text = "{";
+    for (size_t i = map.next(0); i < map.capacity(); i = map.next(i + 1)) {
+        if (text.size() > 1) text += ", ";
+        text += stringify(map.at(i)->key) + ": " + stringify(map.at(i)->value);
+    }
+    open.pop_back();
+    return text + "}";
+}
+
+inline std::string stringify(const std::any& value) {
+    if (IS_TYPE(value, std::nullptr_t)) return "nil";
+    if (IS_TYPE(value, std::string)) return std::any_cast<std::string>(value);
+    if (IS_TYPE(value, double)) return number_to_string(std::any_cast<double>(value));
+    if (IS_TYPE(value, bool)) return std::any_cast<bool>(value) ? "true" : "false";
+    if (IS_TYPE(value, Closure*)) return "<fn " + std::any_cast<Closure*>(value)->name() + ">";
+    if (IS_TYPE(value, const Native*)) return "<native fn>";
+    if (IS_TYPE(value, LoxClass*)) return std::string(std::any_cast<LoxClass*>(value)->name_);
+    if (IS_TYPE(value, Instance*)) return std::string(std::any_cast<Instance*>(value)->class_->name_) + " instance";
+    if (IS_TYPE(value, BoundMethod*)) return "<fn " + std::any_cast<BoundMethod*>(value)->method_->name() + ">";
+    if (IS_TYPE(value, Array*)) return stringify(*std::any_cast<Array*>(value));
+    if (IS_TYPE(value, Map*)) return stringify(*std::any_cast<Map*>(value));
+    if (IS_TYPE(value, Channel*)) return "<channel>";
+    if (IS_TYPE(value, Module*)) return "<module " + std::any_cast<Module*>(value)->name_ + ">";
+    return "?";
+}
+
+// Writes `value` and a newline, as `print` does, without building a string.
+inline void print_value(std::ostream& out, const std::any& value) {
+    if (auto number = std::any_cast<double>(&value)) {
+        NumberBuffer buffer;
+        out << format_number(*number, buffer) << std::endl;
+    } else if (auto string = std::any_cast<std::string>(&value)) {
+        out << *string << std::endl;
+    } else {
+        out << stringify(value) << std::endl;
+    }
+}
+} // namespace lox
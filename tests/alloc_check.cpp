@@ -0,0 +1,77 @@
+// Checks that a warmed-up interpreter runs each program given on the command
+// line without calling the global operator new, which allocation_counters.cpp
+// replaces with a counting one for this executable only. Run as
+// `alloc_check [--no-jit] [--iterations=N] files...`; exits 1 if any run
+// allocated.
+#include "../src/interpreter.hpp"
+#include "../src/parser.hpp"
+#include "../src/allocation.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+// Allocations made by `iterations` runs of `path`'s program, or -1 when it
+// can't be read, doesn't compile or fails.
+long check(const std::string& path, lox::InterpreterOptions options, int iterations) {
+    std::ifstream file(path);
+    if (!file.is_open()) return -1;
+    std::stringstream source;
+    source << file.rdbuf();
+
+    lox::TokenStream tokens = lox::Scanner(source.str()).scan_tokens();
+    if (lox::err::had_error) return -1;
+    std::vector<lox::Stmt*> statements = lox::Parser(tokens).parse();
+    if (lox::err::had_error || statements.empty()) return -1;
+
+    lox::Interpreter interpreter(options);
+
+    // Warm up until the heap has been collected twice, by which point its pool
+    // has grown to what the program needs. A program that leaves nothing on
+    // the heap never gets there.
+    for (int run = 0; run < 20 && interpreter.heap_stats().collections < 2; run++) {
+        interpreter.run(statements);
+        if (interpreter.had_runtime_error()) return -1;
+    }
+
+    size_t before = lox::alloc::count();
+    for (int run = 0; run < iterations; run++) interpreter.run(statements);
+    size_t allocations = lox::alloc::count() - before;
+
+    if (interpreter.had_runtime_error()) return -1;
+    return long(allocations);
+}
+} // namespace
+
+int main(int argc, char* argv[]) {
+    // `print` writes nowhere: a stream without a buffer drops what it is given.
+    std::ostream discard(nullptr);
+    lox::InterpreterOptions options;
+    options.out = &discard;
+    // Collect often, so that what each run leaves behind, such as its
+    // functions, is reused from the pool instead of growing it.
+    options.heap.initial_threshold = 1 << 10;
+    int iterations = 10;
+
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if      (arg == "--no-jit") options.jit = false;
+        else if (arg.starts_with("--iterations=")) iterations = std::max(1, std::atoi(arg.c_str() + 13));
+        else files.push_back(arg);
+    }
+
+    bool failed = false;
+    for (const auto& file: files) {
+        long allocations = check(file, options, iterations);
+        if (allocations < 0) std::cout << file << ": failed to run" << std::endl;
+        else std::cout << file << ": " << allocations << " allocations in " << iterations << " runs" << std::endl;
+        failed = failed || allocations != 0;
+    }
+    return failed ? 1 : 0;
+}
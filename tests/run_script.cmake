@@ -0,0 +1,16 @@
+# Runs `INTERPRETER run ARGS PROGRAM` and fails unless what it prints, on both
+# streams, is the contents of EXPECTED, and, when EXIT_CODE is given, it exits
+# with that code.
+separate_arguments(args UNIX_COMMAND "${ARGS}")
+execute_process(
+    COMMAND ${INTERPRETER} run ${args} ${PROGRAM}
+    OUTPUT_VARIABLE output
+    ERROR_VARIABLE output
+    RESULT_VARIABLE result)
+file(READ ${EXPECTED} expected)
+if(NOT output STREQUAL expected)
+    message(FATAL_ERROR "${PROGRAM} printed:\n${output}\nexpected:\n${expected}")
+endif()
+if(DEFINED EXIT_CODE AND NOT result EQUAL EXIT_CODE)
+    message(FATAL_ERROR "${PROGRAM} exited with ${result}, expected ${EXIT_CODE}")
+endif()